@@ -10,7 +10,10 @@ using std::priority_queue;
 
 #include <algorithm>
 
-inline double score( const vector<double>& s, const vector<double>& l, const vector<double>& r, unsigned int i)
+// the next position in a ring buffer of size n, without the division of a modulo
+inline unsigned int ring_next(unsigned int i, unsigned int n) { return i+1 == n ? 0 : i+1; }
+
+inline double score( const double* s, const vector<double>& l, const vector<double>& r, unsigned int i)
 {
   double score = 0;
   for (int j=0; j<l.size(); j++) {
@@ -23,6 +26,12 @@ inline double score( const vector<double>& s, const vector<double>& l, const vec
 }
 
 vector<tuple<DoublePair, unsigned int>> c_d_w::conv_pla(const vector<double> &s, unsigned int num_params, const vector<double>& l, const vector<double>& r)
+{
+  return conv_pla(s.data(), s.size(), num_params, l, r);
+}
+
+// conv_pla given the score of each point i of s for l.size() <= i < size-r.size()
+vector<tuple<DoublePair, unsigned int>> conv_pla_scored(const double* s, unsigned int size, unsigned int num_params, const double* scores, const vector<double>& l, const vector<double>& r)
 {
   unsigned int ns = num_params / 3; // ns is number of segments
   
@@ -45,12 +54,12 @@ vector<tuple<DoublePair, unsigned int>> c_d_w::conv_pla(const vector<double> &s,
   unsigned int buffer_max_ind = 0;
 
   unsigned int start = l.size();
-  unsigned int end = s.size() - r.size() - 1;
+  unsigned int end = size - r.size() - 1;
 
   for (int i=start; i<=end; i++) {
-    buffer_last = (buffer_last+1) % buffer.size(); 
-    buffer[buffer_last] = score(s, l, r, i);
-    middle = (middle + 1) % buffer.size();
+    buffer_last = ring_next(buffer_last, buffer.size());
+    buffer[buffer_last] = scores[i];
+    middle = ring_next(middle, buffer.size());
     if (buffer_max_ind == buffer_last) { // best was element we overwrote
       for (unsigned int i=0; i<buffer.size(); i++) {
 	if (buffer[i] > buffer_max_val) {
@@ -72,7 +81,7 @@ vector<tuple<DoublePair, unsigned int>> c_d_w::conv_pla(const vector<double> &s,
   }
   // at end we ensure that elements that could still be splits are added as well
   while (middle != buffer_last) {
-    middle = (middle+1) % buffer.size();
+    middle = ring_next(middle, buffer.size());
     end++;
     if (buffer[middle] != -1 && buffer_max_ind == middle) {
       if (std::get<1>( p_q.top() ) < buffer[middle]) {
@@ -86,19 +95,47 @@ vector<tuple<DoublePair, unsigned int>> c_d_w::conv_pla(const vector<double> &s,
     split_indexes[i] = std::get<0>(p_q.top());
     p_q.pop();
   }
-  split_indexes.push_back(s.size() - 1);
+  split_indexes.push_back(size - 1);
   std::sort(split_indexes.begin(), split_indexes.end());
 
   vector<tuple<DoublePair, unsigned int>> apla(ns);
   for (int i=0; i<ns; i++) {
     unsigned int end_index = split_indexes[i];
     if (i==0) {
-      apla[i] = { pla::regression(s.data(), s.data()+end_index), end_index };
+      apla[i] = { pla::regression(s, s+end_index), end_index };
     } else {
       unsigned int start_index = std::get<1>( apla[i-1] ) + 1;
-      apla[i] = { pla::regression(s.data() + start_index, s.data() + end_index), end_index } ;
+      apla[i] = { pla::regression(s + start_index, s + end_index), end_index } ;
     }
   }
   
   return apla;
 }
+
+vector<tuple<DoublePair, unsigned int>> c_d_w::conv_pla(const double* s, unsigned int size, unsigned int num_params, const vector<double>& l, const vector<double>& r)
+{
+  vector<double> scores(size, 0.0);
+  for (unsigned int i=l.size(); i+r.size()<size; i++) scores[i] = score(s, l, r, i);
+  return conv_pla_scored(s, size, num_params, scores.data(), l, r);
+}
+
+vector<tuple<DoublePair, unsigned int>> c_d_w::ConvPla::operator()(const double* s, unsigned int size, unsigned int num_params)
+{
+  const bool slid = size == last_window.size() && size > l.size() + r.size() && std::equal(s, s+size-1, last_window.begin()+1);
+  if (slid) { // slid a point, only the newest point is scored
+    head++;
+    scores.push_back(0.0);
+    scores[head + size-r.size()-1] = score(s, l, r, size-r.size()-1);
+  } else {
+    head = 0;
+    scores.reserve(2*size);
+    scores.assign(size, 0.0);
+    for (unsigned int i=l.size(); i+r.size()<size; i++) scores[i] = score(s, l, r, i);
+  }
+  if (head >= size) { // shift the scores of the window back to the front
+    scores.erase(scores.begin(), scores.begin()+head);
+    head = 0;
+  }
+  last_window.assign(s, s+size);
+  return conv_pla_scored(s, size, num_params, scores.data()+head, l, r);
+}
@@ -20,6 +20,33 @@ namespace c_d_w {
    * @return an Adaptive PLA representation
    */
   Seqddt conv_pla(const Seqd& s, unsigned int num_params, const Seqd& l, const Seqd& r);
+  /**
+   * @brief conv_pla as above on a view of a sequence, so a subsequence of a longer series is compressed without a copy
+   * @param s points to the first element of the sequence
+   * @param size is the length of the sequence
+   */
+  Seqddt conv_pla(const double* s, unsigned int size, unsigned int num_params, const Seqd& l, const Seqd& r);
+
+  /**
+   * @brief ConvPla is conv_pla on views of sequences as a function object, for approximating the overlapping windows of a series
+   * The score of a point depends only on its neighbours, so called on a window holding the points of the last window slid by
+   * one (eg. the windows of apla_bounds::SubseqCoverStream) it reuses the scores of the overlap and only scores the newest point.
+   * The overlap is compared by value against a copy of the last window, so a window that merely lies one past the last in memory
+   * after its points were rewritten (or another series was allocated there) is scored in full.
+   * The scores are held by the object, so a copy must not be called by two threads at once.
+   */
+  class ConvPla {
+  private:
+    Seqd l;
+    Seqd r;
+    Seqd last_window; // the points of the last window
+    Seqd scores; // scores[head+i] is the score of point i of the last window
+    unsigned int head = 0;
+
+  public:
+    ConvPla(const Seqd& l, const Seqd& r) : l(l), r(r) {}
+    Seqddt operator()(const double* s, unsigned int size, unsigned int num_params);
+  };
 }
 
 #endif
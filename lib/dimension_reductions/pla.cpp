@@ -122,3 +122,12 @@ vector<double> pla::apla_to_seq(const std::vector<std::tuple<DoublePair, unsigne
   }
   return seq;
 }
+
+pla::APLA_DRT_PTR pla::drt_on_ptrs(APLA_DRT f)
+{
+  vector<double> buffer;
+  return [f, buffer](const double* s, unsigned int size, unsigned int num_params) mutable {
+    buffer.assign(s, s+size);
+    return f(buffer, num_params);
+  };
+}
@@ -107,6 +107,15 @@ std::vector<double> apla_to_seq(const std::vector< std::tuple<DoublePair, unsign
  * @brief APLA_DRT represents a function that takes a series and target dimension and returns the sorted array of APLA segments
  */
 using APLA_DRT = std::function< std::vector<std::tuple<DoublePair, unsigned int>>(const std::vector<double>&, unsigned int)>;
+/**
+ * @brief APLA_DRT_PTR is APLA_DRT taking a view of the series (its first point and size), so subsequences of a longer series need not be copied
+ */
+using APLA_DRT_PTR = std::function< std::vector<std::tuple<DoublePair, unsigned int>>(const double*, unsigned int, unsigned int)>;
+/**
+ * @brief drt_on_ptrs adapts an APLA_DRT to take a view, copying the viewed series into a buffer held by the returned function
+ * The buffer is reused between calls, so a copy of the returned function must not be called by two threads at once.
+ */
+APLA_DRT_PTR drt_on_ptrs(APLA_DRT f);
 /**
  * @brief APLA is a fixed length array of segments that ensures the dimension of an approximation are all the same
  */
@@ -123,11 +132,12 @@ template <unsigned int NS>
 std::vector<APLA<NS>> apla_drt_on_subseqs( const std::vector<double>& q, unsigned int subseq_size, APLA_DRT f)
 {
   std::vector<APLA<NS>> subseqs_compr;
+  std::vector<double> q_i(subseq_size);
   for (int i=0; i<q.size() - subseq_size; i++) {
-    std::vector<double> q_i( q.cbegin()+i, q.cbegin()+i+subseq_size); 
+    std::copy(q.cbegin()+i, q.cbegin()+i+subseq_size, q_i.begin());
     auto apla = f(q_i,NS*3);
     APLA<NS> apla_arr;
-    std::copy(q_i.begin(), q_i.end(), apla_arr.begin());
+    std::copy(apla.begin(), apla.begin()+NS, apla_arr.begin());
     subseqs_compr.push_back( apla_arr );
   }
   return subseqs_compr;
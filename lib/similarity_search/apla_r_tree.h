@@ -0,0 +1,45 @@
+#ifndef APLA_R_TREE_H
+#define APLA_R_TREE_H
+
+#include "r_tree.h"
+#include "lower_bounds_apla.h"
+#include "lower_bounds.h"
+
+/**
+ * @file apla_r_tree.h
+ * @brief apla_r_tree.h names the r trees indexing Partition Covers through compile time traits
+ */
+
+/**
+ * @brief AplaRTree is the r tree of Partition Covers with the functions on them inlined, constructed from just the entry limits
+ */
+template <unsigned int S, typename I = unsigned int, SplitPolicy P = SplitPolicy::QUADRATIC>
+using AplaRTree = RTree<apla_bounds::AplaMBR<S>, I, P, apla_bounds::AplaTraits<S>>;
+/**
+ * @brief AplaSoARTree is AplaRTree for the struct of arrays layout of Partition Covers
+ */
+template <unsigned int S, typename I = unsigned int, SplitPolicy P = SplitPolicy::QUADRATIC>
+using AplaSoARTree = RTree<apla_bounds::AplaMBRSoA<S>, I, P, apla_bounds::AplaSoATraits<S>>;
+/**
+ * @brief AplaCompactRTree is AplaRTree storing the compact (float and 16 bit) form of Partition Covers, in 2.4x less space
+ */
+template <unsigned int S, typename I = unsigned int, SplitPolicy P = SplitPolicy::QUADRATIC>
+using AplaCompactRTree = RTree<apla_bounds::AplaCompactMBR<S>, I, P, apla_bounds::AplaCompactTraits<S>>;
+
+/**
+ * @brief RTreeLeafBound of leaves holding the APLA of their subsequence, the distance between the regressions of the query and the lines
+ */
+template <unsigned int S>
+struct RTreeLeafBound<apla_bounds::AplaLeaf<S>> {
+  static constexpr bool enabled = true;
+  static inline double dist_sqr(const std::vector<double>& q, const apla_bounds::AplaLeaf<S>& leaf) { return apla_bounds::leaf_lb_sqr(q, leaf.apla.data(), S); }
+  static inline double dist_sqr(const apla_bounds::PreparedQuery& pq, const apla_bounds::AplaLeaf<S>& leaf) { return apla_bounds::leaf_lb_sqr(pq, leaf.apla.data(), S); }
+};
+/**
+ * @brief AplaLeafRTree is AplaRTree whose leaves hold the APLA of their subsequence (see apla_bounds::vec_to_subseq_leaves),
+ * so searches skip retrieving the subsequences their APLA rules out
+ */
+template <unsigned int S, SplitPolicy P = SplitPolicy::QUADRATIC>
+using AplaLeafRTree = RTree<apla_bounds::AplaMBR<S>, apla_bounds::AplaLeaf<S>, P, apla_bounds::AplaTraits<S>>;
+
+#endif
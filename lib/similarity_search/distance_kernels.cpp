@@ -0,0 +1,134 @@
+#include "distance_kernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DISTANCE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using distance_kernels::Kernel;
+
+namespace {
+
+double scalar_l2_sqr(const double* s1, const double* s2, std::size_t len, double threshold, unsigned long* points_skipped)
+{
+  double se = 0;
+  for (std::size_t i=0; i<len; ++i) {
+    se += (s1[i] - s2[i]) * (s1[i] - s2[i]);
+    if (se > threshold) {
+      if (points_skipped != nullptr) *points_skipped += len - i - 1;
+      return se;
+    }
+  }
+  return se;
+}
+
+#ifdef DISTANCE_X86_KERNELS
+/*
+ * The vector kernels sum blocks of 16 points into two accumulators, and reduce them the same way whether checking against
+ * the threshold after a block or finishing, so abandoning never changes a distance that comes in under the threshold.
+ * The points past the last whole block are added one at a time after the reduction.
+ */
+__attribute__((target("avx2")))
+inline double avx2_reduce(__m256d acc0, __m256d acc1)
+{
+  alignas(32) double ds[4];
+  _mm256_store_pd(ds, _mm256_add_pd(acc0, acc1));
+  return (ds[0] + ds[1]) + (ds[2] + ds[3]);
+}
+
+__attribute__((target("avx2")))
+double avx2_l2_sqr(const double* s1, const double* s2, std::size_t len, double threshold, unsigned long* points_skipped)
+{
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+  std::size_t i = 0;
+  for (; i+16<=len; i+=16) {
+    for (std::size_t j=0; j<16; j+=8) {
+      const __m256d d0 = _mm256_sub_pd( _mm256_loadu_pd(s1+i+j), _mm256_loadu_pd(s2+i+j) );
+      const __m256d d1 = _mm256_sub_pd( _mm256_loadu_pd(s1+i+j+4), _mm256_loadu_pd(s2+i+j+4) );
+      acc0 = _mm256_add_pd( acc0, _mm256_mul_pd(d0, d0) );
+      acc1 = _mm256_add_pd( acc1, _mm256_mul_pd(d1, d1) );
+    }
+    if (threshold != std::numeric_limits<double>::infinity()) {
+      double se = avx2_reduce(acc0, acc1);
+      if (se > threshold) {
+	if (points_skipped != nullptr) *points_skipped += len - i - 16;
+	return se;
+      }
+    }
+  }
+  double se = avx2_reduce(acc0, acc1);
+  for (; i<len; ++i) se += (s1[i] - s2[i]) * (s1[i] - s2[i]);
+  return se;
+}
+
+__attribute__((target("avx512f")))
+inline double avx512_reduce(__m512d acc0, __m512d acc1)
+{
+  alignas(64) double ds[8];
+  _mm512_store_pd(ds, _mm512_add_pd(acc0, acc1));
+  return ((ds[0] + ds[1]) + (ds[2] + ds[3])) + ((ds[4] + ds[5]) + (ds[6] + ds[7]));
+}
+
+__attribute__((target("avx512f")))
+double avx512_l2_sqr(const double* s1, const double* s2, std::size_t len, double threshold, unsigned long* points_skipped)
+{
+  __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+  std::size_t i = 0;
+  for (; i+16<=len; i+=16) {
+    const __m512d d0 = _mm512_sub_pd( _mm512_loadu_pd(s1+i), _mm512_loadu_pd(s2+i) );
+    const __m512d d1 = _mm512_sub_pd( _mm512_loadu_pd(s1+i+8), _mm512_loadu_pd(s2+i+8) );
+    acc0 = _mm512_add_pd( acc0, _mm512_mul_pd(d0, d0) );
+    acc1 = _mm512_add_pd( acc1, _mm512_mul_pd(d1, d1) );
+    if (threshold != std::numeric_limits<double>::infinity()) {
+      double se = avx512_reduce(acc0, acc1);
+      if (se > threshold) {
+	if (points_skipped != nullptr) *points_skipped += len - i - 16;
+	return se;
+      }
+    }
+  }
+  double se = avx512_reduce(acc0, acc1);
+  for (; i<len; ++i) se += (s1[i] - s2[i]) * (s1[i] - s2[i]);
+  return se;
+}
+#endif
+
+}
+
+bool distance_kernels::kernel_supported(Kernel kernel)
+{
+  switch (kernel) {
+    case Kernel::SCALAR: return true;
+#ifdef DISTANCE_X86_KERNELS
+    case Kernel::AVX2: return __builtin_cpu_supports("avx2");
+    case Kernel::AVX512: return __builtin_cpu_supports("avx512f");
+#endif
+    default: return false;
+  }
+}
+Kernel distance_kernels::best_kernel()
+{
+  static const Kernel best = kernel_supported(Kernel::AVX512) ? Kernel::AVX512
+			   : kernel_supported(Kernel::AVX2) ? Kernel::AVX2
+			   : Kernel::SCALAR;
+  return best;
+}
+
+double distance_kernels::l2_sqr(const double* s1, const double* s2, std::size_t len, Kernel kernel, double threshold, unsigned long* points_skipped)
+{
+  switch (kernel) {
+#ifdef DISTANCE_X86_KERNELS
+    case Kernel::AVX2: return avx2_l2_sqr(s1, s2, len, threshold, points_skipped);
+    case Kernel::AVX512: return avx512_l2_sqr(s1, s2, len, threshold, points_skipped);
+#endif
+    default: return scalar_l2_sqr(s1, s2, len, threshold, points_skipped);
+  }
+}
+double distance_kernels::l2_sqr(const double* s1, const double* s2, std::size_t len)
+{
+  return l2_sqr(s1, s2, len, best_kernel());
+}
+double distance_kernels::l2_sqr_early_abandon(const double* s1, const double* s2, std::size_t len, double threshold, unsigned long* points_skipped)
+{
+  return l2_sqr(s1, s2, len, best_kernel(), threshold, points_skipped);
+}
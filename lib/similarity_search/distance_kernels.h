@@ -0,0 +1,53 @@
+#ifndef DISTANCE_KERNELS_H
+#define DISTANCE_KERNELS_H
+
+#include <cstddef>
+#include <limits>
+
+/**
+ * @file distance_kernels.h
+ * @brief Header file for the kernels of the squared l2 distance between two sequences, shared by the scans and error measures
+ */
+
+/**
+ * @brief distance_kernels is namespace for the implementations of the squared l2 distance, picked at runtime by the cpu
+ */
+namespace distance_kernels {
+  /**
+   * @brief Kernel names the implementations of l2_sqr
+   * The vector kernels keep several sums of 4 (AVX2) or 8 (AVX-512) points at once, so their result differs from the scalar
+   * kernel's in the last bits. Each kernel gives the same distance bit for bit whether or not it is given a threshold.
+   */
+  enum class Kernel { SCALAR, AVX2, AVX512 };
+  /**
+   * @brief kernel_supported returns true if the kernel was compiled in and the cpu running it supports it
+   */
+  bool kernel_supported(Kernel kernel);
+  /**
+   * @brief best_kernel returns the widest kernel supported by the cpu, found once at the first call
+   */
+  Kernel best_kernel();
+
+  /**
+   * @brief l2_sqr returns the squared error between two sequences of the same size
+   * @param s1 points to the first sequence
+   * @param s2 points to the second sequence
+   * @param len is the size of both sequences
+   * @param kernel is the implementation to use, it must be supported (see kernel_supported)
+   * @param threshold is the error above which the exact value is not needed
+   * @param points_skipped if given is increased by the number of points left unvisited when abandoning
+   * @return the squared error if it is at most threshold, otherwise a partial sum already above threshold
+   * The vector kernels compare the sum against threshold every 16 points.
+   */
+  double l2_sqr(const double* s1, const double* s2, std::size_t len, Kernel kernel, double threshold = std::numeric_limits<double>::infinity(), unsigned long* points_skipped=nullptr);
+  /**
+   * @brief l2_sqr is l2_sqr with the best kernel for the cpu
+   */
+  double l2_sqr(const double* s1, const double* s2, std::size_t len);
+  /**
+   * @brief l2_sqr_early_abandon is l2_sqr with the best kernel for the cpu, abandoned once the sum exceeds threshold
+   */
+  double l2_sqr_early_abandon(const double* s1, const double* s2, std::size_t len, double threshold, unsigned long* points_skipped=nullptr);
+};
+
+#endif
@@ -1,24 +1,29 @@
 #include "error_measures.h"
+#include "distance_kernels.h"
 
 #include <algorithm>
 #include <cmath>
 using std::vector;
 
+namespace {
+  // the number of points of the shorter sequence, the end pointers pointing at the last point
+  std::size_t common_len(const double* const s1_start, const double* const s1_end, const double* const s2_start, const double* const s2_end)
+  {
+    return std::max( std::min( s1_end-s1_start, s2_end-s2_start ) + 1, (std::ptrdiff_t) 0 );
+  }
+}
+
 double error_measures::se_between_seq(const vector<double>& s1, const vector<double>& s2)
 {
-  double se = 0;
-  for (int i=0; i<std::min( s1.size(), s2.size() ); ++i) {
-    se += (s1[i] - s2[i]) * (s1[i] - s2[i]);
-  }
-  return se;
+  return distance_kernels::l2_sqr(s1.data(), s2.data(), std::min( s1.size(), s2.size() ));
 }
 double error_measures::se_between_ptrs(const double* const s1_start, const double* const s1_end, const double* const s2_start, const double* const s2_end)
 {
-  double se = 0;
-  for (int i=0; i<=std::min( s1_end-s1_start, s2_end-s2_start ); ++i) {
-    se += ( s1_start[i] - s2_start[i]) * (s1_start[i] - s2_start[i]);
-  }
-  return se;
+  return distance_kernels::l2_sqr(s1_start, s2_start, common_len(s1_start, s1_end, s2_start, s2_end));
+}
+double error_measures::se_between_ptrs_early_abandon(const double* const s1_start, const double* const s1_end, const double* const s2_start, const double* const s2_end, double threshold, unsigned long* points_skipped)
+{
+  return distance_kernels::l2_sqr_early_abandon(s1_start, s2_start, common_len(s1_start, s1_end, s2_start, s2_end), threshold, points_skipped);
 }
 double error_measures::mse_between_seq(const vector<double>& s1, const vector<double>& s2)
 {
@@ -32,6 +32,17 @@ namespace error_measures {
    * @param s2_end is a constant pointer to a second sequence end
    */
   double se_between_ptrs(const double* const s1_start, const double* const s1_end, const double* const s2_start, const double* const s2_end);
+  /**
+   * @brief se_between_ptrs_early_abandon returns the squared error between two sequences, stopping once it exceeds threshold
+   * @param s1_start is a constant pointer to a first sequence start
+   * @param s1_end is a constant pointer to a first sequence end
+   * @param s2_start is a constant pointer to a second sequence start
+   * @param s2_end is a constant pointer to a second sequence end
+   * @param threshold is the error above which the exact value is not needed
+   * @param points_skipped if given is increased by the number of points left unvisited when abandoning
+   * @return the squared error if it is at most threshold, otherwise a partial sum already above threshold
+   */
+  double se_between_ptrs_early_abandon(const double* const s1_start, const double* const s1_end, const double* const s2_start, const double* const s2_end, double threshold, unsigned long* points_skipped=nullptr);
   /**
    * @brief l2_between_seq returns the euclidean distance between two sequences
    * @param s1 is a constant reference to the first sequence
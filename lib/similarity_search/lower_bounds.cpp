@@ -7,12 +7,12 @@ inline double sqr(double a) { return a * a; }
 
 inline double dist_lines_sqr(const DoublePair& dp1, const DoublePair& dp2, unsigned int len)
 {
-  return len * sqr( dp1[0]-dp2[0] ) + (dp1[0]-dp1[1])*(dp1[1]-dp2[1])*len*(len-1) + sqr( dp1[1]-dp2[1] )*len*(len-1)*(2*len-1)/6;
+  return len * sqr( dp1[0]-dp2[0] ) + (dp1[0]-dp2[0])*(dp1[1]-dp2[1])*len*(len-1) + sqr( dp1[1]-dp2[1] )*len*(len-1)*(2*len-1)/6;
 }
 
 double lower_bounds::dist_pla_lb_sqr(const Seqd &q, const Seqddt &s)
 {
-  double error;
+  double error = 0.0;
   int start_i = 0;
   for (const auto& [dp,end_i] : s) {
     DoublePair q_reg = pla::regression( q.data()+start_i, q.data()+end_i );
@@ -30,6 +30,8 @@ namespace lower_bounds {
    * @brief dist_pla_lb_sqr returns the squared l2 distance between series q and compressed s
    * @param q is uncompressed series
    * @param s is compressed series
+   * The distance between the regressions of q and the lines of s over each segment, a lower bound of the distance between q
+   * and the uncompressed series when the lines of s are the regressions of its segments.
    */
   double dist_pla_lb_sqr(const Seqd& q, const Seqddt& s);
   /**
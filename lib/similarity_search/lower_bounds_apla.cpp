@@ -0,0 +1,384 @@
+#include "lower_bounds_apla.h"
+
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define APLA_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using apla_bounds::Region;
+using apla_bounds::DistKernel;
+
+namespace {
+
+/**
+ * @brief ActiveRegions is the window of regions of a Partition Cover overlapping the current point of a query
+ * The point's distance to the cover is its least distance to a region of the window.
+ */
+struct ActiveRegions {
+  const Region* regions;
+  int last;
+  int start;
+  int end;
+
+  ActiveRegions(const Region* regions, unsigned int num_regions) : regions(regions), last(num_regions-1), start(0), end(0)
+  {
+    while ( end <= last && regions[end].min_i == 0 ) end++;
+    end--;
+  }
+  // moves the window to the point at time i, the points must be visited in time order
+  inline void advance(unsigned int i)
+  {
+    while ( start < last && regions[start].max_i < i ) start++;
+    while ( end < last && regions[end+1].min_i <= i ) end++;
+  }
+  // returns the first time after the current point at which the window changes
+  inline unsigned int next_change() const
+  {
+    unsigned int change = std::numeric_limits<unsigned int>::max();
+    if (start < last) change = regions[start].max_i + 1;
+    if (end < last) change = std::min(change, regions[end+1].min_i);
+    return change;
+  }
+};
+
+// moves the window over the W points from time i, keeping the window of each point, returns false if one is empty
+template <int W>
+inline bool block_windows(ActiveRegions& active, unsigned int i, int* starts, int* ends)
+{
+  bool all_active = true;
+  for (int l=0; l<W; l++) {
+    active.advance(i+l);
+    starts[l] = active.start;
+    ends[l] = active.end;
+    all_active &= active.start <= active.end;
+  }
+  return all_active;
+}
+// adds the distance of the W points from time i one at a time, in the same order as the scalar kernel
+template <int W>
+inline double block_dist_scalar(double dist, const double* q, const Region* regions, unsigned int i, const int* starts, const int* ends)
+{
+  for (int l=0; l<W; l++) dist += apla_bounds::dist_to_regions_sqr(q[i+l], regions + starts[l], regions + ends[l], i+l);
+  return dist;
+}
+
+double scalar_dist_sqr(const double* q, unsigned int q_size, const Region* regions, unsigned int num_regions, double threshold)
+{
+  ActiveRegions active(regions, num_regions);
+  double dist = 0.0;
+  for (unsigned int i=0; i<q_size; i++) {
+    active.advance(i);
+    dist += apla_bounds::dist_to_regions_sqr(q[i], regions + active.start, regions + active.end, i);
+    if (dist > threshold) return dist;
+  }
+  return dist;
+}
+
+// the squared distance from v to the interval [lo, hi]
+inline double interval_dist_sqr(double v, double lo, double hi)
+{
+  if (v < lo) return (lo-v)*(lo-v);
+  if (v > hi) return (v-hi)*(v-hi);
+  return 0.0;
+}
+// interval_dist_sqr without branches, for lo <= hi
+inline double band_dist_sqr(double v, double lo, double hi)
+{
+  double d = std::max(lo - v, 0.0) + std::max(v - hi, 0.0);
+  return d*d;
+}
+
+// lower bound of the distance of the points a..b of a prepared query to the window start..end of regions, every point having that window
+inline double segment_lb_sqr(const apla_bounds::PreparedQuery& pq, const Region* regions, int start, int end, unsigned int a, unsigned int b)
+{
+  // the lower (upper) envelope of the lines of the window is concave (convex), so its chord over the segment lies below (above) it
+  double lo_a = std::numeric_limits<double>::infinity(), lo_b = lo_a;
+  double hi_a = -lo_a, hi_b = -lo_a;
+  for (int r=start; r<=end; r++) {
+    const Region& reg = regions[r];
+    lo_a = std::min(lo_a, reg.min_dp[1] * ((double) a - reg.min_i) + reg.min_dp[0]);
+    lo_b = std::min(lo_b, reg.min_dp[1] * ((double) b - reg.min_i) + reg.min_dp[0]);
+    hi_a = std::max(hi_a, reg.max_dp[1] * ((double) a - reg.min_i) + reg.max_dp[0]);
+    hi_b = std::max(hi_b, reg.max_dp[1] * ((double) b - reg.min_i) + reg.max_dp[0]);
+  }
+  if (a == b) return interval_dist_sqr(pq.series[a], lo_a, hi_a);
+  if (hi_a < lo_a || hi_b < lo_b) return 0.0; // crossed lines bound no band
+
+  // the segment is x = 0..n-1 around its middle h, projected onto the unit vectors along its mean and along x-h
+  const unsigned int n = b - a + 1;
+  const apla_bounds::SegmentProjection& proj = pq.projections[n];
+  const double sum_q = pq.sums[b+1] - pq.sums[a];
+  const double centred_q = (pq.index_sums[b+1] - pq.index_sums[a]) - (a + proj.h) * sum_q;
+  double mean_lb = band_dist_sqr(sum_q, proj.half_n * (lo_a+lo_b), proj.half_n * (hi_a+hi_b)) * proj.inv_n;
+
+  // the band is the lower chord plus a width w(x) >= 0, adding between the negative and positive parts of its sum along x-h
+  const double w_a = hi_a - lo_a;
+  const double w_change = (hi_b - lo_b) - w_a;
+  const double w_neg = w_a * proj.neg_centred + w_change * proj.neg_centred_change;
+  const double w_pos = w_change * proj.chord_centred - w_neg;
+  const double centred_lo = (lo_b - lo_a) * proj.chord_centred;
+  double slope_lb = band_dist_sqr(centred_q, centred_lo + w_neg, centred_lo + w_pos) * proj.inv_centred_sqr;
+
+  return mean_lb + slope_lb;
+}
+
+#ifdef APLA_X86_KERNELS
+/*
+ * The vector kernels take the regions overlapping any point of a block, and for each evaluate its lines at every point
+ * of the block, masking the points outside of the region's window. The arithmetic is that of dist_to_region_sqr
+ * (multiplies and adds are never fused, see CMakeLists.txt) and the least distances of the points are summed in time order,
+ * so the distance is the same as the scalar kernel's to the bit.
+ */
+// dist_to_region_sqr of the 4 points qv at the times iv
+__attribute__((target("avx2")))
+inline __m256d avx2_region_dist_sqr(__m256d qv, __m256d iv, const Region& r)
+{
+  const __m256d x = _mm256_sub_pd( iv, _mm256_set1_pd(r.min_i) );
+  const __m256d min_est = _mm256_add_pd( _mm256_mul_pd( _mm256_set1_pd(r.min_dp[1]), x ), _mm256_set1_pd(r.min_dp[0]) );
+  const __m256d max_est = _mm256_add_pd( _mm256_mul_pd( _mm256_set1_pd(r.max_dp[1]), x ), _mm256_set1_pd(r.max_dp[0]) );
+  const __m256d below = _mm256_sub_pd(qv, min_est);
+  const __m256d above = _mm256_sub_pd(qv, max_est);
+  __m256d rd = _mm256_and_pd( _mm256_mul_pd(above, above), _mm256_cmp_pd(qv, max_est, _CMP_GT_OQ) );
+  return _mm256_blendv_pd( rd, _mm256_mul_pd(below, below), _mm256_cmp_pd(qv, min_est, _CMP_LT_OQ) );
+}
+__attribute__((target("avx2")))
+inline double add_in_order(double dist, __m256d d)
+{
+  alignas(32) double ds[4];
+  _mm256_store_pd(ds, d);
+  for (int l=0; l<4; l++) dist += ds[l];
+  return dist;
+}
+
+__attribute__((target("avx2")))
+double avx2_dist_sqr(const double* q, unsigned int q_size, const Region* regions, unsigned int num_regions, double threshold)
+{
+  const __m256d inf = _mm256_set1_pd( std::numeric_limits<double>::infinity() );
+  ActiveRegions active(regions, num_regions);
+  double dist = 0.0;
+  unsigned int i = 0;
+  for (; i+4 <= q_size; i+=4) {
+    active.advance(i);
+    if (i+4 <= active.next_change() && active.start <= active.end) {
+      // every point of the block shares the window, so no point is masked
+      const __m256d qv = _mm256_loadu_pd(q+i);
+      const __m256d iv = _mm256_set_pd(i+3, i+2, i+1, i);
+      __m256d min_d = inf;
+      for (int r=active.start; r<=active.end; r++) {
+	min_d = _mm256_min_pd( min_d, avx2_region_dist_sqr(qv, iv, regions[r]) );
+      }
+      dist = add_in_order(dist, min_d);
+      if (dist > threshold) return dist;
+      continue;
+    }
+    alignas(16) int starts[4], ends[4];
+    if (!block_windows<4>(active, i, starts, ends)) {
+      dist = block_dist_scalar<4>(dist, q, regions, i, starts, ends);
+      if (dist > threshold) return dist;
+      continue;
+    }
+    const __m256d qv = _mm256_loadu_pd(q+i);
+    const __m256d iv = _mm256_set_pd(i+3, i+2, i+1, i);
+    const __m256d sv = _mm256_cvtepi32_pd( _mm_load_si128((const __m128i*) starts) );
+    const __m256d ev = _mm256_cvtepi32_pd( _mm_load_si128((const __m128i*) ends) );
+    __m256d min_d = inf;
+    for (int r=starts[0]; r<=ends[3]; r++) {
+      const __m256d rv = _mm256_set1_pd(r);
+      const __m256d in_window = _mm256_and_pd( _mm256_cmp_pd(sv, rv, _CMP_LE_OQ), _mm256_cmp_pd(rv, ev, _CMP_LE_OQ) );
+      min_d = _mm256_min_pd( min_d, _mm256_blendv_pd(inf, avx2_region_dist_sqr(qv, iv, regions[r]), in_window) );
+    }
+    dist = add_in_order(dist, min_d);
+    if (dist > threshold) return dist;
+  }
+  for (; i<q_size; i++) {
+    active.advance(i);
+    dist += apla_bounds::dist_to_regions_sqr(q[i], regions + active.start, regions + active.end, i);
+  }
+  return dist;
+}
+
+// dist_to_region_sqr of the 8 points qv at the times iv
+__attribute__((target("avx512f")))
+inline __m512d avx512_region_dist_sqr(__m512d qv, __m512d iv, const Region& r)
+{
+  const __m512d x = _mm512_sub_pd( iv, _mm512_set1_pd(r.min_i) );
+  const __m512d min_est = _mm512_add_pd( _mm512_mul_pd( _mm512_set1_pd(r.min_dp[1]), x ), _mm512_set1_pd(r.min_dp[0]) );
+  const __m512d max_est = _mm512_add_pd( _mm512_mul_pd( _mm512_set1_pd(r.max_dp[1]), x ), _mm512_set1_pd(r.max_dp[0]) );
+  const __m512d below = _mm512_sub_pd(qv, min_est);
+  const __m512d above = _mm512_sub_pd(qv, max_est);
+  __m512d rd = _mm512_maskz_mul_pd( _mm512_cmp_pd_mask(qv, max_est, _CMP_GT_OQ), above, above );
+  return _mm512_mask_mul_pd( rd, _mm512_cmp_pd_mask(qv, min_est, _CMP_LT_OQ), below, below );
+}
+__attribute__((target("avx512f")))
+inline double add_in_order(double dist, __m512d d)
+{
+  alignas(64) double ds[8];
+  _mm512_store_pd(ds, d);
+  for (int l=0; l<8; l++) dist += ds[l];
+  return dist;
+}
+
+__attribute__((target("avx512f")))
+double avx512_dist_sqr(const double* q, unsigned int q_size, const Region* regions, unsigned int num_regions, double threshold)
+{
+  const __m512d inf = _mm512_set1_pd( std::numeric_limits<double>::infinity() );
+  ActiveRegions active(regions, num_regions);
+  double dist = 0.0;
+  unsigned int i = 0;
+  for (; i+8 <= q_size; i+=8) {
+    active.advance(i);
+    if (i+8 <= active.next_change() && active.start <= active.end) {
+      const __m512d qv = _mm512_loadu_pd(q+i);
+      const __m512d iv = _mm512_set_pd(i+7, i+6, i+5, i+4, i+3, i+2, i+1, i);
+      __m512d min_d = inf;
+      for (int r=active.start; r<=active.end; r++) {
+	min_d = _mm512_min_pd( min_d, avx512_region_dist_sqr(qv, iv, regions[r]) );
+      }
+      dist = add_in_order(dist, min_d);
+      if (dist > threshold) return dist;
+      continue;
+    }
+    alignas(32) int starts[8], ends[8];
+    if (!block_windows<8>(active, i, starts, ends)) {
+      dist = block_dist_scalar<8>(dist, q, regions, i, starts, ends);
+      if (dist > threshold) return dist;
+      continue;
+    }
+    const __m512d qv = _mm512_loadu_pd(q+i);
+    const __m512d iv = _mm512_set_pd(i+7, i+6, i+5, i+4, i+3, i+2, i+1, i);
+    const __m512d sv = _mm512_cvtepi32_pd( _mm256_load_si256((const __m256i*) starts) );
+    const __m512d ev = _mm512_cvtepi32_pd( _mm256_load_si256((const __m256i*) ends) );
+    __m512d min_d = inf;
+    for (int r=starts[0]; r<=ends[7]; r++) {
+      const __m512d rv = _mm512_set1_pd(r);
+      const __mmask8 in_window = _mm512_cmp_pd_mask(sv, rv, _CMP_LE_OQ) & _mm512_cmp_pd_mask(rv, ev, _CMP_LE_OQ);
+      min_d = _mm512_mask_min_pd( min_d, in_window, min_d, avx512_region_dist_sqr(qv, iv, regions[r]) );
+    }
+    dist = add_in_order(dist, min_d);
+    if (dist > threshold) return dist;
+  }
+  for (; i<q_size; i++) {
+    active.advance(i);
+    dist += apla_bounds::dist_to_regions_sqr(q[i], regions + active.start, regions + active.end, i);
+  }
+  return dist;
+}
+#endif
+
+}
+
+bool apla_bounds::dist_kernel_supported(DistKernel kernel)
+{
+  switch (kernel) {
+    case DistKernel::SCALAR: return true;
+#ifdef APLA_X86_KERNELS
+    case DistKernel::AVX2: return __builtin_cpu_supports("avx2");
+    case DistKernel::AVX512: return __builtin_cpu_supports("avx512f");
+#endif
+    default: return false;
+  }
+}
+DistKernel apla_bounds::best_dist_kernel()
+{
+  static const DistKernel best = dist_kernel_supported(DistKernel::AVX512) ? DistKernel::AVX512
+			       : dist_kernel_supported(DistKernel::AVX2) ? DistKernel::AVX2
+			       : DistKernel::SCALAR;
+  return best;
+}
+
+double apla_bounds::regions_dist_sqr(const double* q, unsigned int q_size, const Region* regions, unsigned int num_regions, DistKernel kernel, double threshold)
+{
+  switch (kernel) {
+#ifdef APLA_X86_KERNELS
+    case DistKernel::AVX2: return avx2_dist_sqr(q, q_size, regions, num_regions, threshold);
+    case DistKernel::AVX512: return avx512_dist_sqr(q, q_size, regions, num_regions, threshold);
+#endif
+    default: return scalar_dist_sqr(q, q_size, regions, num_regions, threshold);
+  }
+}
+double apla_bounds::regions_dist_sqr(const double* q, unsigned int q_size, const Region* regions, unsigned int num_regions)
+{
+  return regions_dist_sqr(q, q_size, regions, num_regions, best_dist_kernel());
+}
+
+apla_bounds::PreparedQuery::PreparedQuery(const Seqd& q) : series(q), sums(q.size()+1, 0.0), index_sums(q.size()+1, 0.0), projections(q.size()+1)
+{
+  for (unsigned int i=0; i<q.size(); i++) {
+    sums[i+1] = sums[i] + q[i];
+    index_sums[i+1] = index_sums[i] + i * q[i];
+  }
+  for (unsigned int len=2; len<=q.size(); len++) {
+    SegmentProjection& proj = projections[len];
+    const double n = len;
+    proj.h = (n-1) / 2;
+    proj.half_n = n / 2;
+    proj.inv_n = 1 / n;
+    proj.inv_centred_sqr = 12 / (n * (n*n - 1));
+    proj.chord_centred = n * (n+1) / 12;
+    // x runs over 0..m-1 before the middle, so the sums follow from the sums of x and x^2 up to m
+    const double m = len / 2;
+    const double sum_x = m * (m-1) / 2;
+    const double sum_x_sqr = m * (m-1) * (2*m-1) / 6;
+    proj.neg_centred = sum_x - m * proj.h;
+    proj.neg_centred_change = (sum_x_sqr - proj.h * sum_x) / (n-1);
+  }
+}
+
+double apla_bounds::prepared_lb_sqr(const PreparedQuery& pq, const Region* regions, unsigned int num_regions)
+{
+  const unsigned int q_size = pq.series.size();
+  ActiveRegions active(regions, num_regions);
+  double lb = 0.0;
+  for (unsigned int a=0; a<q_size; ) {
+    active.advance(a);
+    unsigned int b = std::min(active.next_change(), q_size) - 1;
+    if (active.start <= active.end) lb += segment_lb_sqr(pq, regions, active.start, active.end, a, b);
+    a = b+1;
+  }
+  // the projections are rounded differently to the distance, so a bound equal to it must not be rounded above it
+  return lb * (1 - 1e-9);
+}
+
+// the regression of the query over a segment has the mean and the sum along x-h of the segment, and its distance to a line
+//  is the distance between those of the line, which has a mean a+b*h and a sum along x-h of b times the sum of (x-h)^2
+double apla_bounds::leaf_lb_sqr(const Seqd& q, const AplaLine* lines, unsigned int num_lines)
+{
+  double lb = 0.0;
+  unsigned int a = 0;
+  for (unsigned int i=0; i<num_lines; i++) {
+    const auto& [dp,b] = lines[i];
+    const double n = b - a + 1;
+    DoublePair q_reg = pla::regression( q.data()+a, q.data()+b );
+    const double d0 = q_reg[0] - dp[0], d1 = q_reg[1] - dp[1];
+    lb += n * d0 * d0 + d0 * d1 * n * (n-1) + d1 * d1 * n * (n-1) * (2*n-1) / 6;
+    a = b+1;
+  }
+  // as prepared_lb_sqr, a bound equal to the distance must not be rounded above it
+  return lb * (1 - 1e-9);
+}
+
+double apla_bounds::leaf_lb_sqr(const PreparedQuery& pq, const AplaLine* lines, unsigned int num_lines)
+{
+  double lb = 0.0;
+  unsigned int a = 0;
+  for (unsigned int i=0; i<num_lines; i++) {
+    const auto& [dp,b] = lines[i];
+    const unsigned int n = b - a + 1;
+    const SegmentProjection& proj = pq.projections[n];
+    const double sum_q = pq.sums[b+1] - pq.sums[a];
+    const double mean_diff = sum_q / n - (dp[0] + dp[1] * proj.h);
+    lb += n * mean_diff * mean_diff;
+    if (n > 1) {
+      const double centred_q = (pq.index_sums[b+1] - pq.index_sums[a]) - (a + proj.h) * sum_q;
+      const double centred_diff = centred_q - dp[1] / proj.inv_centred_sqr;
+      lb += centred_diff * centred_diff * proj.inv_centred_sqr;
+    }
+    a = b+1;
+  }
+  // as prepared_lb_sqr, a bound equal to the distance must not be rounded above it
+  return lb * (1 - 1e-9);
+}
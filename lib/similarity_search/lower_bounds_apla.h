@@ -6,8 +6,13 @@
 #include <numeric>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <cassert>
 
 #include "pla.h"
+#include "parallel_for.h"
 
 /**
  * @file lower_bounds_apla.h
@@ -122,6 +127,35 @@ namespace apla_bounds {
     return std::accumulate(rstart, rend+1, -1.0, min_f);
   }
 
+  /**
+   * @brief DistKernel names the implementations of regions_dist_sqr, all giving the same distance bit for bit
+   * The vector kernels evaluate the lines of the regions over blocks of 4 (AVX2) or 8 (AVX-512) query points at once.
+   */
+  enum class DistKernel { SCALAR, AVX2, AVX512 };
+  /**
+   * @brief dist_kernel_supported returns true if the kernel was compiled in and the cpu running it supports it
+   */
+  bool dist_kernel_supported(DistKernel kernel);
+  /**
+   * @brief best_dist_kernel returns the widest kernel supported by the cpu, found once at the first call
+   */
+  DistKernel best_dist_kernel();
+  /**
+   * @brief regions_dist_sqr takes a time series q and the regions of a Partition Cover and returns the distance between the two
+   * @param q is a pointer to the time series (uncompressed)
+   * @param q_size is the length of q
+   * @param regions is a pointer to the regions of the Partition Cover, in time order
+   * @param num_regions is the number of regions, at least 1
+   * @param kernel is the implementation to use, it must be supported (see dist_kernel_supported)
+   * @param threshold is the distance above which the sum is abandoned, returning the part summed so far (still above threshold)
+   * @return non negative number representing distance to the mbr
+   */
+  double regions_dist_sqr(const double* q, unsigned int q_size, const Region* regions, unsigned int num_regions, DistKernel kernel, double threshold = std::numeric_limits<double>::infinity());
+  /**
+   * @brief regions_dist_sqr is regions_dist_sqr with the best kernel for the cpu
+   */
+  double regions_dist_sqr(const double* q, unsigned int q_size, const Region* regions, unsigned int num_regions);
+
   /**
    * @brief mbr_area calculates the total area of the partition cover in the plane as the sum of area of regions
    * @param mbr is a Partition Cover
@@ -146,17 +180,217 @@ namespace apla_bounds {
     }
     return ret;
   }
+  /**
+   * @brief mbr_centre calculates the centre of a partition cover as the value at the middle of each region
+   * @param mbr is a Partition Cover
+   * @return array of S coordinates, the ith being the centre of the ith region
+   */
+  template <unsigned int S>
+  std::vector<double> mbr_centre(const AplaMBR<S>& mbr)
+  {
+    std::vector<double> centre(S);
+    for (int i=0; i<S; i++) {
+      const Region& r = mbr[i];
+      double half_width = (r.max_i - r.min_i) * 0.5;
+      centre[i] = 0.5 * (r.min_dp[0] + r.min_dp[1]*half_width + r.max_dp[0] + r.max_dp[1]*half_width);
+    }
+    return centre;
+  }
   /**
    * @brief dist_to_mbr_sqr takes a time series q and Partition Cover mbr and returns the distance between the two
    * @param q is a time series (uncompressed)
    * @param mbr is a constant reference to a Partition Cover
    * @return non negative number representing distance to the mbr
+   * The regions are evaluated by the widest kernel the cpu supports, see regions_dist_sqr
    */
   template <unsigned int S>
   double dist_to_mbr_sqr( const Seqd& q, const AplaMBR<S>& mbr ) {
+    return regions_dist_sqr(q.data(), q.size(), mbr.data(), S);
+  }
+
+  /**
+   * @brief SegmentProjection holds the constants projecting a segment of n points onto its mean and its centred slope
+   * A line through the segment with a change of d from its first to last point has d * chord_centred along x-h,
+   * and a width growing from w to w+d adds w * neg_centred + d * neg_centred_change over the points before the middle.
+   */
+  struct SegmentProjection {
+    double h = 0; // the middle of the segment, (n-1)/2
+    double half_n = 0;
+    double inv_n = 0;
+    double inv_centred_sqr = 0; // one over the sum of (x-h)^2
+    double chord_centred = 0; // n(n+1)/12
+    double neg_centred = 0; // the sum of x-h before the middle
+    double neg_centred_change = 0; // the sum of x(x-h)/(n-1) before the middle
+  };
+  /**
+   * @brief PreparedQuery is a query with the sums a search needs to bound its distance to many Partition Covers cheaply
+   * It is built once per search. The projection of the query onto the mean and slope of any segment (its regression) follows
+   * from the prefix sums and the constants of the segment's length in constant time, so prepared_lb_sqr costs a step per window
+   * of regions of a cover rather than a step per point of the query.
+   */
+  struct PreparedQuery {
+    Seqd series;
+    std::vector<double> sums; // sums[i] is the sum of the first i points
+    std::vector<double> index_sums; // index_sums[i] is the sum of the first i points each times its index
+    std::vector<SegmentProjection> projections; // indexed by the length of the segment
+
+    explicit PreparedQuery(const Seqd& q);
+  };
+  /**
+   * @brief prepared_lb_sqr returns a lower bound of regions_dist_sqr from the sums of a prepared query
+   * @param pq is the prepared query
+   * @param regions is a pointer to the regions of the Partition Cover, in time order
+   * @param num_regions is the number of regions, at least 1
+   * @return non negative lower bound of the distance between the query and the cover
+   * Over each segment of the query with the same window of regions, the query and the band of the window are projected
+   * onto the segment's mean and slope, and the distance between the projections bounds the distance of the segment.
+   */
+  double prepared_lb_sqr(const PreparedQuery& pq, const Region* regions, unsigned int num_regions);
+  /**
+   * @brief dist_to_mbr_sqr for a prepared query, only as tight as threshold needs
+   * @param pq is the prepared query
+   * @param mbr is a constant reference to a Partition Cover
+   * @param threshold is the distance beyond which the exact distance is not needed (eg. the kth least error of a knn search)
+   * @return the distance to the mbr if it is at most threshold, otherwise a lower bound of it above threshold
+   */
+  template <unsigned int S>
+  double dist_to_mbr_sqr( const PreparedQuery& pq, const AplaMBR<S>& mbr, double threshold ) {
+    if (threshold < std::numeric_limits<double>::infinity()) { // no bound is above an infinite threshold
+      double lb = prepared_lb_sqr(pq, mbr.data(), S);
+      if (lb > threshold) return lb;
+    }
+    return regions_dist_sqr(pq.series.data(), pq.series.size(), mbr.data(), S, best_dist_kernel(), threshold);
+  }
+
+  /**
+   * @brief AplaLine is a line of an APLA alongside the index of the last point of its segment
+   */
+  struct AplaLine {
+    DoublePair dp;
+    unsigned int end;
+  };
+  /**
+   * @brief AplaLeaf is the index of a leaf entry holding the APLA of its subsequence alongside its position
+   * Its lines are the regressions of the segments of the subsequence, so the distance between the regressions of a query
+   * over the same segments and the lines bounds the distance to the subsequence without retrieving it
+   * (see lower_bounds::dist_pla_lb_sqr). The S lines are held in place, so trees of leaves can be saved and mapped, and
+   * leaves are equal when they index the same subsequence, so they can be removed and updated.
+   */
+  template <unsigned int S>
+  struct AplaLeaf {
+    unsigned int start; // the position of the subsequence in the series
+    std::array<AplaLine, S> apla;
+
+    bool operator==(const AplaLeaf& other) const { return start == other.start; }
+  };
+  /**
+   * @brief leaf_lb_sqr is lower_bounds::dist_pla_lb_sqr for the lines of a leaf
+   * @param q is the query
+   * @param lines is a pointer to the lines of the leaf, in time order
+   * @param num_lines is the number of lines
+   * @return non negative lower bound of the distance between the query and the subsequence of the leaf
+   */
+  double leaf_lb_sqr(const Seqd& q, const AplaLine* lines, unsigned int num_lines);
+  /**
+   * @brief leaf_lb_sqr as above for a prepared query, finding its regressions from its sums in a step per segment
+   * @param pq is the prepared query
+   * @param lines is a pointer to the lines of the leaf, in time order
+   * @param num_lines is the number of lines
+   * @return non negative lower bound of the distance between the query and the subsequence of the leaf
+   */
+  double leaf_lb_sqr(const PreparedQuery& pq, const AplaLine* lines, unsigned int num_lines);
+
+
+  /**
+   * @brief AplaMBRSoA is a Partition Cover stored as a struct of arrays, each field of the regions lying contiguously
+   * Scanning one field across all regions (as the distance to a series does) then reads sequential memory.
+   */
+  template <unsigned int S>
+  struct AplaMBRSoA {
+    std::array<double, S> min_a;
+    std::array<double, S> min_b;
+    std::array<double, S> max_a;
+    std::array<double, S> max_b;
+    std::array<unsigned int, S> min_i;
+    std::array<unsigned int, S> max_i;
+  };
+  /**
+   * @brief soa_region returns the ith region of a struct of arrays Partition Cover
+   */
+  template <unsigned int S>
+  inline Region soa_region(const AplaMBRSoA<S>& mbr, unsigned int i)
+  {
+    return { {mbr.min_a[i], mbr.min_b[i]}, mbr.min_i[i], {mbr.max_a[i], mbr.max_b[i]}, mbr.max_i[i] };
+  }
+  /**
+   * @brief soa_set_region overwrites the ith region of a struct of arrays Partition Cover
+   */
+  template <unsigned int S>
+  inline void soa_set_region(AplaMBRSoA<S>& mbr, unsigned int i, const Region& r)
+  {
+    mbr.min_a[i] = r.min_dp[0];
+    mbr.min_b[i] = r.min_dp[1];
+    mbr.max_a[i] = r.max_dp[0];
+    mbr.max_b[i] = r.max_dp[1];
+    mbr.min_i[i] = r.min_i;
+    mbr.max_i[i] = r.max_i;
+  }
+  /**
+   * @brief to_soa converts a Partition Cover to its struct of arrays layout
+   */
+  template <unsigned int S>
+  AplaMBRSoA<S> to_soa(const AplaMBR<S>& mbr)
+  {
+    AplaMBRSoA<S> ret;
+    for (int i=0; i<S; i++) soa_set_region(ret, i, mbr[i]);
+    return ret;
+  }
+  /**
+   * @brief soa_mbr_area is mbr_area for the struct of arrays layout
+   */
+  template <unsigned int S>
+  double soa_mbr_area(const AplaMBRSoA<S>& mbr)
+  {
+    double area = 0.0;
+    for (int i=0; i<S; i++) area += region_area( soa_region(mbr, i) );
+    return area;
+  }
+  /**
+   * @brief soa_mbr_merge is mbr_merge for the struct of arrays layout
+   */
+  template <unsigned int S>
+  AplaMBRSoA<S> soa_mbr_merge(const AplaMBRSoA<S>& mbr1, const AplaMBRSoA<S>& mbr2)
+  {
+    AplaMBRSoA<S> ret;
+    for (int i=0; i<S; i++) {
+      soa_set_region(ret, i, region_merge( soa_region(mbr1, i), soa_region(mbr2, i) ));
+    }
+    return ret;
+  }
+  /**
+   * @brief soa_mbr_centre is mbr_centre for the struct of arrays layout
+   */
+  template <unsigned int S>
+  std::vector<double> soa_mbr_centre(const AplaMBRSoA<S>& mbr)
+  {
+    std::vector<double> centre(S);
+    for (int i=0; i<S; i++) {
+      double half_width = (mbr.max_i[i] - mbr.min_i[i]) * 0.5;
+      centre[i] = 0.5 * (mbr.min_a[i] + mbr.min_b[i]*half_width + mbr.max_a[i] + mbr.max_b[i]*half_width);
+    }
+    return centre;
+  }
+  /**
+   * @brief soa_dist_to_mbr_sqr is dist_to_mbr_sqr for the struct of arrays layout, giving the same distance
+   * @param q is a time series (uncompressed)
+   * @param mbr is a constant reference to a Partition Cover
+   * @return non negative number representing distance to the mbr
+   */
+  template <unsigned int S>
+  double soa_dist_to_mbr_sqr( const Seqd& q, const AplaMBRSoA<S>& mbr ) {
     int active_start_i = 0;
     int active_end_i = 0;
-    while ( active_end_i < mbr.size() && mbr[active_end_i].min_i == 0 ){
+    while ( active_end_i < S && mbr.min_i[active_end_i] == 0 ){
       active_end_i++;
     }
     active_end_i--;
@@ -164,37 +398,239 @@ namespace apla_bounds {
     double dist = 0.0;
     for (int i=0; i<q.size(); i++) {
       // adjust window of regions
-      while ( active_start_i < mbr.size()-1 && mbr[active_start_i].max_i < i ) {
+      while ( active_start_i < S-1 && mbr.max_i[active_start_i] < i ) {
 	active_start_i++;
       }
-      while( active_end_i < mbr.size()-1 && mbr[active_end_i+1].min_i <= i ){
+      while( active_end_i < S-1 && mbr.min_i[active_end_i+1] <= i ){
 	active_end_i++;
       }
 
-      dist += dist_to_regions_sqr(q[i], &mbr[0] + active_start_i, &mbr[0] + active_end_i, i); 
-
+      double min_d = -1.0;
+      for (int r=active_start_i; r<=active_end_i; r++) {
+	double r_min_est = mbr.min_b[r] * (i - (int) mbr.min_i[r]) + mbr.min_a[r];
+	double r_max_est = mbr.max_b[r] * (i - (int) mbr.min_i[r]) + mbr.max_a[r];
+	double rd = 0.0;
+	if (q[i] < r_min_est) rd = (q[i]-r_min_est)*(q[i]-r_min_est);
+	else if (q[i] > r_max_est) rd = (q[i]-r_max_est)*(q[i]-r_max_est);
+	if (min_d < 0 || rd < min_d) min_d = rd;
+      }
+      dist += min_d;
     }
 
     return dist;
   }
-  
+
+
+  /**
+   * @brief AplaTraits bundles the functions on Partition Covers as static members, to be given to the r tree as its traits
+   * Being known at compile time, the calls inline into the tree's traversal loops.
+   */
+  template <unsigned int S>
+  struct AplaTraits {
+    static inline double area(const AplaMBR<S>& mbr) { return mbr_area<S>(mbr); }
+    static inline AplaMBR<S> merge(const AplaMBR<S>& mbr1, const AplaMBR<S>& mbr2) { return mbr_merge<S>(mbr1, mbr2); }
+    static inline double dist_sqr(const Seqd& q, const AplaMBR<S>& mbr) { return dist_to_mbr_sqr<S>(q, mbr); }
+    // queries prepared once per search, see RTree::knn_search
+    using PreparedQuery = apla_bounds::PreparedQuery;
+    static inline double dist_sqr(const PreparedQuery& pq, const AplaMBR<S>& mbr, double threshold) { return dist_to_mbr_sqr<S>(pq, mbr, threshold); }
+    static inline std::vector<double> centre(const AplaMBR<S>& mbr) { return mbr_centre<S>(mbr); }
+    static constexpr bool has_centre() { return true; }
+  };
+  /**
+   * @brief AplaSoATraits is AplaTraits for the struct of arrays layout of Partition Covers
+   */
+  template <unsigned int S>
+  struct AplaSoATraits {
+    static inline double area(const AplaMBRSoA<S>& mbr) { return soa_mbr_area<S>(mbr); }
+    static inline AplaMBRSoA<S> merge(const AplaMBRSoA<S>& mbr1, const AplaMBRSoA<S>& mbr2) { return soa_mbr_merge<S>(mbr1, mbr2); }
+    static inline double dist_sqr(const Seqd& q, const AplaMBRSoA<S>& mbr) { return soa_dist_to_mbr_sqr<S>(q, mbr); }
+    static inline std::vector<double> centre(const AplaMBRSoA<S>& mbr) { return soa_mbr_centre<S>(mbr); }
+    static constexpr bool has_centre() { return true; }
+  };
+
+
+  /**
+   * @brief CompactRegion is a Region stored in half the space, its lines as floats and its indices as 16 bit offsets in the subsequence
+   * A Partition Cover of S regions takes 20*S bytes rather than 48*S (Region being padded), for subsequences of at most 65536 points.
+   * Indices above COMPACT_MAX_INDEX cannot be stored, so covers of longer subsequences have no compact form (see compact_fits,
+   * to_compact_mbrs rejects them).
+   * Lines are rounded outward on conversion (the lower line down and the upper line up at both ends of the region), so a
+   * compact region contains the region it was made from at every index: the distance from a series to it is at most the
+   * distance to the original, and remains a lower bound of the distance to every subsequence the original covered.
+   */
+  struct CompactRegion {
+    std::array<float, 2> min_dp;
+    std::array<float, 2> max_dp;
+    uint16_t min_i;
+    uint16_t max_i;
+  };
+  template <unsigned int S>
+  using AplaCompactMBR = std::array<CompactRegion, S>;
+  const unsigned int COMPACT_MAX_INDEX = std::numeric_limits<uint16_t>::max();
+
+  /**
+   * @brief round_line_outward rounds the line a + b*x to floats staying on one side of it for x in [0, width]
+   * @param dp is the line (intercept, gradient)
+   * @param width is the length of the region the line bounds
+   * @param down chooses to stay below the line (for a lower bound), otherwise above it
+   * @return the rounded line
+   */
+  inline std::array<float, 2> round_line_outward(const DoublePair& dp, unsigned int width, bool down)
+  {
+    const float toward = down ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+    float b = (float) dp[1];
+    auto outside = [&](float a, double x) {
+      double rounded = (double) a + (double) b * x;
+      double exact = dp[0] + dp[1] * x;
+      return down ? rounded <= exact : rounded >= exact;
+    };
+    // the rounded gradient drifts from the line by at most |b_f - b| * width over the region, and rounding the shifted
+    // intercept to a float moves it by under a float ulp of the line's magnitude, which the margin of a few ulps covers
+    const double magnitude = std::max( std::abs(dp[0]), std::abs(dp[0] + dp[1] * width) );
+    const double shift = std::abs( (double) b - dp[1] ) * width + 4 * std::numeric_limits<float>::epsilon() * magnitude;
+    float a = (float) (down ? dp[0] - shift : dp[0] + shift);
+    // the difference between the lines is linear in x, so checking both ends covers the whole region. A shifted intercept
+    // rounding to 0 or a denormal may need a step or two more
+    for (int steps=0; steps<4 && ( !outside(a, 0.0) || !outside(a, width) ); steps++) {
+      a = std::nextafter(a, toward);
+    }
+    return {a, b};
+  }
+  /**
+   * @brief compact_fits returns true if the indices of the region fit a CompactRegion
+   */
+  inline bool compact_fits(const Region& r) { return r.min_i <= COMPACT_MAX_INDEX && r.max_i <= COMPACT_MAX_INDEX; }
+  /**
+   * @brief compact_fits returns true if every region of the Partition Cover fits a CompactRegion
+   */
+  template <unsigned int S>
+  bool compact_fits(const AplaMBR<S>& mbr)
+  {
+    return std::all_of(mbr.begin(), mbr.end(), [](const Region& r){ return compact_fits(r); });
+  }
+  /**
+   * @brief to_compact_region converts a region to its compact form, containing it
+   * @param r is the region, it must fit (see compact_fits)
+   */
+  inline CompactRegion to_compact_region(const Region& r)
+  {
+    assert( compact_fits(r) );
+    const unsigned int width = r.max_i - r.min_i;
+    return { round_line_outward(r.min_dp, width, true)
+	   , round_line_outward(r.max_dp, width, false)
+	   , (uint16_t) r.min_i
+	   , (uint16_t) r.max_i };
+  }
+  /**
+   * @brief from_compact_region converts a compact region back to a region, exactly
+   */
+  inline Region from_compact_region(const CompactRegion& r)
+  {
+    return { {r.min_dp[0], r.min_dp[1]}, r.min_i, {r.max_dp[0], r.max_dp[1]}, r.max_i };
+  }
+  /**
+   * @brief to_compact converts a Partition Cover to its compact form, containing it
+   * @param mbr is the Partition Cover, it must fit (see compact_fits)
+   */
+  template <unsigned int S>
+  AplaCompactMBR<S> to_compact(const AplaMBR<S>& mbr)
+  {
+    AplaCompactMBR<S> ret;
+    for (unsigned int i=0; i<S; i++) ret[i] = to_compact_region(mbr[i]);
+    return ret;
+  }
+  /**
+   * @brief to_compact_mbrs converts an array of Partition Covers to their compact forms
+   * @return the compact covers, or an empty array if any of the covers does not fit (see compact_fits)
+   */
+  template <unsigned int S>
+  std::vector<AplaCompactMBR<S>> to_compact_mbrs(const std::vector<AplaMBR<S>>& mbrs)
+  {
+    if (!std::all_of(mbrs.begin(), mbrs.end(), [](const AplaMBR<S>& mbr){ return compact_fits<S>(mbr); })) return {};
+    std::vector<AplaCompactMBR<S>> ret;
+    ret.reserve(mbrs.size());
+    for (const AplaMBR<S>& mbr : mbrs) ret.push_back( to_compact<S>(mbr) );
+    return ret;
+  }
+  /**
+   * @brief compact_mbr_area is mbr_area for compact Partition Covers
+   */
+  template <unsigned int S>
+  double compact_mbr_area(const AplaCompactMBR<S>& mbr)
+  {
+    double area = 0.0;
+    for (unsigned int i=0; i<S; i++) area += region_area( from_compact_region(mbr[i]) );
+    return area;
+  }
+  /**
+   * @brief compact_mbr_merge is mbr_merge for compact Partition Covers, the merged regions again rounded outward
+   */
+  template <unsigned int S>
+  AplaCompactMBR<S> compact_mbr_merge(const AplaCompactMBR<S>& mbr1, const AplaCompactMBR<S>& mbr2)
+  {
+    AplaCompactMBR<S> ret;
+    for (unsigned int i=0; i<S; i++) {
+      ret[i] = to_compact_region( region_merge( from_compact_region(mbr1[i]), from_compact_region(mbr2[i]) ) );
+    }
+    return ret;
+  }
+  /**
+   * @brief compact_mbr_centre is mbr_centre for compact Partition Covers
+   */
+  template <unsigned int S>
+  std::vector<double> compact_mbr_centre(const AplaCompactMBR<S>& mbr)
+  {
+    std::vector<double> centre(S);
+    for (unsigned int i=0; i<S; i++) {
+      const CompactRegion& r = mbr[i];
+      double half_width = (r.max_i - r.min_i) * 0.5;
+      centre[i] = 0.5 * (r.min_dp[0] + r.min_dp[1]*half_width + r.max_dp[0] + r.max_dp[1]*half_width);
+    }
+    return centre;
+  }
+  /**
+   * @brief compact_dist_to_mbr_sqr is dist_to_mbr_sqr for compact Partition Covers
+   * @param q is a time series (uncompressed)
+   * @param mbr is a constant reference to a compact Partition Cover
+   * @return non negative number, at most the distance from q to the Partition Cover the compact one was made from
+   * The regions are expanded back to regions and evaluated as in dist_to_mbr_sqr
+   */
+  template <unsigned int S>
+  double compact_dist_to_mbr_sqr( const Seqd& q, const AplaCompactMBR<S>& mbr ) {
+    // expanding the regions costs a step per region, against the step per point of the walk over them
+    Region regions[S];
+    for (unsigned int i=0; i<S; i++) regions[i] = from_compact_region(mbr[i]);
+    return regions_dist_sqr(q.data(), q.size(), regions, S);
+  }
+  /**
+   * @brief AplaCompactTraits is AplaTraits for compact Partition Covers
+   */
+  template <unsigned int S>
+  struct AplaCompactTraits {
+    static inline double area(const AplaCompactMBR<S>& mbr) { return compact_mbr_area<S>(mbr); }
+    static inline AplaCompactMBR<S> merge(const AplaCompactMBR<S>& mbr1, const AplaCompactMBR<S>& mbr2) { return compact_mbr_merge<S>(mbr1, mbr2); }
+    static inline double dist_sqr(const Seqd& q, const AplaCompactMBR<S>& mbr) { return compact_dist_to_mbr_sqr<S>(q, mbr); }
+    static inline std::vector<double> centre(const AplaCompactMBR<S>& mbr) { return compact_mbr_centre<S>(mbr); }
+    static constexpr bool has_centre() { return true; }
+  };  
   /**
    * @brief ptrs_to_region converts an array of doubles into a region that bounds them
    * @param start points to the array beginning
    * @param end points to the arrays end (final element)
    * @param g_start_i is the starting index of this in the larger time series being approximated
+   * @param dp is the line of best fit of the points, which the region lies along
    * @return region that bounds the contiguous array of points
    */
-  inline Region ptrs_to_region(const double* const start, const double* const end, unsigned int g_start_i)
+  inline Region ptrs_to_region(const double* const start, const double* const end, unsigned int g_start_i, const DoublePair& dp)
   {
     if (start == end) return { {start[0], 0}, g_start_i, {start[0], 0}, g_start_i };
-    DoublePair dp = pla::regression(start, end);
     if (start+1 == end) return { {dp[0], dp[1]}, g_start_i, {dp[0], dp[1]}, g_start_i+1 };
     //std::cout << " dp " << dp[0] << " : " << dp[1] << " width : " << end - start <<  std::endl;
     int max_i = 0,  min_i = 0;
     double max_v = -1, min_v = -1;
     for (int i=0; i<=end-start; i++) {
-      double dist_to_line_sqr = (dp[1]*i - start[i] +dp[0])*(dp[1]*i - start[i] +dp[0]) / std::abs( dp[1]*dp[1] + 1 ) ;
+      // the distance to the line is this over dp[1]^2+1, which is the same for every point so is left out of the comparisons
+      double dist_to_line_sqr = (dp[1]*i - start[i] +dp[0])*(dp[1]*i - start[i] +dp[0]);
       //std::cout << "		index : " << g_start_i + i <<" val " << start[i] << " dist to line " << dist_to_line_sqr << std::endl;	
       if (dist_to_line_sqr > max_v && start[i] >= dp[0]+dp[1]*i) {
 	max_i = i;
@@ -216,6 +652,14 @@ namespace apla_bounds {
     }
     return ret;
   }
+  /**
+   * @brief ptrs_to_region as above, finding the line of best fit of the points
+   */
+  inline Region ptrs_to_region(const double* const start, const double* const end, unsigned int g_start_i)
+  {
+    if (start == end) return { {start[0], 0}, g_start_i, {start[0], 0}, g_start_i };
+    return ptrs_to_region(start, end, g_start_i, pla::regression(start, end));
+  }
   /**
    * @brief vec_to_mbr takes a series q and a Adaptive PLA algorithm and returns a Partition Cover that covers q using the algorithm
    * @param q is the uncompressed time series to cover
@@ -236,23 +680,203 @@ namespace apla_bounds {
     }
     return mbr;
   }
+  /**
+   * @brief SubseqCoverStream builds the Partition Covers of the subsequences of a stream of points, sliding a point at a time
+   * The latest points are kept in a buffer twice the subsequence size, so the window handed to the DRT is a view into it
+   * rather than a copy, and the buffer is only shifted back once every subseq_size points. The regressions of the segments
+   * of a window follow from prefix sums over the buffer, kept as the points arrive, rather than from passes over each segment.
+   */
+  template <unsigned int S>
+  class SubseqCoverStream {
+  private:
+    unsigned int subseq_size;
+    pla::APLA_DRT_PTR f;
+    std::vector<double> points; // the latest points, the window is the last subseq_size of them
+    std::vector<double> sums; // sums[i] is the sum of the first i points of the buffer
+    std::vector<double> index_sums; // index_sums[i] is the sum of the first i points of the buffer each times its position
+    std::vector<std::tuple<DoublePair, unsigned int>> apla; // the segments of the window found by the DRT
+    unsigned long num_points = 0;
+
+    // the line of best fit of the points a..b of the buffer, from their sums
+    DoublePair regression(unsigned int a, unsigned int b) const
+    {
+      const double n = b - a + 1;
+      const double sum = sums[b+1] - sums[a];
+      if (a == b) return { sum, 0.0 };
+      const double h = (n-1) / 2;
+      const double centred = (index_sums[b+1] - index_sums[a]) - (a + h) * sum;
+      const double gradient = centred * 12 / (n * (n*n - 1));
+      return { sum / n - gradient * h, gradient };
+    }
+    inline unsigned int window_start() const { return points.size() - subseq_size; }
+
+  public:
+    /**
+     * @brief constructor for the stream
+     * @param subseq_size is the size of the subsequences to cover
+     * @param f is the DRT function from a view of a subsequence to an approximation
+     */
+    SubseqCoverStream(unsigned int subseq_size, pla::APLA_DRT_PTR f) : subseq_size(subseq_size), f(f)
+    {
+      points.reserve(2 * subseq_size);
+      sums.reserve(2 * subseq_size + 1);
+      index_sums.reserve(2 * subseq_size + 1);
+      sums.push_back(0.0);
+      index_sums.push_back(0.0);
+    }
+
+    /**
+     * @brief push appends the next point of the stream, approximating the latest subsequence once there is one
+     * @param v is the point
+     */
+    void push(double v)
+    {
+      if (points.size() == 2 * subseq_size) { // shift the last subseq_size-1 points to the front of the buffer
+	points.erase(points.begin(), points.end() - (subseq_size-1));
+	sums.resize(1);
+	index_sums.resize(1);
+	for (unsigned int i=0; i<points.size(); i++) {
+	  sums.push_back(sums.back() + points[i]);
+	  index_sums.push_back(index_sums.back() + i * points[i]);
+	}
+      }
+      index_sums.push_back(index_sums.back() + points.size() * v);
+      sums.push_back(sums.back() + v);
+      points.push_back(v);
+      num_points++;
+      if (full()) apla = f(points.data() + window_start(), subseq_size, 3*S);
+    }
+    /**
+     * @brief full returns true once subseq_size points have been pushed, so there is a subsequence to cover
+     */
+    inline bool full() const { return points.size() >= subseq_size && subseq_size != 0; }
+    /**
+     * @brief start returns the position in the stream of the first point of the latest subsequence
+     */
+    inline unsigned long start() const { return num_points - subseq_size; }
+
+    /**
+     * @brief cover returns the Partition Cover of the latest subsequence, the stream must be full
+     */
+    AplaMBR<S> cover() const
+    {
+      AplaMBR<S> mbr;
+      const unsigned int w = window_start();
+      unsigned int start_i = 0;
+      for ( unsigned int apla_i = 0; apla_i < S; apla_i++ ) {
+	unsigned int end_i = std::get<1>(apla[apla_i]);
+	mbr[apla_i] = ptrs_to_region(points.data()+w+start_i, points.data()+w+end_i, start_i, regression(w+start_i, w+end_i));
+	start_i = end_i+1;
+      }
+      return mbr;
+    }
+    /**
+     * @brief leaf returns the leaf index holding the APLA of the latest subsequence (see AplaLeaf), the stream must be full
+     */
+    AplaLeaf<S> leaf() const
+    {
+      AplaLeaf<S> ret = { (unsigned int) start(), {} };
+      const unsigned int w = window_start();
+      unsigned int start_i = 0;
+      for ( unsigned int apla_i = 0; apla_i < S; apla_i++ ) {
+	unsigned int end_i = std::get<1>(apla[apla_i]);
+	ret.apla[apla_i] = { regression(w+start_i, w+end_i), end_i };
+	start_i = end_i+1;
+      }
+      return ret;
+    }
+  };
+
   /**
    * @brief vec_to_subseq_mbrs takes a series q and a Adaptive PLA algorithm, returning an array of PC that cover the subsequences of q
    * @param q is the uncompressed time series to cover
    * @param subseq_size is the desired size of the subsequence
-   * @param f is the DRT function to q to an approximation
+   * @param f is the DRT function from a view of a subsequence to an approximation
    * @return array of partition covers, the ith PC covers the ith subsequence
    */
   template <unsigned int S>
-  std::vector<AplaMBR<S>> vec_to_subseq_mbrs( const std::vector<double>& q, unsigned int subseq_size, pla::APLA_DRT f)
+  std::vector<AplaMBR<S>> vec_to_subseq_mbrs( const std::vector<double>& q, unsigned int subseq_size, pla::APLA_DRT_PTR f)
   {
     std::vector<AplaMBR<S>> subseqs_compr;
-    for (int i=0; i<q.size() - subseq_size; i++) {
-      std::vector<double> q_i( q.cbegin()+i, q.cbegin()+i+subseq_size); 
-      subseqs_compr.push_back( vec_to_mbr<S>(q_i, f) );
+    if (q.size() <= subseq_size) return subseqs_compr;
+    subseqs_compr.reserve(q.size() - subseq_size);
+    SubseqCoverStream<S> stream(subseq_size, f);
+    for (unsigned int i=0; i+1<q.size(); i++) {
+      stream.push(q[i]);
+      if (stream.full()) subseqs_compr.push_back( stream.cover() );
     }
     return subseqs_compr;
   }
+  /**
+   * @brief vec_to_subseq_mbrs as above for a DRT taking a series, which is handed a copy of each subsequence (see pla::drt_on_ptrs)
+   */
+  template <unsigned int S>
+  std::vector<AplaMBR<S>> vec_to_subseq_mbrs( const std::vector<double>& q, unsigned int subseq_size, pla::APLA_DRT f)
+  {
+    return vec_to_subseq_mbrs<S>(q, subseq_size, pla::drt_on_ptrs(f));
+  }
+  /**
+   * @brief vec_to_subseq_mbrs_parallel is vec_to_subseq_mbrs spread across threads, for DRTs too slow to cover every subsequence on one core
+   * @param q is the uncompressed time series to cover
+   * @param subseq_size is the desired size of the subsequence
+   * @param f is the DRT function from a view of a subsequence to an approximation
+   * @param num_threads is the number of threads to use, 0 uses one per hardware core
+   * @return array of partition covers, the ith PC covers the ith subsequence
+   * The subsequences are split into contiguous blocks claimed by the threads in turn. Each block slides its own stream, with its
+   * own copy of f, over its subsequences and writes their covers into place in the array, so f must not share mutable state
+   * between copies (eg. by capturing by reference). The covers equal those of vec_to_subseq_mbrs up to the rounding of the regressions.
+   */
+  template <unsigned int S>
+  std::vector<AplaMBR<S>> vec_to_subseq_mbrs_parallel( const std::vector<double>& q, unsigned int subseq_size, pla::APLA_DRT_PTR f, unsigned int num_threads=0)
+  {
+    if (q.size() <= subseq_size) return {};
+    const unsigned int num_subseqs = q.size() - subseq_size;
+    std::vector<AplaMBR<S>> subseqs_compr(num_subseqs);
+    // a few blocks per thread balance uneven DRTs, while each block only rescans its first subsequence from scratch
+    const unsigned int num_blocks = std::min( num_subseqs, 8 * parallel::num_threads_or_default(num_threads) );
+    parallel::parallel_for(num_blocks, num_threads, [&](unsigned int block, unsigned int) {
+      unsigned long start = (unsigned long) num_subseqs * block / num_blocks;
+      unsigned long end = (unsigned long) num_subseqs * (block+1) / num_blocks;
+      SubseqCoverStream<S> stream(subseq_size, f);
+      for (unsigned long i=start; i+1<end+subseq_size; i++) {
+	stream.push(q[i]);
+	if (stream.full()) subseqs_compr[i+1-subseq_size] = stream.cover();
+      }
+    });
+    return subseqs_compr;
+  }
+  /**
+   * @brief vec_to_subseq_mbrs_parallel as above for a DRT taking a series, each block handing it copies of its subsequences
+   */
+  template <unsigned int S>
+  std::vector<AplaMBR<S>> vec_to_subseq_mbrs_parallel( const std::vector<double>& q, unsigned int subseq_size, pla::APLA_DRT f, unsigned int num_threads=0)
+  {
+    return vec_to_subseq_mbrs_parallel<S>(q, subseq_size, pla::drt_on_ptrs(f), num_threads);
+  }
+  /**
+   * @brief vec_to_subseq_leaves is vec_to_subseq_mbrs also returning the leaf indexes holding the APLA of each subsequence
+   * @param q is the uncompressed time series to cover
+   * @param subseq_size is the desired size of the subsequence
+   * @param f is the DRT function to q to an approximation
+   * @param mbrs is set to the array of partition covers, the ith PC covers the ith subsequence
+   * @return array of leaf indexes, the ith holds the position and APLA of the ith subsequence
+   * The segments are those of the DRT and the lines the regressions of the segments, which the leaf bound needs.
+   */
+  template <unsigned int S>
+  std::vector<AplaLeaf<S>> vec_to_subseq_leaves( const std::vector<double>& q, unsigned int subseq_size, pla::APLA_DRT f, std::vector<AplaMBR<S>>& mbrs)
+  {
+    std::vector<AplaLeaf<S>> leaves;
+    mbrs.clear();
+    if (q.size() <= subseq_size) return leaves;
+    SubseqCoverStream<S> stream(subseq_size, pla::drt_on_ptrs(f));
+    for (unsigned int i=0; i+1<q.size(); i++) {
+      stream.push(q[i]);
+      if (!stream.full()) continue;
+      mbrs.push_back( stream.cover() );
+      leaves.push_back( stream.leaf() );
+    }
+    return leaves;
+  }
 };
 
 #endif
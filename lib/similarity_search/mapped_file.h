@@ -0,0 +1,80 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @file mapped_file.h
+ * @brief mapped_file.h holds a small owner of a memory mapped file
+ */
+
+/**
+ * @brief MappedFile maps a whole file into memory, unmapping it when destroyed or remapped
+ * The mapping is private, so pages may be written (copy on write) without changing the file,
+ * while pages never written stay shared through the page cache with every other process mapping the file.
+ */
+class MappedFile {
+private:
+  char* data;
+  unsigned long length;
+
+public:
+  MappedFile() : data(nullptr), length(0) {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& o) : data(o.data), length(o.length) { o.data = nullptr; o.length = 0; }
+  MappedFile& operator=(MappedFile&& o)
+  {
+    if (this != &o) {
+      unmap();
+      data = o.data;
+      length = o.length;
+      o.data = nullptr;
+      o.length = 0;
+    }
+    return *this;
+  }
+  ~MappedFile() { unmap(); }
+
+  /**
+   * @brief map maps the file at path, replacing any current mapping
+   * @param path is the path to the file
+   * @return true if the file was mapped
+   */
+  bool map(const std::string& path)
+  {
+    unmap();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    void* addr = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (addr == MAP_FAILED) return false;
+    data = (char*) addr;
+    length = st.st_size;
+    return true;
+  }
+  /**
+   * @brief unmap releases the current mapping, invalidating every pointer into it
+   */
+  void unmap()
+  {
+    if (data != nullptr) ::munmap(data, length);
+    data = nullptr;
+    length = 0;
+  }
+
+  inline char* get() const { return data; }
+  inline unsigned long size() const { return length; }
+};
+
+#endif
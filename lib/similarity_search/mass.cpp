@@ -0,0 +1,203 @@
+#include "mass.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <tuple>
+
+using std::vector;
+using cd = std::complex<double>;
+
+void mass::fft(vector<cd>& a, bool inverse)
+{
+  const unsigned int n = a.size();
+  // the inverse is the transform of the conjugate, conjugated and scaled
+  if (inverse) {
+    for (cd& x : a) x = std::conj(x);
+  }
+  // reorder by bit reversed index, so the butterflies can work in place
+  for (unsigned int i=1, j=0; i<n; i++) {
+    unsigned int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) std::swap(a[i], a[j]);
+  }
+  // the roots of unity of each length are laid out in turn, roots[len/2 + k] being the k-th of length len, so the
+  // butterflies read them contiguously. They are computed directly rather than by repeated multiplication, which drifts,
+  // and only when the size changes
+  static thread_local vector<cd> roots;
+  if (roots.size() != n) {
+    roots.assign(std::max(n, 2u), 1.0);
+    for (unsigned int len=2; len<=n; len<<=1) {
+      for (unsigned int k=0; k<len/2; k++) roots[len/2 + k] = std::polar(1.0, -2 * M_PI * k / len);
+    }
+  }
+  for (unsigned int len=2; len<=n; len<<=1) {
+    const cd* const w = roots.data() + len/2;
+    for (unsigned int i=0; i<n; i+=len) {
+      cd* const lo = a.data() + i;
+      cd* const hi = lo + len/2;
+      for (unsigned int k=0; k<len/2; k++) {
+	cd v = hi[k] * w[k];
+	hi[k] = lo[k] - v;
+	lo[k] += v;
+      }
+    }
+  }
+  if (inverse) {
+    for (cd& x : a) x = std::conj(x) / (double) n;
+  }
+}
+
+namespace {
+  /**
+   * @brief half_roots returns the roots of unity e^(-2 pi i k / n) for k < n/2, computed once per size
+   */
+  const vector<cd>& half_roots(unsigned int n)
+  {
+    static thread_local vector<cd> roots;
+    if (roots.size() != n/2) {
+      roots.resize(n/2);
+      for (unsigned int k=0; k<n/2; k++) roots[k] = std::polar(1.0, -2 * M_PI * k / n);
+    }
+    return roots;
+  }
+
+  /**
+   * @brief rfft returns the first n/2+1 terms of the fft of the real x of size n, a power of 2 of at least 2, the rest
+   * following by symmetry. The even and odd points are packed into one complex sequence of half the size.
+   */
+  vector<cd> rfft(const vector<double>& x)
+  {
+    const unsigned int h = x.size() / 2;
+    vector<cd> z(h);
+    for (unsigned int k=0; k<h; k++) z[k] = cd(x[2*k], x[2*k+1]);
+    mass::fft(z);
+    const vector<cd>& w = half_roots(x.size());
+    vector<cd> spectrum(h+1);
+    for (unsigned int k=0; k<=h; k++) {
+      cd a = z[k % h], b = std::conj(z[(h-k) % h]);
+      cd even = (a + b) * 0.5, odd = (a - b) * cd(0, -0.5);
+      spectrum[k] = k < h ? even + w[k] * odd : even - odd;
+    }
+    return spectrum;
+  }
+
+  /**
+   * @brief irfft returns the real sequence of size n whose fft begins with the n/2+1 terms of spectrum, as rfft returns
+   */
+  vector<double> irfft(const vector<cd>& spectrum)
+  {
+    const unsigned int h = spectrum.size() - 1;
+    const vector<cd>& w = half_roots(2*h);
+    vector<cd> z(h);
+    for (unsigned int k=0; k<h; k++) {
+      cd a = spectrum[k], b = std::conj(spectrum[h-k]);
+      cd even = (a + b) * 0.5, odd = (a - b) * 0.5 * std::conj(w[k]);
+      z[k] = even + cd(0, 1) * odd;
+    }
+    mass::fft(z, true);
+    vector<double> x(2*h);
+    for (unsigned int k=0; k<h; k++) {
+      x[2*k] = z[k].real();
+      x[2*k+1] = z[k].imag();
+    }
+    return x;
+  }
+}
+
+mass::PreparedSeries mass::prepare(const vector<double>& series)
+{
+  PreparedSeries ps;
+  ps.series = series;
+  unsigned int size = 2;
+  while (size < series.size()) size <<= 1;
+  vector<double> padded(size, 0.0);
+  std::copy(series.begin(), series.end(), padded.begin());
+  ps.spectrum = rfft(padded);
+
+  ps.prefix_sum.assign(series.size()+1, 0.0);
+  ps.prefix_sqr_sum.assign(series.size()+1, 0.0);
+  for (unsigned int i=0; i<series.size(); i++) {
+    ps.prefix_sum[i+1] = ps.prefix_sum[i] + series[i];
+    ps.prefix_sqr_sum[i+1] = ps.prefix_sqr_sum[i] + series[i]*series[i];
+  }
+  return ps;
+}
+
+vector<double> mass::sliding_dot_products(const PreparedSeries& ps, const vector<double>& query)
+{
+  const unsigned int n = ps.series.size(), m = query.size();
+  if (m == 0 || m > n) return {};
+
+  // the circular convolution with the reversed query wraps only into the first m-1 results, which are not wanted,
+  // so padding the series to a power of 2 is enough and its spectrum does not depend on the query
+  vector<double> reversed(2 * (ps.spectrum.size()-1), 0.0);
+  for (unsigned int t=0; t<m; t++) reversed[t] = query[m-1-t];
+  vector<cd> product = rfft(reversed);
+  for (unsigned int k=0; k<product.size(); k++) product[k] *= ps.spectrum[k];
+  vector<double> convolution = irfft(product);
+
+  return vector<double>(convolution.begin()+m-1, convolution.begin()+n);
+}
+
+vector<double> mass::distance_profile_sqr(const PreparedSeries& ps, const vector<double>& query)
+{
+  const unsigned int m = query.size();
+  vector<double> profile = sliding_dot_products(ps, query);
+  double query_sqr_sum = 0;
+  for (double x : query) query_sqr_sum += x*x;
+  for (unsigned int i=0; i<profile.size(); i++) {
+    double window_sqr_sum = ps.prefix_sqr_sum[i+m] - ps.prefix_sqr_sum[i];
+    profile[i] = std::max( 0.0, query_sqr_sum + window_sqr_sum - 2*profile[i] );
+  }
+  return profile;
+}
+
+vector<double> mass::distance_profile_sqr(const vector<double>& series, const vector<double>& query)
+{
+  return distance_profile_sqr(prepare(series), query);
+}
+
+vector<double> mass::znorm_distance_profile_sqr(const PreparedSeries& ps, const vector<double>& query)
+{
+  const unsigned int m = query.size();
+  vector<double> profile = sliding_dot_products(ps, query);
+  if (profile.empty()) return profile;
+
+  auto mean_and_dev = [m](double sum, double sqr_sum) {
+    double mean = sum / m;
+    return std::make_tuple( mean, std::sqrt( std::max(0.0, sqr_sum / m - mean*mean) ) );
+  };
+  double query_sum = 0, query_sqr_sum = 0;
+  for (double x : query) {
+    query_sum += x;
+    query_sqr_sum += x*x;
+  }
+  auto [query_mean, query_dev] = mean_and_dev(query_sum, query_sqr_sum);
+  const double min_dev = 1e-8;
+  for (unsigned int i=0; i<profile.size(); i++) {
+    auto [mean, dev] = mean_and_dev(ps.prefix_sum[i+m] - ps.prefix_sum[i], ps.prefix_sqr_sum[i+m] - ps.prefix_sqr_sum[i]);
+    // a flat sequence normalises to all 0, whose distance to a normalised sequence is m, or 0 to another flat one
+    if (query_dev < min_dev || dev < min_dev) {
+      profile[i] = (query_dev < min_dev && dev < min_dev) ? 0.0 : m;
+      continue;
+    }
+    double correlation = (profile[i] - m * query_mean * mean) / (m * query_dev * dev);
+    profile[i] = std::clamp( 2.0 * m * (1.0 - correlation), 0.0, 4.0 * m );
+  }
+  return profile;
+}
+
+double mass::tolerance(const PreparedSeries& ps, const vector<double>& query)
+{
+  const double eps = std::numeric_limits<double>::epsilon();
+  const double series_sqr_sum = ps.prefix_sqr_sum.empty() ? 0.0 : ps.prefix_sqr_sum.back();
+  double query_sqr_sum = 0;
+  for (double x : query) query_sqr_sum += x*x;
+  const double size = 2 * (ps.spectrum.size()-1);
+  // the error of a FFT convolution grows with the log of its size and the norms of the sequences,
+  // that of the window sums with the number of terms summed in the prefix sums
+  return eps * ( 8 * (std::log2(size) + 1) * std::sqrt(size * series_sqr_sum * query_sqr_sum)
+		 + 2 * ps.series.size() * series_sqr_sum + query.size() * query_sqr_sum );
+}
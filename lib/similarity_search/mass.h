@@ -0,0 +1,76 @@
+#ifndef MASS_H
+#define MASS_H
+
+#include <vector>
+#include <complex>
+
+/**
+ * @file mass.h
+ * @brief Header file for distance profiles by FFT, in the manner of MASS (Mueen's Algorithm for Similarity Search)
+ */
+
+/**
+ * @brief mass is namespace for computing the distances of a query to every subsequence of a series at once
+ * The sliding dot products of the query with the series are a convolution, found by FFT in O(n log n) rather than the
+ * O(n*m) of computing each distance in turn. The distances then follow from the dot products and the sums of the windows.
+ * The distances carry the rounding error of the FFT, see tolerance(), so exact answers verify the candidates they find.
+ */
+namespace mass {
+
+  /**
+   * @brief fft transforms a in place, its size must be a power of 2
+   * @param a is the sequence to transform
+   * @param inverse whether to apply the inverse transform, scaled so fft(fft(a), true) is a
+   */
+  void fft(std::vector<std::complex<double>>& a, bool inverse=false);
+
+  /**
+   * @brief PreparedSeries is a series with its spectrum and window sums computed, so many queries can share them
+   */
+  struct PreparedSeries {
+    std::vector<double> series;
+    std::vector<std::complex<double>> spectrum; // first half of the fft of series padded to a power of 2, the rest follows by symmetry
+    std::vector<double> prefix_sum; // prefix_sum[i] is the sum of the first i points
+    std::vector<double> prefix_sqr_sum; // the same for the squares of the points
+  };
+  /**
+   * @brief prepare returns the series prepared for distance profiles
+   * @param series is the time series to compute the distance profiles of queries against
+   */
+  PreparedSeries prepare(const std::vector<double>& series);
+
+  /**
+   * @brief sliding_dot_products returns the dot product of query with each subsequence of the series of the same size
+   * @param ps is the prepared series
+   * @param query is the query, of at most the size of the series
+   * @return array whose i-th element is the dot product with the subsequence starting at i
+   */
+  std::vector<double> sliding_dot_products(const PreparedSeries& ps, const std::vector<double>& query);
+  /**
+   * @brief distance_profile_sqr returns the squared l2 distance of query to each subsequence of the series of the same size
+   * @param ps is the prepared series
+   * @param query is the query, of at most the size of the series
+   * @return array whose i-th element is the squared distance to the subsequence starting at i, to within tolerance(ps, query)
+   */
+  std::vector<double> distance_profile_sqr(const PreparedSeries& ps, const std::vector<double>& query);
+  /**
+   * @brief distance_profile_sqr is distance_profile_sqr preparing the series itself
+   */
+  std::vector<double> distance_profile_sqr(const std::vector<double>& series, const std::vector<double>& query);
+  /**
+   * @brief znorm_distance_profile_sqr returns the squared l2 distance of the z-normalised query to each z-normalised subsequence
+   * @param ps is the prepared series
+   * @param query is the query, of at most the size of the series
+   * @return array whose i-th element is the squared distance to the subsequence starting at i z-normalised,
+   * a subsequence (or query) of no deviation is taken as all 0 once normalised
+   */
+  std::vector<double> znorm_distance_profile_sqr(const PreparedSeries& ps, const std::vector<double>& query);
+  /**
+   * @brief tolerance returns a bound on the error of distance_profile_sqr against the distance computed directly
+   * @param ps is the prepared series
+   * @param query is the query
+   */
+  double tolerance(const PreparedSeries& ps, const std::vector<double>& query);
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <vector>
+#include <memory>
+
+/**
+ * @file node_pool.h
+ * @brief node_pool.h holds the definition of a slab allocator handing out nodes by index
+ */
+
+/**
+ * @brief NodeId is the index of a node inside a NodePool
+ */
+typedef unsigned int NodeId;
+/**
+ * @brief NO_NODE is the NodeId used to mark a missing node (eg. the parent of the root)
+ */
+const NodeId NO_NODE = (NodeId) -1;
+
+/**
+ * @brief NodePool allocates nodes in contiguous slabs, referring to them by index so links survive growth of the pool
+ * Slabs are never moved once allocated, so references to nodes stay valid until the node is released or the pool cleared.
+ * Clearing the pool frees each slab at once rather than each node.
+ * A pool can also view slabs held elsewhere (eg. a memory mapped file), growing with its own slabs from there.
+ */
+template <typename T>
+class NodePool {
+private:
+  unsigned int slab_bits;
+  NodeId slab_mask;
+  std::vector<T*> slabs;
+  std::vector<std::unique_ptr<T[]>> owned_slabs;
+  NodeId num_used;
+  std::vector<NodeId> free_ids;
+
+public:
+  /**
+   * @brief constructor for the node pool
+   * @param slab_bytes is the rough size in bytes of each slab, rounded to hold a power of two number of nodes
+   */
+  NodePool(unsigned int slab_bytes=1<<16) : slab_bits(0), num_used(0)
+  {
+    while ( (sizeof(T) << (slab_bits+1)) <= slab_bytes ) slab_bits++;
+    slab_mask = (1u << slab_bits) - 1;
+  }
+
+  /**
+   * @brief allocate hands out a default constructed node, reusing released nodes first
+   * @return the index of the node
+   */
+  NodeId allocate()
+  {
+    if (free_ids.size() != 0) {
+      NodeId id = free_ids.back();
+      free_ids.pop_back();
+      (*this)[id] = T();
+      return id;
+    }
+    if ( (num_used >> slab_bits) == slabs.size() ) {
+      owned_slabs.emplace_back( new T[1u << slab_bits]() );
+      slabs.push_back( owned_slabs.back().get() );
+    }
+    return num_used++;
+  }
+  /**
+   * @brief release returns a node to the pool to be handed out again
+   * @param id is the index of the node
+   */
+  void release(NodeId id) { free_ids.push_back(id); }
+  /**
+   * @brief clear releases every node, freeing the slabs
+   */
+  void clear()
+  {
+    slabs.clear();
+    owned_slabs.clear();
+    free_ids.clear();
+    num_used = 0;
+  }
+  /**
+   * @brief view replaces the contents of the pool with slabs held elsewhere, which must outlive the pool's use of them
+   * @param slab_ptrs points to each slab, laid out as the slabs of a pool of the same type and slab size
+   * @param num_allocated is the number of nodes handed out from the slabs
+   * @param released is the array of those nodes which have since been released
+   */
+  void view(const std::vector<T*>& slab_ptrs, NodeId num_allocated, const std::vector<NodeId>& released)
+  {
+    clear();
+    slabs = slab_ptrs;
+    num_used = num_allocated;
+    free_ids = released;
+  }
+
+  /**
+   * @brief size returns the number of nodes in use
+   */
+  inline NodeId size() const { return num_used - free_ids.size(); }
+  /**
+   * @brief num_allocated returns the number of nodes handed out, including those since released
+   */
+  inline NodeId num_allocated() const { return num_used; }
+  inline const std::vector<NodeId>& released() const { return free_ids; }
+  inline unsigned int num_slabs() const { return slabs.size(); }
+  inline unsigned long slab_size_bytes() const { return sizeof(T) << slab_bits; }
+  inline const T* slab(unsigned int i) const { return slabs[i]; }
+  inline T& operator[](NodeId id) { return slabs[id >> slab_bits][id & slab_mask]; }
+  inline const T& operator[](NodeId id) const { return slabs[id >> slab_bits][id & slab_mask]; }
+};
+
+/**
+ * @brief EntryPool gives nodes a contiguous array of a fixed number of entries each, allocated in slabs
+ * Entries of one node sit next to each other in memory so they can be scanned linearly without following pointers.
+ * An array is either reserved for every NodeId of a NodePool (reserve), or handed out by the pool itself to only the
+ * nodes needing one (allocate), the node keeping the index of its array.
+ */
+template <typename E>
+class EntryPool {
+private:
+  unsigned int stride;
+  unsigned int slab_bits;
+  NodeId slab_mask;
+  std::vector<E*> slabs;
+  std::vector<std::unique_ptr<E[]>> owned_slabs;
+  NodeId num_used;
+  std::vector<NodeId> free_ids;
+
+public:
+  /**
+   * @brief constructor for the entry pool
+   * @param entries_per_node is the number of entries each node has space for
+   * @param slab_bytes is the rough size in bytes of each slab, rounded to hold a power of two number of nodes
+   */
+  EntryPool(unsigned int entries_per_node, unsigned int slab_bytes=1<<16) : stride(entries_per_node), slab_bits(0), num_used(0)
+  {
+    while ( (sizeof(E) * stride << (slab_bits+1)) <= slab_bytes ) slab_bits++;
+    slab_mask = (1u << slab_bits) - 1;
+  }
+
+  /**
+   * @brief reserve ensures the node of index id has space for its entries
+   * @param id is the index of the node, given out by the matching NodePool
+   */
+  void reserve(NodeId id)
+  {
+    while ( (id >> slab_bits) >= slabs.size() ) {
+      owned_slabs.emplace_back( new E[stride << slab_bits]() );
+      slabs.push_back( owned_slabs.back().get() );
+    }
+  }
+  /**
+   * @brief allocate hands out the index of an unused array, reusing released arrays first
+   */
+  NodeId allocate()
+  {
+    if (free_ids.size() != 0) {
+      NodeId id = free_ids.back();
+      free_ids.pop_back();
+      return id;
+    }
+    reserve(num_used);
+    return num_used++;
+  }
+  /**
+   * @brief release returns an array given by allocate to the pool to be handed out again
+   * @param id is the index of the array
+   */
+  void release(NodeId id) { free_ids.push_back(id); }
+  /**
+   * @brief clear frees every slab
+   */
+  void clear()
+  {
+    slabs.clear();
+    owned_slabs.clear();
+    free_ids.clear();
+    num_used = 0;
+  }
+  /**
+   * @brief view replaces the contents of the pool with slabs held elsewhere, which must outlive the pool's use of them
+   * @param slab_ptrs points to each slab, laid out as the slabs of a pool of the same type, stride and slab size
+   * @param num_allocated is the number of arrays handed out by allocate from the slabs
+   * @param released is the array of those arrays which have since been released
+   */
+  void view(const std::vector<E*>& slab_ptrs, NodeId num_allocated=0, const std::vector<NodeId>& released={})
+  {
+    clear();
+    slabs = slab_ptrs;
+    num_used = num_allocated;
+    free_ids = released;
+  }
+
+  /**
+   * @brief capacity returns the number of entries each node has space for
+   */
+  inline unsigned int capacity() const { return stride; }
+  /**
+   * @brief num_allocated returns the number of arrays handed out by allocate, including those since released
+   */
+  inline NodeId num_allocated() const { return num_used; }
+  inline const std::vector<NodeId>& released() const { return free_ids; }
+  inline unsigned int num_slabs() const { return slabs.size(); }
+  inline unsigned long slab_size_bytes() const { return (sizeof(E) * stride) << slab_bits; }
+  inline const E* slab(unsigned int i) const { return slabs[i]; }
+  inline E* operator[](NodeId id) { return slabs[id >> slab_bits] + (id & slab_mask) * stride; }
+  inline const E* operator[](NodeId id) const { return slabs[id >> slab_bits] + (id & slab_mask) * stride; }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+/**
+ * @file parallel_for.h
+ * @brief parallel_for.h holds a small helper to spread independent tasks across threads
+ */
+
+/**
+ * @brief parallel is a namespace holding helpers to run independent tasks concurrently
+ */
+namespace parallel {
+  /**
+   * @brief num_threads_or_default resolves a requested thread count, 0 meaning one thread per hardware core
+   * @param num_threads is the requested number of threads
+   * @return the number of threads to use, at least 1
+   */
+  inline unsigned int num_threads_or_default(unsigned int num_threads)
+  {
+    if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+    return std::max(num_threads, 1u);
+  }
+
+  /**
+   * @brief parallel_for calls f(task, thread) for every task in [0, num_tasks) across num_threads threads
+   * @param num_tasks is the number of tasks to run
+   * @param num_threads is the number of threads to use, 0 uses one per hardware core
+   * @param f is called with the index of the task and the index of the thread running it (in [0, num_threads))
+   * Threads claim the next unstarted task from a shared counter whenever they finish one, so idle threads
+   * pick up the remaining work and uneven tasks (eg. queries pruning differently) balance out.
+   * The calling thread takes part as thread 0, and tasks of one thread may share scratch space indexed by the thread.
+   */
+  template <typename F>
+  void parallel_for(unsigned int num_tasks, unsigned int num_threads, F f)
+  {
+    num_threads = std::min( num_threads_or_default(num_threads), std::max(num_tasks, 1u) );
+    if (num_threads == 1) {
+      for (unsigned int i=0; i<num_tasks; i++) f(i, 0u);
+      return;
+    }
+
+    std::atomic<unsigned int> next_task(0);
+    auto worker = [&next_task,num_tasks,&f](unsigned int thread_i) {
+      for (unsigned int i = next_task++; i < num_tasks; i = next_task++) {
+	f(i, thread_i);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int t=1; t<num_threads; t++) {
+      threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (std::thread& t : threads) t.join();
+  }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef QUERY_STATS_H
+#define QUERY_STATS_H
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+/**
+ * @file query_stats.h
+ * @brief query_stats.h holds the collectors a search can report the work done by a query to
+ */
+
+/**
+ * @brief QueryStats accumulates the work done by the queries of an index, one query or any number of them
+ * A search calls start_query and end_query around each query, and the remaining methods as it works.
+ * Collectors of different queries (eg. one per thread of a batch) can be combined with merge.
+ */
+struct QueryStats {
+  unsigned long num_queries = 0;
+  std::vector<unsigned long> nodes_visited; // indexed by the level of the node, 0 for leaves
+  unsigned long entries_checked = 0; // leaf entries whose mbr was bound checked against the query
+  unsigned long entries_retrieved = 0; // leaf entries whose subsequences were retrieved
+  unsigned long entries_skipped = 0; // leaf entries not retrieved as the bound of their index ruled them out (see RTreeLeafBound)
+  unsigned long candidates_refined = 0; // subsequences whose exact error to the query was computed
+  unsigned long dist_calls = 0; // lower bounds computed between the query and a mbr
+  unsigned long max_queue_size = 0; // the largest the queue of entries to visit grew
+  double wall_ms = 0.0;
+
+  std::chrono::steady_clock::time_point query_start;
+
+  inline void start_query()
+  {
+    num_queries++;
+    query_start = std::chrono::steady_clock::now();
+  }
+  inline void end_query()
+  {
+    auto end = std::chrono::steady_clock::now();
+    wall_ms += std::chrono::duration_cast<std::chrono::nanoseconds>(end - query_start).count() / 1'000'000.0;
+  }
+  inline void visit_node(unsigned int level)
+  {
+    if (level >= nodes_visited.size()) nodes_visited.resize(level+1, 0);
+    nodes_visited[level]++;
+  }
+  inline void check_entries(unsigned long n) { entries_checked += n; }
+  inline void retrieve_entry() { entries_retrieved++; }
+  inline void skip_entry() { entries_skipped++; }
+  inline void refine_candidate() { candidates_refined++; }
+  inline void call_dist(unsigned long n) { dist_calls += n; }
+  inline void queue_size(unsigned long n) { max_queue_size = std::max(max_queue_size, n); }
+
+  /**
+   * @brief merge adds the work recorded by other to this collector
+   * @param other is the collector to add, the largest queue of either is kept
+   */
+  void merge(const QueryStats& other)
+  {
+    num_queries += other.num_queries;
+    if (other.nodes_visited.size() > nodes_visited.size()) nodes_visited.resize(other.nodes_visited.size(), 0);
+    for (unsigned int i=0; i<other.nodes_visited.size(); i++) nodes_visited[i] += other.nodes_visited[i];
+    entries_checked += other.entries_checked;
+    entries_retrieved += other.entries_retrieved;
+    entries_skipped += other.entries_skipped;
+    candidates_refined += other.candidates_refined;
+    dist_calls += other.dist_calls;
+    max_queue_size = std::max(max_queue_size, other.max_queue_size);
+    wall_ms += other.wall_ms;
+  }
+};
+
+/**
+ * @brief NullQueryStats is the collector used when no stats are wanted, every method is empty so the calls compile away
+ */
+struct NullQueryStats {
+  inline void start_query() {}
+  inline void end_query() {}
+  inline void visit_node(unsigned int) {}
+  inline void check_entries(unsigned long) {}
+  inline void retrieve_entry() {}
+  inline void skip_entry() {}
+  inline void refine_candidate() {}
+  inline void call_dist(unsigned long) {}
+  inline void queue_size(unsigned long) {}
+};
+
+#endif
@@ -3,40 +3,146 @@
 
 #include <vector>
 #include <array>
-#include <set>
-#include <variant>
+#include <tuple>
+#include <limits>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
 
 #include <queue>
 using std::queue;
 
 #include "error_measures.h"
+#include "node_pool.h"
+#include "parallel_for.h"
+#include "mapped_file.h"
+#include "query_stats.h"
 
 /**
  * @file r_tree.h
  * @brief r_tree.h holds the definition and implementation of a r_tree suitable to use the new indexing scheme
  */
 
-template <typename R, typename I>
-struct RTreeNode;
-
 /**
- * @brief LeafEntry is a struct denoting a leaf in the tree meaning it holds indexes of the sequences the cover covers
+ * @brief RTreeNode is the header of a node, the mbr covers all of its entries
+ * Nodes live in the NodePool of their tree and refer to their parent by NodeId.
+ * The entries of a node are held by the tree in flat arrays: the mbrs of the entries lie contiguously at the NodeId,
+ * alongside the array at links of either the indexes of the sequences (leaf nodes, level 0) or the NodeIds of the children
+ * (non-leaf nodes). Leaves and non-leaves each take an array from their own pool, so no node holds space for both.
  */
-template <typename R, typename I>
-struct LeafEntry {
+template <typename R>
+struct RTreeNode {
   R mbr;
-  I st_index;
-  LeafEntry(R mbr, I st_index) : mbr(mbr), st_index(st_index) {}
+  NodeId parent = NO_NODE;
+  unsigned int num_entries = 0;
+  unsigned int level = 0;
+  NodeId links = NO_NODE;
 };
+
 /**
- * @brief RTreeNode is a non leaf node holding as children either other non-leaf nodes or leaves, the mbr covers all children
+ * @brief RTreeSharedBound is the kth least error found so far by knn searches for the same query in several trees
+ * (eg. the shards of a ShardedRTree), so that each search can prune by what the others have found.
+ * The bound is read without locking, and lowered under a lock as searches offer the errors they refine.
  */
-template <typename R, typename I>
-struct RTreeNode {
-  R mbr;
-  RTreeNode<R,I>* parent;
-  std::variant<std::vector<LeafEntry<R,I>>, std::vector<RTreeNode<R,I>*>> entries;
-  RTreeNode(R mbr, RTreeNode<R,I>* p, std::variant<std::vector<LeafEntry<R,I>>, std::vector<RTreeNode<R,I>*>> e) : mbr(mbr), parent(p), entries(e) {}
+class RTreeSharedBound {
+private:
+  std::mutex lock;
+  std::vector<double> kth_errors; // max heap of the k least errors offered
+  unsigned int k;
+  std::atomic<double> bound;
+
+public:
+  RTreeSharedBound(unsigned int k) : k(k), bound(std::numeric_limits<double>::infinity()) {}
+
+  /**
+   * @brief get returns the kth least error offered so far, infinity until k have been offered
+   */
+  inline double get() const { return bound.load(std::memory_order_relaxed); }
+  /**
+   * @brief offer adds the error of a refined candidate, lowering the bound if it is among the k least
+   */
+  void offer(double error)
+  {
+    if (error >= get()) return;
+    std::lock_guard<std::mutex> guard(lock);
+    kth_errors.push_back(error);
+    std::push_heap(kth_errors.begin(), kth_errors.end());
+    if (kth_errors.size() > k) {
+      std::pop_heap(kth_errors.begin(), kth_errors.end());
+      kth_errors.pop_back();
+    }
+    if (kth_errors.size() == k) bound.store(kth_errors.front(), std::memory_order_relaxed);
+  }
+};
+
+/**
+ * @brief RTreeSearchScratch holds the working arrays of a search so they can be reused between queries
+ * The priority queues of knn_search are kept as heaps inside these arrays, and the queue of nodes to visit
+ * of sim_search_exact as an array read from a moving front, so a query reusing a scratch allocates nothing once warmed up.
+ * A scratch must only be used by one search at a time.
+ * Searches refine candidates with an early abandoning error, points_refined and points_skipped count (over every search
+ * using the scratch) the points of candidates that were due to be compared to the query and those skipped by abandoning.
+ * A knn_search given a shared_bound prunes by it as well as by its own results, and offers it every error it refines.
+ */
+struct RTreeSearchScratch {
+  std::vector<std::tuple<NodeId, int, double, bool>> node_heap;
+  std::vector<std::tuple<std::array<const double*, 2>, double>> candidate_heap;
+  std::vector<NodeId> to_visit;
+  std::vector<double> kth_errors; // max heap of the k least errors refined by knn_search, bounding which candidates matter
+  unsigned int k = 0;
+  RTreeSharedBound* shared_bound = nullptr;
+
+  unsigned long points_refined = 0;
+  unsigned long points_skipped = 0;
+};
+
+/**
+ * @brief rtree_refine_error finds the error between a query and a retrieved candidate, abandoning once it exceeds threshold
+ * @return the squared error if at most threshold, otherwise a value above threshold
+ */
+inline double rtree_refine_error(const std::vector<double>& q, const std::array<const double*, 2>& candidate, double threshold, RTreeSearchScratch& scratch)
+{
+  scratch.points_refined += std::min( (long) q.size(), candidate[1] - candidate[0] + 1 );
+  return error_measures::se_between_ptrs_early_abandon(q.data(), q.data()+q.size()-1, candidate[0], candidate[1], threshold, &scratch.points_skipped);
+}
+
+/**
+ * @brief rtree_query_series returns the series of a query, which a prepared query (see RTree::knn_search) holds as its series member
+ */
+inline const std::vector<double>& rtree_query_series(const std::vector<double>& q) { return q; }
+template <typename Q>
+inline const std::vector<double>& rtree_query_series(const Q& pq) { return pq.series; }
+
+/**
+ * @brief RTreeLeafBound bounds the distance between a query and the sequences of a leaf entry from the index of the entry alone
+ * It is specialised for indexes holding an approximation of their sequences (eg. apla_bounds::AplaLeaf, see apla_r_tree.h),
+ * and searches skip retrieving the entries whose bound rules them out, as a second filter after the bound of the mbr.
+ * A specialisation sets enabled and gives dist_sqr for each kind of query, below the error of every sequence retrieved.
+ */
+template <typename I>
+struct RTreeLeafBound {
+  static constexpr bool enabled = false;
+  template <typename Q>
+  static inline double dist_sqr(const Q&, const I&) { return 0.0; }
+};
+
+/**
+ * @brief ApproxKnnLimits are the cut offs of an approximate knn search, a search stops at the first one reached
+ * A limit left at 0 is not applied, and with none applied the search is exact.
+ */
+struct ApproxKnnLimits {
+  unsigned int max_refinements = 0; // leaf entries whose subsequences are retrieved and refined
+  double epsilon = 0.0; // stop once the kth result is within (1+epsilon) times the distance of the true kth nearest
+  double time_budget_ms = 0.0;
+};
+/**
+ * @brief ApproxKnnResult holds the results of an approximate knn search alongside the guarantee it achieved
+ */
+struct ApproxKnnResult {
+  std::vector<std::array<const double*, 2>> results; // closest first
+  bool exact = true; // the results are the k nearest
+  bool exhausted = false; // every entry was refined, so fewer than k results means the series has no more subsequences
+  double distance_ratio = 1.0; // the distance of the kth result is at most this times that of the true kth nearest, infinity if unbounded
 };
 
 template <typename R>
@@ -45,25 +151,67 @@ template <typename R>
 using FPtrAreaMerge = R (*)(const R&, const R&);
 template <typename R>
 using FPtrMBRDistSqr = double (*)(const std::vector<double>& q, const R&);
+template <typename R>
+using FPtrMBRCentre = std::vector<double> (*)(const R&);
 template <typename I>
 using FPtrRetrievalMethod = std::vector<std::array<const double*, 2>> (*)(const I&, const std::vector<double>&);
 
+/**
+ * @brief FPtrTraits gives the tree the functions on its MBRs through function pointers chosen at run time
+ * Any type with the same members can be given to the tree instead. Stateless types with static members (eg. apla_bounds::AplaTraits)
+ * let the compiler inline the distance and area calls into the tree's loops, which it never can through a function pointer.
+ */
+template <typename R>
+struct FPtrTraits {
+  FPtrArea<R> area_f = nullptr;
+  FPtrAreaMerge<R> merge_f = nullptr;
+  FPtrMBRDistSqr<R> dist_sqr_f = nullptr;
+  FPtrMBRCentre<R> centre_f = nullptr;
+
+  FPtrTraits() {}
+  FPtrTraits(FPtrArea<R> area_f, FPtrAreaMerge<R> merge_f, FPtrMBRDistSqr<R> dist_sqr_f, FPtrMBRCentre<R> centre_f=nullptr)
+    : area_f(area_f), merge_f(merge_f), dist_sqr_f(dist_sqr_f), centre_f(centre_f) {}
+
+  inline double area(const R& r) const { return area_f(r); }
+  inline R merge(const R& a, const R& b) const { return merge_f(a, b); }
+  inline double dist_sqr(const std::vector<double>& q, const R& r) const { return dist_sqr_f(q, r); }
+  inline std::vector<double> centre(const R& r) const { return centre_f(r); }
+  inline bool has_centre() const { return centre_f != nullptr; }
+};
+
+
+/**
+ * @brief SplitPolicy chooses how an overflowing node of the r tree is split
+ * QUADRATIC and LINEAR are the quadratic and linear cost splits of R-TREES. A DYNAMIC INDEX STRUCTURE FOR SPATIAL SEARCHING.
+ * RSTAR follows The R*-tree: An Efficient and Robust Access Method for Points and Rectangles, splitting along the axis
+ * (dimension of the MBR centres) of least total area into the groups of least overlap, and forcing the reinsertion of the
+ * entries farthest from the centre of a node the first time a level overflows during an insert.
+ * As MBRs are only known through the area and merge functions, margin is replaced by area and the overlap of two groups
+ * by area(a) + area(b) - area(merge(a, b)) (which is the overlap for intervals, and negative as they move apart).
+ * LINEAR and RSTAR need the centre function of the tree, without one they fall back to QUADRATIC.
+ */
+enum class SplitPolicy { QUADRATIC, LINEAR, RSTAR };
 
 #include <iostream>
 /**
  * @brief RTree is the partial implementation of a r tree from R-TREES. A DYNAMIC INDEX STRUCTURE FOR SPATIAL SEARCHING
+ * The policy P chooses the algorithm used to split nodes on insert, and the traits T the functions on MBRs
+ * (area, merge, dist_sqr to a series, centre and has_centre, see FPtrTraits)
  */
-template <typename R, typename I>
+template <typename R, typename I, SplitPolicy P = SplitPolicy::QUADRATIC, typename T = FPtrTraits<R>>
 class RTree {
 private:
-  RTreeNode<R,I>* root;
-  FPtrArea<R> area_f;
-  FPtrAreaMerge<R> merge_f;
-  FPtrMBRDistSqr<R> uncompr_point_dist_sqr_f;
+  NodePool<RTreeNode<R>> nodes;
+  EntryPool<R> entry_mbrs;
+  EntryPool<I> entry_indexes;
+  EntryPool<NodeId> entry_children;
+  NodeId root;
+  T traits;
   unsigned int max_entries;
   unsigned int min_entries;
 
   unsigned int total_num_entries;
+  MappedFile mapped;
 
 public:
   /**
@@ -73,40 +221,41 @@ public:
    * @param area_f is a function to determine the area of a MBR
    * @param merge_f is a function to merge two MBR's
    * @param p_dist_f is a function to determine the distance from a series to a MBR (squared for comparison speed ups)
+   * @param centre_f is an optional function giving the centre of a MBR as coordinates, used to order MBRs when bulk loading and by the LINEAR and RSTAR split policies
    */
-  RTree(unsigned int max_entries, unsigned int min_entries, FPtrArea<R> area_f, FPtrAreaMerge<R> merge_f, FPtrMBRDistSqr<R> p_dist_f)
-    : max_entries(max_entries)
-      , min_entries(min_entries)
-      , area_f(area_f)
-      , merge_f(merge_f)
-      , uncompr_point_dist_sqr_f(p_dist_f)
-      , root(nullptr)
-      , total_num_entries(0) {}
+  RTree(unsigned int max_entries, unsigned int min_entries, FPtrArea<R> area_f, FPtrAreaMerge<R> merge_f, FPtrMBRDistSqr<R> p_dist_f, FPtrMBRCentre<R> centre_f=nullptr)
+    : RTree(max_entries, min_entries, T(area_f, merge_f, p_dist_f, centre_f)) {}
   /**
-   * @brief destructor for r tree
-   * Requires a recursive (implemented non recursive to not crash stack) deletion of information from tree
+   * @brief constructor for the r tree taking the functions on MBRs as traits
+   * @param max_entries is the desired maximum number of entries per node (recommended is 40)
+   * @param min_entries is the desired minimum number of entries per node (recommended is 10)
+   * @param traits holds the functions on MBRs, stateless traits need not be given
    */
-  ~RTree()
-  {
-    destroy_tree_from(root);
-    root = nullptr;
-  }
+  RTree(unsigned int max_entries, unsigned int min_entries, T traits = T())
+    : entry_mbrs(max_entries+1)
+      , entry_indexes(max_entries+1)
+      , entry_children(max_entries+1)
+      , root(NO_NODE)
+      , traits(traits)
+      , max_entries(max_entries)
+      , min_entries(min_entries)
+      , total_num_entries(0) {}
 
   /**
    * @brief get_size_tree calculates the total number of entries in the tree
    * @return integer of number of entries in tree
    */
-  unsigned int get_size_tree();
+  unsigned int get_size_tree() const;
   /**
    * @brief get_size_leaves calculates the total number of leaves in the tree
    * @return integer of number of leaves in tree
    */
-  unsigned int get_size_leaves();
+  unsigned int get_size_leaves() const;
   /**
    * @brief get_num_leaves yields the total number of leaves in the tree, counted as they are entered
    * @return integer of number of leaves in tree
    */
-  inline unsigned int get_num_leaves() { return total_num_entries; }
+  inline unsigned int get_num_leaves() const { return total_num_entries; }
 
   /**
    * @brief insert inserts a new sequence into the r tree
@@ -114,6 +263,48 @@ public:
    * @param st_index is the indexing methods to retrieve the original sequence
    */
   void insert(R mbr, I st_index);
+  /**
+   * @brief remove removes a sequence from the r tree
+   * @param mbr is the mbr the sequence was inserted with, guiding the search for it
+   * @param st_index is the indexing method the sequence was inserted with, identifying it
+   * @return true if the sequence was found and removed, false if it is not in the tree
+   * Nodes left with fewer than min entries are removed and their entries inserted again (CondenseTree of R-TREES),
+   * and released nodes are reused by later inserts, so a tree under a stream of inserts and removes stays bounded in size.
+   */
+  bool remove(const R& mbr, const I& st_index);
+  /**
+   * @brief update moves a sequence of the r tree to a new mbr
+   * @param old_mbr is the mbr the sequence was inserted with
+   * @param new_mbr is the new mbr of the sequence
+   * @param st_index is the indexing method of the sequence
+   * @return true if the sequence was found and moved, false if it is not in the tree
+   */
+  bool update(const R& old_mbr, const R& new_mbr, const I& st_index);
+  /**
+   * @brief bulk_load replaces the contents of the tree with a fully packed tree built bottom up by Sort-Tile-Recursive
+   * @param mbrs is the array of mbrs of the sequences
+   * @param st_indexes is the array of indexing methods, the ith retrieves the sequence covered by the ith mbr
+   * MBRs are ordered by the centre function given on construction, without one they are packed in the order given
+   * (which for subsequences of a series already groups those close in time)
+   */
+  void bulk_load(const std::vector<R>& mbrs, const std::vector<I>& st_indexes);
+
+  /**
+   * @brief save writes the tree to a binary file that open_mapped can map back without deserialising
+   * @param path is the path of the file to write
+   * @return true if the file was written
+   * Only trees of trivially copyable MBRs and indexes (eg. AplaMBR and unsigned int) can be saved.
+   * The functions of the tree are not saved, so the file must be opened by a tree constructed with the same ones.
+   */
+  bool save(const std::string& path) const;
+  /**
+   * @brief open_mapped replaces the contents of the tree with the tree saved at path, searching its nodes in place from the mapped file
+   * @param path is the path of a file written by save
+   * @return true if the file was mapped, false if it is missing or was saved by a tree of different types or entry limits
+   * The mapping is private: the tree may still be modified (copying the touched pages) and never changes the file,
+   * while untouched pages are shared through the page cache by every process opening the same file.
+   */
+  bool open_mapped(const std::string& path);
 
   /**
    * @brief sim_search finds all subsequences of series that are within epsilon of query
@@ -122,7 +313,7 @@ public:
    * @return array of indexing tools representing the retrieval indexes for the sequences
    * This function returns with false positives
    */
-  std::vector<I> sim_search(const std::vector<double>& q, double epsilon);
+  std::vector<I> sim_search(const std::vector<double>& q, double epsilon) const;
   /**
    * @brief knn_search finds k subsequences of series closest to q
    * @param query is the query sequence to search for similar sequences to
@@ -131,7 +322,59 @@ public:
    * @param s the larger sequence containing all additions to the r tree
    * @return array of pointers to the sequences in the larger sequence s
    */
-  std::vector<std::array<const double*, 2>> knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s);
+  std::vector<std::array<const double*, 2>> knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const;
+  /**
+   * @brief knn_search as above, reusing the working arrays in scratch instead of allocating new ones
+   * @param scratch is the working space of the search, owned by the caller
+   */
+  std::vector<std::array<const double*, 2>> knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const;
+  /**
+   * @brief knn_search as above, recording the work done by the query in stats
+   * @param stats is the collector to record to, eg. QueryStats, or NullQueryStats to record nothing
+   */
+  template <typename QS>
+  std::vector<std::array<const double*, 2>> knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const;
+  /**
+   * @brief knn_search as above, for a query prepared once by the traits so that bounding it to each mbr costs less
+   * @param pq is the query prepared for the traits' PreparedQuery type (eg. apla_bounds::PreparedQuery of apla_bounds::AplaTraits)
+   * The traits bound a prepared query to a mbr only as tightly as pruning by the k least errors found so far needs,
+   * as traits.dist_sqr(pq, mbr, threshold), which is exact up to threshold and any lower bound above it.
+   */
+  template <typename TT = T>
+  std::vector<std::array<const double*, 2>> knn_search(const typename TT::PreparedQuery& pq, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const;
+  /**
+   * @brief knn_search for a prepared query as above, recording the work done by the query in stats
+   */
+  template <typename QS, typename TT = T>
+  std::vector<std::array<const double*, 2>> knn_search(const typename TT::PreparedQuery& pq, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const;
+  /**
+   * @brief knn_search_errors is knn_search also giving the squared error of each result, for merging the results of many trees
+   * @param errors is set to the squared errors of the results, the ith being that of the ith result
+   */
+  std::vector<std::array<const double*, 2>> knn_search_errors(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, std::vector<double>& errors) const;
+
+  /**
+   * @brief knn_search_approx finds k subsequences of series close to q, stopping early at the limits given
+   * @param limits are the cut offs of the search, see ApproxKnnLimits
+   * @param scratch is the working space of the search, owned by the caller
+   * @return the results and the guarantee achieved: the true kth nearest is no closer than the lowest bound left unexpanded
+   */
+  ApproxKnnResult knn_search_approx(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, const ApproxKnnLimits& limits, RTreeSearchScratch& scratch) const;
+  /**
+   * @brief knn_search_approx as above, allocating its own working space
+   */
+  ApproxKnnResult knn_search_approx(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, const ApproxKnnLimits& limits) const;
+
+  class NearestIterator;
+  /**
+   * @brief nearest starts a distance browsing search, yielding the subsequences of s one at a time from closest to q onwards
+   * @param q is the query sequence
+   * @param retrieve_f a method to retrieve the original sequence using the indexing tool and a larger sequence
+   * @param s the larger sequence containing all additions to the r tree, it must outlive the iterator
+   * @return the iterator, which keeps the search state between calls so each further subsequence costs only the extra work
+   * The tree must not be modified while the iterator is in use.
+   */
+  NearestIterator nearest(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const;
   /**
    * @brief sim_search_exact finds all subsequences of series that are within epsilon of query
    * @param query is the query sequence to search for similar sequences to
@@ -140,15 +383,84 @@ public:
    * @param s the larger sequence containing all additions to the r tree
    * @return array of pointers to the sequences in the larger sequence s
    */
-  std::vector<std::array<const double*, 2>> sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s);
+  std::vector<std::array<const double*, 2>> sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const;
+  /**
+   * @brief sim_search_exact as above, reusing the working arrays in scratch instead of allocating new ones
+   * @param scratch is the working space of the search, owned by the caller
+   */
+  std::vector<std::array<const double*, 2>> sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const;
+  /**
+   * @brief sim_search_exact as above, recording the work done by the query in stats
+   * @param stats is the collector to record to, eg. QueryStats, or NullQueryStats to record nothing
+   */
+  template <typename QS>
+  std::vector<std::array<const double*, 2>> sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const;
+  /**
+   * @brief sim_search_exact as above, for a query prepared once by the traits (see knn_search), bounded only as tightly as epsilon needs
+   */
+  template <typename TT = T>
+  std::vector<std::array<const double*, 2>> sim_search_exact(const typename TT::PreparedQuery& pq, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const;
+  /**
+   * @brief sim_search_exact for a prepared query as above, recording the work done by the query in stats
+   */
+  template <typename QS, typename TT = T>
+  std::vector<std::array<const double*, 2>> sim_search_exact(const typename TT::PreparedQuery& pq, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const;
   /**
    * @brief pruning_power returns the pruning power observed by trying a 1-NN search for q
    * @param q is the query sequence
    * @param retrieve_f a method to retrieve the original sequence using the indexing tool and a larger sequence
    * @param s the larger sequence containing all additions to the r tree
    * @return the pruning power (number of sequences fetched) / (number of sequences in r tree)
+   * This is the entries_retrieved of the QueryStats of a 1-NN knn_search, over the size of the tree.
+   */
+  double pruning_power(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const;
+  /**
+   * @brief pruning_power as above, reusing the working arrays in scratch instead of allocating new ones
+   * @param scratch is the working space of the search, owned by the caller
    */
-  double pruning_power(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s);
+  double pruning_power(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const;
+
+  /**
+   * @brief knn_search_batch runs knn_search for every query concurrently
+   * @param qs is the array of query sequences
+   * @param k is the number of sequences to find closest to each query
+   * @param retrieve_f a method to retrieve the original sequence using the indexing tool and a larger sequence
+   * @param s the larger sequence containing all additions to the r tree
+   * @param num_threads is the number of threads to search with, 0 uses one per hardware core
+   * @return array of results, the ith being the knn_search result for the ith query
+   * The tree is only read while searching so it must not be modified until this returns.
+   */
+  std::vector<std::vector<std::array<const double*, 2>>> knn_search_batch(const std::vector<std::vector<double>>& qs, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads=0) const;
+  /**
+   * @brief knn_search_batch as above, recording the work done by the queries
+   * @param stats is set to the stats of each query, the ith being those of the ith query
+   */
+  std::vector<std::vector<std::array<const double*, 2>>> knn_search_batch(const std::vector<std::vector<double>>& qs, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, std::vector<QueryStats>& stats, unsigned int num_threads=0) const;
+  /**
+   * @brief sim_search_exact_batch runs sim_search_exact for every query concurrently
+   * @param qs is the array of query sequences
+   * @param epsilon is the maximum allowed l2 error between a query and returned subseqence
+   * @param retrieve_f a method to retrieve the original sequence using the indexing tool and a larger sequence
+   * @param s the larger sequence containing all additions to the r tree
+   * @param num_threads is the number of threads to search with, 0 uses one per hardware core
+   * @return array of results, the ith being the sim_search_exact result for the ith query
+   * The tree is only read while searching so it must not be modified until this returns.
+   */
+  std::vector<std::vector<std::array<const double*, 2>>> sim_search_exact_batch(const std::vector<std::vector<double>>& qs, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads=0) const;
+  /**
+   * @brief sim_search_exact_batch as above, recording the work done by the queries
+   * @param stats is set to the stats of each query, the ith being those of the ith query
+   */
+  std::vector<std::vector<std::array<const double*, 2>>> sim_search_exact_batch(const std::vector<std::vector<double>>& qs, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, std::vector<QueryStats>& stats, unsigned int num_threads=0) const;
+  /**
+   * @brief pruning_power_batch runs pruning_power for every query concurrently
+   * @param qs is the array of query sequences
+   * @param retrieve_f a method to retrieve the original sequence using the indexing tool and a larger sequence
+   * @param s the larger sequence containing all additions to the r tree
+   * @param num_threads is the number of threads to search with, 0 uses one per hardware core
+   * @return array of pruning powers, the ith being that of the ith query
+   */
+  std::vector<double> pruning_power_batch(const std::vector<std::vector<double>>& qs, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads=0) const;
 
 
   /**
@@ -156,7 +468,7 @@ public:
    * @param node is the node to split
    * @return new node holding other half of entries
    */
-  RTreeNode<R,I>* split_node(RTreeNode<R,I>* const node);
+  NodeId split_node(NodeId node);
 
   /**
    * @brief quad_pick_seeds uses quadratic algorithm from paper to pick entries to start split from
@@ -167,152 +479,186 @@ public:
   /**
    * @brief quad_pick_next_node picks the next node to be added to one of the splits
    * @param mbrs is array of children to pick seeds from
-   * @param g1 is set of children in first node
-   * @param g1mbr is current mbr covering its children
-   * @param g2 is set of children in second node
-   * @param g2mbr is current mbr covering its children
-   * @return the index of the next node to move to a set
+   * @param group is the group (0 or 1) each child is in, -1 for children not yet in a group
+   * @param g1mbr is current mbr covering the children of group 0
+   * @param g2mbr is current mbr covering the children of group 1
+   * @return the index of the next node to move to a group
    */
-  unsigned int quad_pick_next_node(const std::vector<const R*>& mbrs, const std::set<unsigned int>& g1, const R& g1mbr, const std::set<unsigned int>& g2, const R& g2mbr);
+  unsigned int quad_pick_next_node(const std::vector<const R*>& mbrs, const std::vector<int>& group, const R& g1mbr, const R& g2mbr);
 
 private:
+  // the searches take either a series or a query prepared by the traits as Q
+  template <typename QS, typename Q>
+  void start_nearest(const Q& q, RTreeSearchScratch& scratch, QS& stats, unsigned int k=0) const;
+  template <typename QS, typename Q>
+  bool next_nearest(const Q& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats, std::array<const double*, 2>& result, double& error) const;
+  template <typename QS, typename Q>
+  std::vector<std::array<const double*, 2>> knn_search_query(const Q& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats, std::vector<double>* errors=nullptr) const;
+  template <typename QS, typename Q>
+  std::vector<std::array<const double*, 2>> sim_search_exact_query(const Q& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const;
+  /**
+   * @brief query_dist_sqr bounds the distance between a query and a mbr, exactly for a series and for a prepared query up to threshold
+   * @param exact is set if the bound is the distance, otherwise it is a lower bound above threshold
+   */
+  inline double query_dist_sqr(const std::vector<double>& q, const R& mbr, double /*threshold*/, bool& exact) const
+  {
+    exact = true;
+    return traits.dist_sqr(q, mbr);
+  }
+  template <typename Q>
+  inline double query_dist_sqr(const Q& pq, const R& mbr, double threshold, bool& exact) const
+  {
+    double bound = traits.dist_sqr(pq, mbr, threshold);
+    exact = bound <= threshold;
+    return bound;
+  }
 
-  RTreeNode<R,I>* choose_leaf(const R&);
-  RTreeNode<R,I>* choose_leaf_from(const R&, RTreeNode<R,I>*);
-
-  void adjust_tree(RTreeNode<R,I>* node); 
-
-  std::vector<const R*> get_entry_mbrs( const RTreeNode<R,I> *const n);
-  R rebuild_mbr( const RTreeNode<R,I> *const n);
-  unsigned int get_num_mbrs( const RTreeNode<R,I> *const n);
-  unsigned int get_size_tree(const RTreeNode<R,I>* node);
-  unsigned int get_size_leaves(const RTreeNode<R,I>* node);
-
-  void destroy_tree_from(RTreeNode<R,I>* node);
+  /**
+   * @brief the partition functions assign each of mbrs to group 0 or 1, each group keeping at least min entries
+   * @param mbrs is array of children to split
+   * @param g0mbr is set to the mbr covering group 0
+   * @param g1mbr is set to the mbr covering group 1
+   * @return the group of each child
+   */
+  std::vector<int> quad_partition(const std::vector<const R*>& mbrs, R& g0mbr, R& g1mbr);
+  std::vector<int> linear_partition(const std::vector<const R*>& mbrs, R& g0mbr, R& g1mbr);
+  std::vector<int> rstar_partition(const std::vector<const R*>& mbrs, R& g0mbr, R& g1mbr);
+
+  NodeId choose_node(const R&, unsigned int level);
+  NodeId choose_node_from(const R&, NodeId, unsigned int level);
+
+  void insert_at_level(const R& mbr, const I& st_index, NodeId child, unsigned int level, std::vector<bool>& reinserted);
+  bool reinsert_farthest(NodeId node, std::vector<bool>& reinserted);
+
+  bool covers(const R& outer, const R& inner);
+  bool find_leaf(const R& mbr, const I& st_index, bool only_covering, NodeId& leaf, unsigned int& slot);
+  void remove_entry(NodeId node, unsigned int slot);
+  void condense_tree(NodeId leaf);
+  void reinsert_entries(NodeId node);
+  void adjust_tree(NodeId node); 
+
+  std::vector<unsigned int> str_sort(std::vector<unsigned int>& order, const std::vector<std::vector<double>>& centres);
+
+  NodeId new_node(unsigned int level);
+  void release_node(NodeId n);
+  void clear_tree();
+  inline I* leaf_indexes(NodeId n) { return entry_indexes[nodes[n].links]; }
+  inline const I* leaf_indexes(NodeId n) const { return entry_indexes[nodes[n].links]; }
+  inline NodeId* node_children(NodeId n) { return entry_children[nodes[n].links]; }
+  inline const NodeId* node_children(NodeId n) const { return entry_children[nodes[n].links]; }
+
+  std::vector<const R*> get_entry_mbrs(NodeId n);
+  R rebuild_mbr(NodeId n);
+  unsigned int get_size_tree(NodeId node) const;
+  unsigned int get_size_leaves(NodeId node) const;
 };
 
 /* ******************** General R Tree functions ************************ */
-// non recursive destruction to avoid crashing the stack
-template <typename R, typename I>
-void RTree<R,I>::destroy_tree_from(RTreeNode<R,I>* node)
+template <typename R, typename I, SplitPolicy P, typename T>
+NodeId RTree<R,I,P,T>::new_node(unsigned int level)
 {
-  if (node == nullptr) return;
-  if (node->entries.index() == 0) { // leaf node
-    delete node;
-  } else {
-    queue<RTreeNode<R,I>*> q;
-    q.push(node);
-
-    while (q.size() > 0) {
-      RTreeNode<R,I>* next = q.front();
-      q.pop();
-      if (next->entries.index() == 0) { // next is a leaf
-	destroy_tree_from(next);
-	continue;
-      }
-      for (RTreeNode<R,I>* entry : std::get<1>(next->entries)) {
-	q.push(entry);
-      }
-      delete next;
-    }
-  }
+  NodeId n = nodes.allocate();
+  entry_mbrs.reserve(n);
+  nodes[n].level = level;
+  nodes[n].links = level == 0 ? entry_indexes.allocate() : entry_children.allocate();
+  return n;
 }
 
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::release_node(NodeId n)
+{
+  if (nodes[n].level == 0) entry_indexes.release(nodes[n].links);
+  else entry_children.release(nodes[n].links);
+  nodes.release(n);
+}
 
-template <typename R, typename I>
-std::vector<const R*> RTree<R,I>::get_entry_mbrs( const RTreeNode<R,I> *const n)
+// freeing the slabs frees the whole tree, no walk over the nodes is needed
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::clear_tree()
 {
-  if (n->entries.index() == 0) {
-    std::vector<const R*> mbrs;
-    for ( const LeafEntry<R,I>& l : std::get<0>(n->entries) ){
-      mbrs.push_back(&l.mbr);
-    }
-    return mbrs;
-  } else {
-    std::vector<const R*> mbrs;
-    for ( const RTreeNode<R,I>* ep : std::get<1>(n->entries) ){
-      mbrs.push_back(&ep->mbr);
-    }
-    return mbrs;
-  }
+  nodes.clear();
+  entry_mbrs.clear();
+  entry_indexes.clear();
+  entry_children.clear();
+  mapped.unmap();
+  root = NO_NODE;
+  total_num_entries = 0;
 }
 
-template <typename R, typename I>
-unsigned int RTree<R,I>::get_num_mbrs( const RTreeNode<R,I> *const n)
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<const R*> RTree<R,I,P,T>::get_entry_mbrs(NodeId n)
 {
-  if (n->entries.index() == 0)
-    return std::get<0>(n->entries).size();
-  return std::get<1>(n->entries).size();
+  std::vector<const R*> mbrs;
+  const R* const mbr_arr = entry_mbrs[n];
+  for (unsigned int i=0; i<nodes[n].num_entries; i++) {
+    mbrs.push_back(mbr_arr + i);
+  }
+  return mbrs;
 }
 
-template <typename R, typename I>
-R RTree<R,I>::rebuild_mbr( const RTreeNode<R,I> *const n)
+template <typename R, typename I, SplitPolicy P, typename T>
+R RTree<R,I,P,T>::rebuild_mbr(NodeId n)
 {
-  std::vector<const R*> mbrs = get_entry_mbrs(n);
-  R mbr = *mbrs[0];
-  for (const R* const rp : mbrs) {
-    mbr = merge_f( mbr, *rp );
+  const R* const mbr_arr = entry_mbrs[n];
+  R mbr = mbr_arr[0];
+  for (unsigned int i=1; i<nodes[n].num_entries; i++) {
+    mbr = traits.merge( mbr, mbr_arr[i] );
   }
   return mbr;
 }
 
-template <typename R, typename I>
-unsigned int RTree<R,I>::get_size_tree(){
+template <typename R, typename I, SplitPolicy P, typename T>
+unsigned int RTree<R,I,P,T>::get_size_tree() const {
   return get_size_tree(root);
 }
-template <typename R, typename I>
-unsigned int RTree<R,I>::get_size_leaves(){
+template <typename R, typename I, SplitPolicy P, typename T>
+unsigned int RTree<R,I,P,T>::get_size_leaves() const {
   return get_size_leaves(root);
 }
 
-template <typename R, typename I>
-unsigned int RTree<R,I>::get_size_tree(const RTreeNode<R,I>* node)
+template <typename R, typename I, SplitPolicy P, typename T>
+unsigned int RTree<R,I,P,T>::get_size_tree(NodeId node) const
 {
-  if (node == nullptr) return 0;
+  if (node == NO_NODE) return 0;
   unsigned int size = 1;
-  if (node->entries.index() == 0) { // leaf node
-    return size;
-  } else {
-    queue<const RTreeNode<R,I>*> q;
-    q.push(node);
-
-    while (q.size() > 0) {
-      const RTreeNode<R,I>* next = q.front();
-      q.pop();
-      if (next->entries.index() == 0) { // next is a leaf
-	size++;
-	continue;
-      }
-      for (RTreeNode<R,I>* entry : std::get<1>(next->entries)) {
-	size++;
-	q.push(entry);
-      }
+  if (nodes[node].level == 0) return size; // leaf node
+  queue<NodeId> q;
+  q.push(node);
+
+  while (q.size() > 0) {
+    const RTreeNode<R>& next = nodes[q.front()];
+    const NodeId* const children = node_children(q.front());
+    q.pop();
+    if (next.level == 0) { // next is a leaf
+      size++;
+      continue;
+    }
+    for (unsigned int i=0; i<next.num_entries; i++) {
+      size++;
+      q.push(children[i]);
     }
   }
   return size;
 }
 
-template <typename R, typename I>
-unsigned int RTree<R,I>::get_size_leaves(const RTreeNode<R,I>* node)
+template <typename R, typename I, SplitPolicy P, typename T>
+unsigned int RTree<R,I,P,T>::get_size_leaves(NodeId node) const
 {
-  if (node == nullptr) return 0;
+  if (node == NO_NODE) return 0;
   unsigned int size = 1;
-  if (node->entries.index() == 0) { // leaf node
-    return size;
-  } else {
-    queue<const RTreeNode<R,I>*> q;
-    q.push(node);
-
-    while (q.size() > 0) {
-      const RTreeNode<R,I>* next = q.front();
-      q.pop();
-      if (next->entries.index() == 0) { // next is a leaf
-	size+=std::get<0>(next->entries).size();
-	continue;
-      }
-      for (RTreeNode<R,I>* entry : std::get<1>(next->entries)) {
-	q.push(entry);
-      }
+  queue<NodeId> q;
+  q.push(node);
+
+  while (q.size() > 0) {
+    const RTreeNode<R>& next = nodes[q.front()];
+    const NodeId* const children = node_children(q.front());
+    q.pop();
+    if (next.level == 0) { // next is a leaf
+      size+=next.num_entries;
+      continue;
+    }
+    for (unsigned int i=0; i<next.num_entries; i++) {
+      q.push(children[i]);
     }
   }
   return size;
@@ -320,44 +666,47 @@ unsigned int RTree<R,I>::get_size_leaves(const RTreeNode<R,I>* node)
 
 /* *********************************** Insert definitions ******************* */
 #include <cmath>
+#include <algorithm>
+#include <numeric>
 
-template <typename R, typename I>
-RTreeNode<R,I>* RTree<R,I>::choose_leaf(const R& mbr)
+template <typename R, typename I, SplitPolicy P, typename T>
+NodeId RTree<R,I,P,T>::choose_node(const R& mbr, unsigned int level)
 {
-  return choose_leaf_from(mbr, root);
+  return choose_node_from(mbr, root, level);
 }
 
 // recursive call here is all good as goes directly downwards, doesn't branch at all
-template <typename R, typename I>
-RTreeNode<R,I>* RTree<R,I>::choose_leaf_from(const R& mbr, RTreeNode<R,I>* node)
+template <typename R, typename I, SplitPolicy P, typename T>
+NodeId RTree<R,I,P,T>::choose_node_from(const R& mbr, NodeId node, unsigned int level)
 {
-  // if root is leaf node
-  if (node->entries.index() == 0) return node;
+  // if node is at the level being inserted into (a leaf for new sequences)
+  if (nodes[node].level <= level) return node;
   
   // otherwise find the child rect that increases area least to accomodate it and recursively call
+  const R* const mbr_arr = entry_mbrs[node];
   double min_area_incr = -1;
-  RTreeNode<R,I>* min_r;
-  for (RTreeNode<R,I>* e_ptr : std::get<1>(node->entries)) {
-    double area_incr = area_f( merge_f( mbr, e_ptr->mbr ) ) - area_f(e_ptr->mbr);
-    if (min_area_incr < 0 || area_incr < min_area_incr || area_incr == min_area_incr && area_f(e_ptr->mbr) < area_f(min_r->mbr)) {
-      min_r = e_ptr;
+  unsigned int min_r = 0;
+  for (unsigned int i=0; i<nodes[node].num_entries; i++) {
+    double area_incr = traits.area( traits.merge( mbr, mbr_arr[i] ) ) - traits.area(mbr_arr[i]);
+    if (min_area_incr < 0 || area_incr < min_area_incr || (area_incr == min_area_incr && traits.area(mbr_arr[i]) < traits.area(mbr_arr[min_r]))) {
+      min_r = i;
       min_area_incr = area_incr;
     }
   }
-  return choose_leaf_from(mbr, min_r);
+  return choose_node_from(mbr, node_children(node)[min_r], level);
 }
 
-template <typename R, typename I>
-std::array<unsigned int, 2> RTree<R,I>::quad_pick_seeds(const std::vector<const R*>& mbrs)
+template <typename R, typename I, SplitPolicy P, typename T>
+std::array<unsigned int, 2> RTree<R,I,P,T>::quad_pick_seeds(const std::vector<const R*>& mbrs)
 {
   double max_d = -1e30;
   unsigned int i1, i2;
 
   for (unsigned int i=0; i<mbrs.size(); i++) {
     for (unsigned int j=0; j<i; j++) {
-      double d = area_f( merge_f(*mbrs[i], *mbrs[j]) )
-		  - area_f( *mbrs[i] )
-		  - area_f( *mbrs[j] );
+      double d = traits.area( traits.merge(*mbrs[i], *mbrs[j]) )
+		  - traits.area( *mbrs[i] )
+		  - traits.area( *mbrs[j] );
       if (d > max_d) {
 	max_d = d;
 	i1 = i;
@@ -368,16 +717,16 @@ std::array<unsigned int, 2> RTree<R,I>::quad_pick_seeds(const std::vector<const
   return { i1, i2 };
 }
 
-template <typename R, typename I>
-unsigned int RTree<R,I>::quad_pick_next_node(const std::vector<const R*>& mbrs, const std::set<unsigned int>& g1, const R& g1mbr, const std::set<unsigned int>& g2, const R& g2mbr)
+template <typename R, typename I, SplitPolicy P, typename T>
+unsigned int RTree<R,I,P,T>::quad_pick_next_node(const std::vector<const R*>& mbrs, const std::vector<int>& group, const R& g1mbr, const R& g2mbr)
 {
   double max_d = 0;
   int max_i = -1;
 
   for (int i=0; i<mbrs.size(); i++) {
-    if ( g1.count(i) > 0 || g2.count(i) > 0) continue;
-    double d = area_f( merge_f(g1mbr, *mbrs[i]) )
-		- area_f( merge_f(g2mbr, *mbrs[i]) );
+    if (group[i] != -1) continue;
+    double d = traits.area( traits.merge(g1mbr, *mbrs[i]) )
+		- traits.area( traits.merge(g2mbr, *mbrs[i]) );
     if (std::abs(d) >= std::abs(max_d)) {
       max_d = d;
       max_i = i;
@@ -386,179 +735,645 @@ unsigned int RTree<R,I>::quad_pick_next_node(const std::vector<const R*>& mbrs,
   return max_i;
 }
 
-// split node only adjusts the MBR of node and new twin_node
-//  does not adjust mbr of parent
-//  may invalidate max entries of parent
-//  must be called with adjust tree to maintain invariant
-template <typename R, typename I>
-RTreeNode<R,I>* RTree<R,I>::split_node(RTreeNode<R,I>* node)
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<int> RTree<R,I,P,T>::quad_partition(const std::vector<const R*>& mbrs, R& g0mbr, R& g1mbr)
 {
-  std::vector<const R*> mbrs = get_entry_mbrs(node);
-
   std::array<unsigned int, 2> seeds = quad_pick_seeds(mbrs);
-  //std::cout << " got here afterall" << std::endl;
   //std::cout << seeds[0] << " " << seeds[1] << std::endl;
-  std::set<unsigned int> g0 = {seeds[0]}, g1 = {seeds[1]};
-  R g0mbr = *mbrs[seeds[0]], g1mbr = *mbrs[seeds[1]];
+  std::vector<int> group(mbrs.size(), -1);
+  group[seeds[0]] = 0;
+  group[seeds[1]] = 1;
+  unsigned int g0_size = 1, g1_size = 1;
+  g0mbr = *mbrs[seeds[0]];
+  g1mbr = *mbrs[seeds[1]];
 
-  int num_remaining = get_num_mbrs(node) - 2;
+  int num_remaining = mbrs.size() - 2;
 
   // allocate all entries to either of the seeds preserving the minimum entries per node requirement
-  while (g0.size() < max_entries && g1.size() < max_entries && g0.size()+num_remaining > min_entries && g1.size()+num_remaining > min_entries) {
-    unsigned int next_i = quad_pick_next_node(mbrs, g0, g0mbr, g1, g1mbr);
+  while (g0_size < max_entries && g1_size < max_entries && g0_size+num_remaining > min_entries && g1_size+num_remaining > min_entries) {
+    unsigned int next_i = quad_pick_next_node(mbrs, group, g0mbr, g1mbr);
     if (next_i == -1) break; // exhausted all numbers
     num_remaining--;
-    double area_incr_g0 = area_f( merge_f( g0mbr, *mbrs[next_i] ) ) - area_f( g0mbr );
-    double area_incr_g1 = area_f( merge_f( g1mbr, *mbrs[next_i] ) ) - area_f( g1mbr );
-    if (area_incr_g0 < area_incr_g1 || area_incr_g0 == area_incr_g1 && area_f(g0mbr) < area_f(g1mbr)) {
-      g0.insert(next_i);
-      g0mbr = merge_f(g0mbr, *mbrs[next_i]);
+    double area_incr_g0 = traits.area( traits.merge( g0mbr, *mbrs[next_i] ) ) - traits.area( g0mbr );
+    double area_incr_g1 = traits.area( traits.merge( g1mbr, *mbrs[next_i] ) ) - traits.area( g1mbr );
+    if (area_incr_g0 < area_incr_g1 || (area_incr_g0 == area_incr_g1 && traits.area(g0mbr) < traits.area(g1mbr))) {
+      group[next_i] = 0;
+      g0_size++;
+      g0mbr = traits.merge(g0mbr, *mbrs[next_i]);
     } else {
-      g1.insert(next_i);
-      g1mbr = merge_f(g1mbr, *mbrs[next_i]);
+      group[next_i] = 1;
+      g1_size++;
+      g1mbr = traits.merge(g1mbr, *mbrs[next_i]);
     }
   }
-  if (g0.size()==max_entries || g1.size()+num_remaining <= min_entries) {
-    unsigned int next_i = quad_pick_next_node(mbrs, g0, g0mbr, g1, g1mbr);
+  if (g0_size==max_entries || g1_size+num_remaining <= min_entries) {
+    unsigned int next_i = quad_pick_next_node(mbrs, group, g0mbr, g1mbr);
     while (next_i != -1) {
-      g1.insert(next_i);
-      g1mbr = merge_f(g1mbr, *mbrs[next_i]);
-      next_i = quad_pick_next_node(mbrs, g0, g0mbr, g1, g1mbr);
+      group[next_i] = 1;
+      g1_size++;
+      g1mbr = traits.merge(g1mbr, *mbrs[next_i]);
+      next_i = quad_pick_next_node(mbrs, group, g0mbr, g1mbr);
     }
   }
-  if (g1.size()==max_entries || g0.size()+num_remaining <= min_entries) {
-    unsigned int next_i = quad_pick_next_node(mbrs, g0, g0mbr, g1, g1mbr);
+  if (g1_size==max_entries || g0_size+num_remaining <= min_entries) {
+    unsigned int next_i = quad_pick_next_node(mbrs, group, g0mbr, g1mbr);
     while (next_i != -1) {
-      g0.insert(next_i);
-      g0mbr = merge_f(g0mbr, *mbrs[next_i]);
-      next_i = quad_pick_next_node(mbrs, g0, g0mbr, g1, g1mbr);
+      group[next_i] = 0;
+      g0_size++;
+      g0mbr = traits.merge(g0mbr, *mbrs[next_i]);
+      next_i = quad_pick_next_node(mbrs, group, g0mbr, g1mbr);
     }
   }
+  return group;
+}
 
-  if ( node->entries.index() == 0 ) {
-    std::vector<LeafEntry<R,I>>& leaves = std::get<0>(node->entries);
-
-    std::vector<LeafEntry<R,I>> g0entries;
-    std::vector<LeafEntry<R,I>> g1entries;
-    for (unsigned int n : g1) {
-      g1entries.push_back( leaves[n] );
+// linear split, the seeds are the entries whose centres lie furthest apart along the dimension they spread the most
+//  the rest are taken in order by the group needing the least area increase to cover them
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<int> RTree<R,I,P,T>::linear_partition(const std::vector<const R*>& mbrs, R& g0mbr, R& g1mbr)
+{
+  std::vector<std::vector<double>> centres;
+  for (const R* mbr : mbrs) centres.push_back( traits.centre(*mbr) );
+
+  unsigned int s0 = 0, s1 = 1;
+  double max_spread = -1;
+  for (unsigned int d=0; d<centres[0].size(); d++) {
+    unsigned int lo = 0, hi = 0;
+    for (unsigned int i=1; i<centres.size(); i++) {
+      if (centres[i][d] < centres[lo][d]) lo = i;
+      if (centres[i][d] > centres[hi][d]) hi = i;
     }
-    for (unsigned int n : g0) {
-      g0entries.push_back( leaves[n] );
+    if (lo != hi && centres[hi][d] - centres[lo][d] > max_spread) {
+      max_spread = centres[hi][d] - centres[lo][d];
+      s0 = lo;
+      s1 = hi;
     }
+  }
+
+  std::vector<int> group(mbrs.size(), -1);
+  group[s0] = 0;
+  group[s1] = 1;
+  unsigned int g0_size = 1, g1_size = 1;
+  g0mbr = *mbrs[s0];
+  g1mbr = *mbrs[s1];
 
-    // cover is root case
-    if (node->parent == nullptr) {
-      RTreeNode<R,I>* new_root = new RTreeNode<R,I>({ node->mbr, nullptr, std::vector<RTreeNode<R,I>*>{node} });
-      node->parent = new_root;
-      root = new_root;
+  unsigned int num_remaining = mbrs.size() - 2;
+  for (unsigned int i=0; i<mbrs.size(); i++) {
+    if (group[i] != -1) continue;
+    int g;
+    if (g0_size + num_remaining <= min_entries) g = 0; // group needs all remaining entries to be full enough
+    else if (g1_size + num_remaining <= min_entries) g = 1;
+    else {
+      double area_incr_g0 = traits.area( traits.merge( g0mbr, *mbrs[i] ) ) - traits.area( g0mbr );
+      double area_incr_g1 = traits.area( traits.merge( g1mbr, *mbrs[i] ) ) - traits.area( g1mbr );
+      g = (area_incr_g0 < area_incr_g1 || (area_incr_g0 == area_incr_g1 && g0_size <= g1_size)) ? 0 : 1;
     }
+    num_remaining--;
+    group[i] = g;
+    if (g == 0) {
+      g0_size++;
+      g0mbr = traits.merge(g0mbr, *mbrs[i]);
+    } else {
+      g1_size++;
+      g1mbr = traits.merge(g1mbr, *mbrs[i]);
+    }
+  }
+  return group;
+}
 
-    node->entries = g0entries;
-    node->mbr = g0mbr; // adjust node's mbr to reflect its current entries
-    RTreeNode<R,I>* g1node = new RTreeNode<R,I>({g1mbr, node->parent, g1entries});
-    std::get<1>(node->parent->entries).push_back( g1node ); // add g1node to parent
+// R* split, sorting the entries along each dimension of their centres the axis is the one where the distributions
+//  (first k entries against the rest) have least total area, the distribution is the one of least overlap along it
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<int> RTree<R,I,P,T>::rstar_partition(const std::vector<const R*>& mbrs, R& g0mbr, R& g1mbr)
+{
+  const unsigned int n = mbrs.size();
+  std::vector<std::vector<double>> centres;
+  for (const R* mbr : mbrs) centres.push_back( traits.centre(*mbr) );
+
+  // k is the size of the first group
+  unsigned int first_k = std::max(min_entries, 1u);
+  unsigned int last_k = n - first_k;
+  if (first_k > last_k) first_k = last_k = n / 2;
+
+  // lower[k] covers the first k+1 entries of order, upper[k] the entries from k onwards
+  std::vector<unsigned int> order(n), best_order;
+  std::vector<R> lower(n), upper(n);
+  auto cover_distributions = [&]() {
+    lower[0] = *mbrs[order[0]];
+    for (unsigned int k=1; k<n; k++) lower[k] = traits.merge( lower[k-1], *mbrs[order[k]] );
+    upper[n-1] = *mbrs[order[n-1]];
+    for (unsigned int k=n-1; k>0; k--) upper[k-1] = traits.merge( upper[k], *mbrs[order[k-1]] );
+  };
 
-    return g1node;
+  double min_axis_area = -1;
+  for (unsigned int d=0; d<centres[0].size(); d++) {
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&centres,d](unsigned int a, unsigned int b){ return centres[a][d] < centres[b][d]; });
+    cover_distributions();
+    double axis_area = 0.0;
+    for (unsigned int k=first_k; k<=last_k; k++) {
+      axis_area += traits.area(lower[k-1]) + traits.area(upper[k]);
+    }
+    if (min_axis_area < 0 || axis_area < min_axis_area) {
+      min_axis_area = axis_area;
+      best_order = order;
+    }
+  }
+  order = best_order;
+  cover_distributions();
+
+  unsigned int best_k = first_k;
+  double min_overlap = std::numeric_limits<double>::infinity(), min_area = std::numeric_limits<double>::infinity();
+  for (unsigned int k=first_k; k<=last_k; k++) {
+    double area_g0 = traits.area(lower[k-1]);
+    double area_g1 = traits.area(upper[k]);
+    double overlap = area_g0 + area_g1 - traits.area( traits.merge(lower[k-1], upper[k]) );
+    if (k == first_k || overlap < min_overlap || (overlap == min_overlap && area_g0 + area_g1 < min_area)) {
+      best_k = k;
+      min_overlap = overlap;
+      min_area = area_g0 + area_g1;
+    }
+  }
 
-  } else {
-    const std::vector<RTreeNode<R,I>*>& entries = std::get<1>(node->entries);
+  std::vector<int> group(n);
+  for (unsigned int k=0; k<n; k++) {
+    group[order[k]] = k < best_k ? 0 : 1;
+  }
+  g0mbr = lower[best_k-1];
+  g1mbr = upper[best_k];
+  return group;
+}
 
-    std::vector<RTreeNode<R,I>*> g0entries;
-    std::vector<RTreeNode<R,I>*> g1entries;
-    for (unsigned int n : g1) {
-      g1entries.push_back(entries[n]);
-    } // copy across pointers
-    for (unsigned int n : g0) {
-      g0entries.push_back(entries[n]);
-    } // copy across pointers
+// split node only adjusts the MBR of node and new twin_node
+//  does not adjust mbr of parent
+//  may invalidate max entries of parent
+//  must be called with adjust tree to maintain invariant
+template <typename R, typename I, SplitPolicy P, typename T>
+NodeId RTree<R,I,P,T>::split_node(NodeId node_id)
+{
+  std::vector<const R*> mbrs = get_entry_mbrs(node_id);
+
+  R g0mbr, g1mbr;
+  std::vector<int> group;
+  if (P == SplitPolicy::LINEAR && traits.has_centre()) {
+    group = linear_partition(mbrs, g0mbr, g1mbr);
+  } else if (P == SplitPolicy::RSTAR && traits.has_centre()) {
+    group = rstar_partition(mbrs, g0mbr, g1mbr);
+  } else {
+    group = quad_partition(mbrs, g0mbr, g1mbr);
+  }
 
-    // cover is root case
-    if (node->parent == nullptr) {
-      RTreeNode<R,I>* new_root = new RTreeNode<R,I>({ node->mbr, nullptr, std::vector<RTreeNode<R,I>*>{node} });
-      node->parent = new_root;
-      root = new_root;
+  // copy the groups out before rewriting the node's entries in place
+  std::vector<R> g0mbrs, g1mbrs;
+  std::vector<I> g0indexes, g1indexes;
+  std::vector<NodeId> g0children, g1children;
+  const bool is_leaf = nodes[node_id].level == 0;
+  for (unsigned int n=0; n<mbrs.size(); n++) {
+    if (group[n] == 0) {
+      g0mbrs.push_back( *mbrs[n] );
+      if (is_leaf) g0indexes.push_back( leaf_indexes(node_id)[n] );
+      else g0children.push_back( node_children(node_id)[n] );
+    } else {
+      g1mbrs.push_back( *mbrs[n] );
+      if (is_leaf) g1indexes.push_back( leaf_indexes(node_id)[n] );
+      else g1children.push_back( node_children(node_id)[n] );
     }
+  }
 
-    RTreeNode<R,I>* g1node = new RTreeNode<R,I>({g1mbr, node->parent, g1entries});
-    for (unsigned int n : g1) {
-	entries[n]->parent = g1node;
-    } // change child entries to have new parent
-    node->entries = g0entries;
-    node->mbr = g0mbr; // adjust node's mbr to reflect its current entries
-
-    std::get<1>(node->parent->entries).push_back( g1node ); // add g1node to parent
-    return g1node;
+  // cover is root case
+  if (nodes[node_id].parent == NO_NODE) {
+    NodeId new_root = new_node( nodes[node_id].level + 1 );
+    nodes[new_root].mbr = nodes[node_id].mbr;
+    nodes[new_root].num_entries = 1;
+    entry_mbrs[new_root][0] = nodes[node_id].mbr;
+    node_children(new_root)[0] = node_id;
+    nodes[node_id].parent = new_root;
+    root = new_root;
   }
+  // references into the pools stay valid as slabs never move
+  NodeId g1node_id = new_node( nodes[node_id].level );
+  RTreeNode<R>& node = nodes[node_id];
+  RTreeNode<R>& g1node = nodes[g1node_id];
+
+  std::copy( g0mbrs.begin(), g0mbrs.end(), entry_mbrs[node_id] );
+  std::copy( g1mbrs.begin(), g1mbrs.end(), entry_mbrs[g1node_id] );
+  if (is_leaf) {
+    std::copy( g0indexes.begin(), g0indexes.end(), leaf_indexes(node_id) );
+    std::copy( g1indexes.begin(), g1indexes.end(), leaf_indexes(g1node_id) );
+  } else {
+    std::copy( g0children.begin(), g0children.end(), node_children(node_id) );
+    std::copy( g1children.begin(), g1children.end(), node_children(g1node_id) );
+    for (NodeId c : g1children) {
+      nodes[c].parent = g1node_id; // change child entries to have new parent
+    }
+  }
+  node.num_entries = g0mbrs.size();
+  node.mbr = g0mbr; // adjust node's mbr to reflect its current entries
+  g1node.num_entries = g1mbrs.size();
+  g1node.mbr = g1mbr;
+  g1node.parent = node.parent;
+
+  // add g1node to parent
+  RTreeNode<R>& parent = nodes[node.parent];
+  entry_mbrs[node.parent][parent.num_entries] = g1mbr;
+  node_children(node.parent)[parent.num_entries] = g1node_id;
+  parent.num_entries++;
+  return g1node_id;
 }
 
-template <typename R, typename I>
-void RTree<R,I>::adjust_tree(RTreeNode<R,I>* node)
+// the entry of node inside its parent must be kept equal to the node's mbr
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::adjust_tree(NodeId node)
 {
-  RTreeNode<R,I>* curr_node = node;
+  NodeId curr_node = node;
   while (curr_node != root) {
-    RTreeNode<R,I>* parent_node = curr_node->parent;
-    parent_node->mbr = rebuild_mbr(parent_node);
-    if (get_num_mbrs(parent_node) > max_entries) {
+    NodeId parent_node = nodes[curr_node].parent;
+    const NodeId* const siblings = node_children(parent_node);
+    for (unsigned int i=0; i<nodes[parent_node].num_entries; i++) {
+      entry_mbrs[parent_node][i] = nodes[siblings[i]].mbr;
+    }
+    nodes[parent_node].mbr = rebuild_mbr(parent_node);
+    if (nodes[parent_node].num_entries > max_entries) {
       split_node(parent_node);
     }
     curr_node = parent_node;
   }
 }
 
-template <typename R, typename I>
-void RTree<R,I>::insert(R mbr, I st_index)
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::insert(R mbr, I st_index)
 {
   total_num_entries++;
-  if (root == nullptr) {
-    root = new RTreeNode<R,I>(mbr, nullptr, std::vector<LeafEntry<R,I>>({{mbr,st_index}}) );
+  if (root == NO_NODE) {
+    root = new_node(0);
+    nodes[root].mbr = mbr;
+    nodes[root].num_entries = 1;
+    entry_mbrs[root][0] = mbr;
+    leaf_indexes(root)[0] = st_index;
     return;
   }
 
-  RTreeNode<R,I>* target_leaf = choose_leaf(mbr);
-  //std::cout << "	got leaf"<<std::endl;
-  std::vector<LeafEntry<R,I>>& entries = std::get<0>(target_leaf->entries);
-  entries.push_back({mbr, st_index});
-  target_leaf->mbr = merge_f( target_leaf->mbr, mbr );
+  std::vector<bool> reinserted(nodes[root].level + 1, false);
+  insert_at_level(mbr, st_index, NO_NODE, 0, reinserted);
+}
+
+// places an entry into a node of the given level, sequences (st_index) go into level 0 and child nodes above
+//  reinserted marks the levels which have already had a forced reinsertion during this insert
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::insert_at_level(const R& mbr, const I& st_index, NodeId child, unsigned int level, std::vector<bool>& reinserted)
+{
+  NodeId target = choose_node(mbr, level);
+  //std::cout << "	got node"<<std::endl;
+  RTreeNode<R>& node = nodes[target];
+  entry_mbrs[target][node.num_entries] = mbr;
+  if (level == 0) {
+    leaf_indexes(target)[node.num_entries] = st_index;
+  } else {
+    node_children(target)[node.num_entries] = child;
+    nodes[child].parent = target;
+  }
+  node.num_entries++;
+  node.mbr = traits.merge( node.mbr, mbr );
 
-  RTreeNode<R,I>* twin_node = nullptr;
-  if (entries.size() > max_entries) {
+  if (node.num_entries > max_entries && !reinsert_farthest(target, reinserted)) {
     //std::cout << "	splitting"<<std::endl;
-    twin_node = split_node(target_leaf);
+    split_node(target);
     //std::cout << "	splitted"<<std::endl;
   }
   //std::cout << "	adjusting"<<std::endl;
-  adjust_tree(target_leaf);
+  adjust_tree(target);
   //std::cout << "	adjusted"<<std::endl;
-    
 }
+
+// forced reinsertion of R*, removes the 30% of entries whose centres are farthest from the centre of the node
+//  and inserts them again closest first, returns false if the node must be split instead
+template <typename R, typename I, SplitPolicy P, typename T>
+bool RTree<R,I,P,T>::reinsert_farthest(NodeId node_id, std::vector<bool>& reinserted)
+{
+  if (P != SplitPolicy::RSTAR || !traits.has_centre() || node_id == root) return false;
+  const unsigned int level = nodes[node_id].level;
+  if (reinserted.size() <= level) reinserted.resize(level + 1, false);
+  if (reinserted[level]) return false;
+  reinserted[level] = true;
+
+  const unsigned int num_entries = nodes[node_id].num_entries;
+  std::vector<double> node_centre = traits.centre(nodes[node_id].mbr);
+  std::vector<std::tuple<double, unsigned int>> centre_dists;
+  for (unsigned int i=0; i<num_entries; i++) {
+    std::vector<double> centre = traits.centre(entry_mbrs[node_id][i]);
+    double dist = 0.0;
+    for (unsigned int d=0; d<centre.size(); d++) {
+      dist += (centre[d] - node_centre[d]) * (centre[d] - node_centre[d]);
+    }
+    centre_dists.push_back( {dist, i} );
+  }
+  std::sort(centre_dists.begin(), centre_dists.end());
+
+  const unsigned int num_reinsert = std::max( (unsigned int) (0.3 * max_entries), 1u );
+  const unsigned int num_kept = num_entries - num_reinsert;
+  std::vector<R> removed_mbrs;
+  std::vector<I> removed_indexes;
+  std::vector<NodeId> removed_children;
+  std::vector<bool> removed(num_entries, false);
+  for (unsigned int n=num_kept; n<num_entries; n++) {
+    unsigned int i = std::get<1>(centre_dists[n]);
+    removed[i] = true;
+    removed_mbrs.push_back( entry_mbrs[node_id][i] );
+    removed_indexes.push_back( level == 0 ? leaf_indexes(node_id)[i] : I() );
+    removed_children.push_back( level == 0 ? NO_NODE : node_children(node_id)[i] );
+  }
+
+  // compact the kept entries in place
+  unsigned int kept = 0;
+  for (unsigned int i=0; i<num_entries; i++) {
+    if (removed[i]) continue;
+    entry_mbrs[node_id][kept] = entry_mbrs[node_id][i];
+    if (level == 0) leaf_indexes(node_id)[kept] = leaf_indexes(node_id)[i];
+    else node_children(node_id)[kept] = node_children(node_id)[i];
+    kept++;
+  }
+  nodes[node_id].num_entries = kept;
+  nodes[node_id].mbr = rebuild_mbr(node_id);
+  adjust_tree(node_id);
+
+  for (unsigned int n=0; n<removed_mbrs.size(); n++) {
+    insert_at_level(removed_mbrs[n], removed_indexes[n], removed_children[n], level, reinserted);
+  }
+  return true;
+}
+/* *********************************** Remove definitions ******************* */
+
+// merging an mbr into one covering it leaves it unchanged, so its area cannot grow beyond rounding
+template <typename R, typename I, SplitPolicy P, typename T>
+bool RTree<R,I,P,T>::covers(const R& outer, const R& inner)
+{
+  const double outer_area = traits.area(outer);
+  return traits.area( traits.merge( outer, inner ) ) - outer_area <= 1e-9 * std::max( std::abs(outer_area), 1.0 );
+}
+
+// depth first search for the leaf entry holding st_index, only down branches covering mbr when only_covering
+template <typename R, typename I, SplitPolicy P, typename T>
+bool RTree<R,I,P,T>::find_leaf(const R& mbr, const I& st_index, bool only_covering, NodeId& leaf, unsigned int& slot)
+{
+  if (root == NO_NODE) return false;
+  std::vector<NodeId> to_visit = { root };
+  while (to_visit.size() != 0) {
+    NodeId next = to_visit.back();
+    to_visit.pop_back();
+    const R* const mbr_arr = entry_mbrs[next];
+    const unsigned int num_entries = nodes[next].num_entries;
+    if (nodes[next].level == 0) {
+      const I* const index_arr = leaf_indexes(next);
+      for (unsigned int i=0; i<num_entries; i++) {
+	if (index_arr[i] == st_index) {
+	  leaf = next;
+	  slot = i;
+	  return true;
+	}
+      }
+    } else {
+      const NodeId* const child_arr = node_children(next);
+      for (unsigned int i=0; i<num_entries; i++) {
+	if (!only_covering || covers(mbr_arr[i], mbr)) to_visit.push_back(child_arr[i]);
+      }
+    }
+  }
+  return false;
+}
+
+// moves the last entry of the node into slot, the node's mbr is left to be rebuilt
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::remove_entry(NodeId node, unsigned int slot)
+{
+  const unsigned int last = --nodes[node].num_entries;
+  entry_mbrs[node][slot] = entry_mbrs[node][last];
+  if (nodes[node].level == 0) leaf_indexes(node)[slot] = leaf_indexes(node)[last];
+  else node_children(node)[slot] = node_children(node)[last];
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+bool RTree<R,I,P,T>::remove(const R& mbr, const I& st_index)
+{
+  NodeId leaf;
+  unsigned int slot;
+  // merges that are not exact covers (eg. of Partition Covers, whose regions are extrapolated past the ends
+  //  they were merged over) can leave an entry outside the mbr of its parent, so fall back to every branch
+  if (!find_leaf(mbr, st_index, true, leaf, slot) && !find_leaf(mbr, st_index, false, leaf, slot)) return false;
+  remove_entry(leaf, slot);
+  total_num_entries--;
+  condense_tree(leaf);
+  return true;
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+bool RTree<R,I,P,T>::update(const R& old_mbr, const R& new_mbr, const I& st_index)
+{
+  if (!remove(old_mbr, st_index)) return false;
+  insert(new_mbr, st_index);
+  return true;
+}
+
+// walks up from the leaf, removing underfull nodes from their parents and shrinking the mbrs of the rest,
+//  then shortens the tree while the root has a single child and inserts the entries of the removed nodes again
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::condense_tree(NodeId leaf)
+{
+  std::vector<NodeId> eliminated;
+  NodeId node = leaf;
+  while (node != root) {
+    NodeId parent = nodes[node].parent;
+    unsigned int slot = 0;
+    while (node_children(parent)[slot] != node) slot++;
+    if (nodes[node].num_entries < min_entries) {
+      remove_entry(parent, slot);
+      eliminated.push_back(node);
+    } else {
+      nodes[node].mbr = rebuild_mbr(node);
+      entry_mbrs[parent][slot] = nodes[node].mbr;
+    }
+    node = parent;
+  }
+  if (nodes[root].num_entries != 0) nodes[root].mbr = rebuild_mbr(root);
+
+  while (root != NO_NODE && (nodes[root].num_entries == 0 || (nodes[root].level > 0 && nodes[root].num_entries == 1))) {
+    NodeId old_root = root;
+    root = nodes[root].num_entries == 0 ? NO_NODE : node_children(root)[0];
+    if (root != NO_NODE) nodes[root].parent = NO_NODE;
+    release_node(old_root);
+  }
+
+  for (auto it = eliminated.rbegin(); it != eliminated.rend(); it++) {
+    reinsert_entries(*it);
+    release_node(*it);
+  }
+}
+
+// inserts the entries of a node removed from the tree back at the level they came from,
+//  or if the tree is no longer that tall, every sequence under them at the leaves
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::reinsert_entries(NodeId node)
+{
+  const unsigned int level = nodes[node].level;
+  const unsigned int num_entries = nodes[node].num_entries;
+  for (unsigned int i=0; i<num_entries; i++) {
+    const R mbr = entry_mbrs[node][i];
+    if (level == 0) {
+      total_num_entries--; // counted again by insert
+      insert(mbr, leaf_indexes(node)[i]);
+    } else if (root != NO_NODE && nodes[root].level >= level) {
+      std::vector<bool> reinserted(nodes[root].level + 1, true); // no forced reinsertion within a remove
+      insert_at_level(mbr, I(), node_children(node)[i], level, reinserted);
+    } else {
+      NodeId child = node_children(node)[i];
+      reinsert_entries(child);
+      release_node(child);
+    }
+  }
+}
+
+/* *********************************** Bulk loading definitions ************* */
+#include <algorithm>
+
+// Sort-Tile-Recursive from STR: A SIMPLE AND EFFICIENT ALGORITHM FOR R-TREE PACKING
+//  sorts order so that the entries of each slice of the last dimension are consecutive, and returns the end of each node's
+//  run of order. Nodes never straddle two slices, except a slice too small for a node of its own joins the one before it
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<unsigned int> RTree<R,I,P,T>::str_sort(std::vector<unsigned int>& order, const std::vector<std::vector<double>>& centres)
+{
+  std::vector<unsigned int> slice_ends;
+  if (centres.size() == 0 || centres[0].size() == 0) {
+    slice_ends.push_back(order.size());
+  } else {
+    const unsigned int num_dims = centres[0].size();
+
+    // (start, end, dimension) of ranges of order still to be tiled
+    std::vector<std::tuple<unsigned int, unsigned int, unsigned int>> ranges = { {0, order.size(), 0} };
+    while (ranges.size() != 0) {
+      auto [start, end, dim] = ranges.back();
+      ranges.pop_back();
+      std::sort(order.begin()+start, order.begin()+end, [&centres,dim](unsigned int a, unsigned int b){ return centres[a][dim] < centres[b][dim]; });
+      unsigned int num_pages = (end - start + max_entries - 1) / max_entries;
+      unsigned int num_slices = dim+1 == num_dims ? 1 : std::ceil( std::pow( num_pages, 1.0 / (num_dims - dim) ) );
+      if (num_slices <= 1) { // the last dimension, or remaining dimensions cannot split the range any further
+	slice_ends.push_back(end);
+	continue;
+      }
+      unsigned int slice_size = ((num_pages + num_slices - 1) / num_slices) * max_entries;
+      for (unsigned int slice_start = start; slice_start < end; slice_start += slice_size) {
+	ranges.push_back( {slice_start, std::min(slice_start + slice_size, end), dim+1} );
+      }
+    }
+    std::sort(slice_ends.begin(), slice_ends.end());
+  }
+
+  // spread the entries of each slice evenly over its nodes so no node falls below the minimum entries
+  std::vector<unsigned int> node_ends;
+  for (unsigned int s=0, start=0, prev_start=0; s<slice_ends.size(); s++) {
+    unsigned int end = slice_ends[s];
+    if (end - start < min_entries && s > 0) {
+      // too few for a node of its own, so the slice is spread over the nodes of the one before it
+      while (!node_ends.empty() && node_ends.back() > prev_start) node_ends.pop_back();
+      start = prev_start;
+    }
+    unsigned int num_nodes = (end - start + max_entries - 1) / max_entries;
+    for (unsigned int n=0; n<num_nodes; n++) node_ends.push_back( start + (unsigned long) (end - start) * (n+1) / num_nodes );
+    prev_start = start;
+    start = end;
+  }
+  return node_ends;
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+void RTree<R,I,P,T>::bulk_load(const std::vector<R>& mbrs, const std::vector<I>& st_indexes)
+{
+  clear_tree();
+  total_num_entries = std::min(mbrs.size(), st_indexes.size());
+  if (total_num_entries == 0) return;
+
+  std::vector<unsigned int> order(total_num_entries);
+  for (unsigned int i=0; i<order.size(); i++) order[i] = i;
+  std::vector<std::vector<double>> centres;
+  if (traits.has_centre()) {
+    for (unsigned int i=0; i<total_num_entries; i++) centres.push_back( traits.centre(mbrs[i]) );
+  }
+  std::vector<unsigned int> node_ends = str_sort(order, centres);
+
+  // pack leaves
+  std::vector<NodeId> level;
+  for (unsigned int n=0, i=0; n<node_ends.size(); n++) {
+    NodeId leaf = new_node(0);
+    RTreeNode<R>& leaf_node = nodes[leaf];
+    leaf_node.mbr = mbrs[order[i]];
+    for (; i<node_ends[n]; i++) {
+      entry_mbrs[leaf][leaf_node.num_entries] = mbrs[order[i]];
+      leaf_indexes(leaf)[leaf_node.num_entries] = st_indexes[order[i]];
+      leaf_node.num_entries++;
+      leaf_node.mbr = traits.merge( leaf_node.mbr, mbrs[order[i]] );
+    }
+    level.push_back( leaf );
+  }
+
+  // pack each level of nodes into parents until a single root remains
+  for (unsigned int height=1; level.size() > 1; height++) {
+    order.resize(level.size());
+    for (unsigned int i=0; i<order.size(); i++) order[i] = i;
+    centres.clear();
+    if (traits.has_centre()) {
+      for (NodeId n : level) centres.push_back( traits.centre(nodes[n].mbr) );
+    }
+    node_ends = str_sort(order, centres);
+
+    std::vector<NodeId> parents;
+    for (unsigned int n=0, i=0; n<node_ends.size(); n++) {
+      NodeId parent = new_node(height);
+      RTreeNode<R>& parent_node = nodes[parent];
+      parent_node.mbr = nodes[level[order[i]]].mbr;
+      for (; i<node_ends[n]; i++) {
+	NodeId child = level[order[i]];
+	nodes[child].parent = parent;
+	entry_mbrs[parent][parent_node.num_entries] = nodes[child].mbr;
+	node_children(parent)[parent_node.num_entries] = child;
+	parent_node.num_entries++;
+	parent_node.mbr = traits.merge( parent_node.mbr, nodes[child].mbr );
+      }
+      parents.push_back( parent );
+    }
+    level = parents;
+  }
+  root = level[0];
+}
+
 /* *************************** R Tree Search methods ************************* */
 
-template <typename R, typename I>
-std::vector<I> RTree<R,I>::sim_search(const std::vector<double>& q, double epsilon)
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<I> RTree<R,I,P,T>::sim_search(const std::vector<double>& q, double epsilon) const
 {
   epsilon = epsilon * epsilon;
-  if (uncompr_point_dist_sqr_f(q, root->mbr) > epsilon) {
+  if (root == NO_NODE || traits.dist_sqr(q, nodes[root].mbr) > epsilon) {
     return {};
   }
 
-  queue<const RTreeNode<R,I>*> nodes;
-  nodes.push(root);
+  queue<NodeId> to_visit;
+  to_visit.push(root);
   std::vector<I> results;
 
-  while (nodes.size() != 0) {
-    const RTreeNode<R,I>* const next = nodes.front();
-    nodes.pop();
-    if (next->entries.index() == 0) {
-      for (const LeafEntry<R,I>& l : std::get<0>(next->entries)) {
-	if (uncompr_point_dist_sqr_f(q, l.mbr) <= epsilon) {
-	  results.push_back(l.st_index);
+  while (to_visit.size() != 0) {
+    const NodeId next = to_visit.front();
+    to_visit.pop();
+    const R* const mbr_arr = entry_mbrs[next];
+    const unsigned int num_entries = nodes[next].num_entries;
+    if (nodes[next].level == 0) {
+      const I* const index_arr = leaf_indexes(next);
+      for (unsigned int i=0; i<num_entries; i++) {
+	if (traits.dist_sqr(q, mbr_arr[i]) <= epsilon) {
+	  results.push_back(index_arr[i]);
 	}
       }
     } else {
-      for (const RTreeNode<R,I>* const n : std::get<1>(next->entries)) {
-	if (uncompr_point_dist_sqr_f(q, n->mbr) <= epsilon) {
-	  nodes.push(n);
+      const NodeId* const child_arr = node_children(next);
+      for (unsigned int i=0; i<num_entries; i++) {
+	if (traits.dist_sqr(q, mbr_arr[i]) <= epsilon) {
+	  to_visit.push(child_arr[i]);
 	}
       }
     }
@@ -566,153 +1381,646 @@ std::vector<I> RTree<R,I>::sim_search(const std::vector<double>& q, double epsil
   return results;
 }
 
-template <typename R, typename I>
-std::vector<std::array<const double*,2>> RTree<R,I>::knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s)
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const
 {
-  typedef std::variant<const LeafEntry<R,I>*, const RTreeNode<R,I>*> QEntry;
-  auto entry_error = [this,&q](const QEntry& a) {
-    const R& ambr = a.index()==0 ? std::get<0>(a)->mbr : std::get<1>(a)->mbr;
-    return uncompr_point_dist_sqr_f(q,ambr);
-  };
-  auto cmp_qentry = [this,&q,&entry_error](const QEntry& a, const QEntry& b) {
-    return entry_error(a) > entry_error(b);
-  };
-  typedef std::tuple<QEntry, double> QDEntry;
-  auto cmp = [](const QDEntry& a, const QDEntry& b) {
-    return std::get<1>(a) > std::get<1>(b);
-  };
-  using std::vector, std::array;
-  typedef array<const double*,2> Subseq;
-  typedef std::tuple<Subseq,double> SubseqWithE;
-  auto ptr_error = [this,&q](const Subseq& s) { return error_measures::se_between_ptrs(q.data(), q.data()+q.size()-1,s[0],s[1]); };
-  auto leaf_cmp = [](const SubseqWithE& sa, const SubseqWithE& sb) {
-    return std::get<1>(sa) > std::get<1>(sb);
-  };
+  RTreeSearchScratch scratch;
+  return knn_search(q, k, retrieve_f, s, scratch);
+}
 
-  std::priority_queue<QDEntry, std::vector<QDEntry>, decltype(cmp)> pri_q(cmp);
-  std::priority_queue<SubseqWithE, std::vector<SubseqWithE>, decltype(leaf_cmp)> candidates(leaf_cmp);
-  std::vector<array<const double*,2>> results;
-  pri_q.push( { root, entry_error(root) } );
-
-  while (pri_q.size() != 0) {
-    auto [next, next_error] = pri_q.top();
-    pri_q.pop();
-    while (candidates.size()!=0 && std::get<1>(candidates.top()) <= next_error ) {
-      results.push_back( std::get<0>(candidates.top()) );
-      candidates.pop();
-      if (results.size() >= k) {
-	return results;
-      }
-    }
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const
+{
+  NullQueryStats stats;
+  return knn_search(q, k, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const
+{
+  return knn_search_query(q, k, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename TT>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::knn_search(const typename TT::PreparedQuery& pq, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const
+{
+  NullQueryStats stats;
+  return knn_search_query(pq, k, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS, typename TT>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::knn_search(const typename TT::PreparedQuery& pq, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const
+{
+  return knn_search_query(pq, k, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::knn_search_errors(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, std::vector<double>& errors) const
+{
+  NullQueryStats stats;
+  errors.clear();
+  return knn_search_query(q, k, retrieve_f, s, scratch, stats, &errors);
+}
 
-    if (next.index() == 0) { // next is an entry
-      for (auto s : retrieve_f( std::get<0>(next)->st_index, s ) ) {
-	candidates.push({ s, ptr_error(s) });
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS, typename Q>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::knn_search_query(const Q& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats, std::vector<double>* errors) const
+{
+  stats.start_query();
+  std::vector<std::array<const double*,2>> results;
+  std::array<const double*,2> next;
+  double next_error;
+  start_nearest(q, scratch, stats, k);
+  while (results.size() < k && next_nearest(q, retrieve_f, s, scratch, stats, next, next_error)) {
+    results.push_back(next);
+    if (errors != nullptr) errors->push_back(next_error);
+  }
+  stats.end_query();
+  return results;
+}
+
+/* *************************** Distance browsing ***************************** */
+// the search state is two min heaps kept in the scratch arrays, node_heap of entries (node, entry slot or -1 for the node itself)
+//  by the lower bound of their mbr, and candidate_heap of retrieved subsequences by their exact error
+//  when only the k nearest are wanted, candidates worse than the kth least error refined so far are abandoned and never queued
+//  entries of a prepared query are queued by the cheapest bound of the traits (not exact), and tightened once least in the queue,
+//  so the entries are expanded in the same order while most of them, never reaching the front, are only ever cheaply bounded
+typedef std::tuple<NodeId, int, double, bool> RTreeNodeDist;
+typedef std::tuple<std::array<const double*,2>, double> RTreeSubseqDist;
+inline bool rtree_node_dist_greater(const RTreeNodeDist& a, const RTreeNodeDist& b) { return std::get<2>(a) > std::get<2>(b); }
+inline bool rtree_subseq_dist_greater(const RTreeSubseqDist& a, const RTreeSubseqDist& b) { return std::get<1>(a) > std::get<1>(b); }
+inline bool rtree_subseq_dist_less(const RTreeSubseqDist& a, const RTreeSubseqDist& b) { return std::get<1>(a) < std::get<1>(b); }
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS, typename Q>
+void RTree<R,I,P,T>::start_nearest(const Q& q, RTreeSearchScratch& scratch, QS& stats, unsigned int k) const
+{
+  scratch.node_heap.clear();
+  scratch.candidate_heap.clear();
+  scratch.kth_errors.clear();
+  scratch.k = k;
+  if (root == NO_NODE) return;
+  bool exact;
+  double bound = query_dist_sqr(q, nodes[root].mbr, std::numeric_limits<double>::infinity(), exact);
+  scratch.node_heap.push_back( { root, -1, bound, exact } );
+  stats.call_dist(1);
+}
+
+// expands entries from the node heap until no unexpanded entry can hold anything closer than the best candidate
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS, typename Q>
+bool RTree<R,I,P,T>::next_nearest(const Q& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats, std::array<const double*,2>& result, double& error) const
+{
+  std::vector<RTreeNodeDist>& pri_q = scratch.node_heap;
+  std::vector<RTreeSubseqDist>& candidates = scratch.candidate_heap;
+  auto pri_q_push = [&pri_q](const RTreeNodeDist& e) { pri_q.push_back(e); std::push_heap(pri_q.begin(), pri_q.end(), rtree_node_dist_greater); };
+  auto candidates_push = [&candidates](const RTreeSubseqDist& e) { candidates.push_back(e); std::push_heap(candidates.begin(), candidates.end(), rtree_subseq_dist_greater); };
+  std::vector<double>& kth_errors = scratch.kth_errors;
+
+  while (pri_q.size() != 0 && (candidates.size() == 0 || std::get<1>(candidates.front()) > std::get<2>(pri_q.front()))) {
+    if (scratch.shared_bound != nullptr && std::get<2>(pri_q.front()) > scratch.shared_bound->get()) {
+      pri_q.clear(); // k closer subsequences are known elsewhere than anything left in this tree
+      break;
+    }
+    std::pop_heap(pri_q.begin(), pri_q.end(), rtree_node_dist_greater);
+    auto [next, slot, next_error, next_exact] = pri_q.back();
+    pri_q.pop_back();
+    // entries bounded beyond the kth least error are never expanded before the k nearest are found, so are not queued
+    double prune = scratch.k != 0 && kth_errors.size() == scratch.k ? kth_errors.front() : std::numeric_limits<double>::infinity();
+    if (scratch.shared_bound != nullptr) prune = std::min( prune, scratch.shared_bound->get() );
+
+    if (!next_exact) { // tighten the bound of the least entry, queueing it again
+      bool exact;
+      double bound = query_dist_sqr(q, slot >= 0 ? entry_mbrs[next][slot] : nodes[next].mbr, prune, exact);
+      stats.call_dist(1);
+      if (exact) pri_q_push({ next, slot, bound, true });
+    } else if (slot >= 0) { // next is an entry
+      if (RTreeLeafBound<I>::enabled && RTreeLeafBound<I>::dist_sqr(q, leaf_indexes(next)[slot]) > prune) {
+	stats.skip_entry();
+	continue;
+      }
+      stats.retrieve_entry();
+      for (auto s : retrieve_f( leaf_indexes(next)[slot], s ) ) {
+	stats.refine_candidate();
+	const bool bounded = scratch.k != 0 && kth_errors.size() == scratch.k;
+	double threshold = bounded ? kth_errors.front() : std::numeric_limits<double>::infinity();
+	if (scratch.shared_bound != nullptr) threshold = std::min( threshold, scratch.shared_bound->get() );
+	double s_error = rtree_refine_error(rtree_query_series(q), s, threshold, scratch);
+	if (s_error > threshold) continue; // k closer subsequences are already known
+	candidates_push({ s, s_error });
+	if (scratch.shared_bound != nullptr) scratch.shared_bound->offer(s_error);
+	if (scratch.k != 0) {
+	  kth_errors.push_back(s_error);
+	  std::push_heap(kth_errors.begin(), kth_errors.end());
+	  if (kth_errors.size() > scratch.k) {
+	    std::pop_heap(kth_errors.begin(), kth_errors.end());
+	    kth_errors.pop_back();
+	  }
+	}
       }
     } else {
-      const RTreeNode<R,I>* node = std::get<1>(next);
-      if (node->entries.index() == 0) { // next is a leaf node
-	for ( const LeafEntry<R,I>& l : std::get<0>(node->entries) ){
-	  pri_q.push({ &l, entry_error(&l) } ); // potential optimisation if you can retrieve the original DRT and use dist_LB
+      const R* const mbr_arr = entry_mbrs[next];
+      const unsigned int num_entries = nodes[next].num_entries;
+      bool exact;
+      stats.visit_node(nodes[next].level);
+      stats.call_dist(num_entries);
+      if (nodes[next].level == 0) { // next is a leaf node
+	stats.check_entries(num_entries);
+	for (unsigned int i=0; i<num_entries; i++) {
+	  double bound = query_dist_sqr(q, mbr_arr[i], 0.0, exact);
+	  if (bound <= prune) pri_q_push({ next, (int) i, bound, exact });
 	}
       } else {
-	for ( const RTreeNode<R,I>* e : std::get<1>(node->entries) ){
-	  pri_q.push( { e, entry_error(e) } );
+	const NodeId* const child_arr = node_children(next);
+	for (unsigned int i=0; i<num_entries; i++) {
+	  double bound = query_dist_sqr(q, mbr_arr[i], 0.0, exact);
+	  if (bound <= prune) pri_q_push({ child_arr[i], -1, bound, exact });
 	}
       }
+      stats.queue_size(pri_q.size());
     }
   }
-  return results;
+
+  if (candidates.size() == 0) return false;
+  std::tie(result, error) = candidates.front();
+  std::pop_heap(candidates.begin(), candidates.end(), rtree_subseq_dist_greater);
+  candidates.pop_back();
+  return true;
+}
+
+/**
+ * @brief NearestIterator yields the subsequences indexed by a r tree in increasing distance to a query, see RTree::nearest
+ */
+template <typename R, typename I, SplitPolicy P, typename T>
+class RTree<R,I,P,T>::NearestIterator {
+private:
+  const RTree<R,I,P,T>* tree;
+  std::vector<double> q;
+  FPtrRetrievalMethod<I> retrieve_f;
+  const std::vector<double>* s;
+  RTreeSearchScratch scratch;
+  unsigned int num_yielded;
+
+public:
+  NearestIterator(const RTree<R,I,P,T>& tree, const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s)
+    : tree(&tree), q(q), retrieve_f(retrieve_f), s(&s), num_yielded(0)
+  {
+    NullQueryStats stats;
+    tree.start_nearest(this->q, scratch, stats);
+  }
+
+  /**
+   * @brief next finds the next closest subsequence
+   * @param result is set to the pointers to the subsequence in s
+   * @param error is set to the squared l2 error between the query and the subsequence
+   * @return false once every subsequence has been yielded
+   */
+  bool next(std::array<const double*, 2>& result, double& error)
+  {
+    NullQueryStats stats;
+    if (!tree->next_nearest(q, retrieve_f, *s, scratch, stats, result, error)) return false;
+    num_yielded++;
+    return true;
+  }
+  /**
+   * @brief next_page finds the next n closest subsequences
+   * @param n is the size of the page
+   * @return array of pointers to the subsequences in s, shorter than n once the subsequences run out
+   */
+  std::vector<std::array<const double*, 2>> next_page(unsigned int n)
+  {
+    std::vector<std::array<const double*, 2>> page;
+    std::array<const double*, 2> result;
+    double error;
+    while (page.size() < n && next(result, error)) {
+      page.push_back(result);
+    }
+    return page;
+  }
+  /**
+   * @brief get_num_yielded returns the number of subsequences yielded so far
+   */
+  inline unsigned int get_num_yielded() const { return num_yielded; }
+};
+
+template <typename R, typename I, SplitPolicy P, typename T>
+typename RTree<R,I,P,T>::NearestIterator RTree<R,I,P,T>::nearest(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const
+{
+  return NearestIterator(*this, q, retrieve_f, s);
 }
 
-template <typename R, typename I>
-std::vector<std::array<const double*,2>> RTree<R,I>::sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s)
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const
 {
+  RTreeSearchScratch scratch;
+  return sim_search_exact(q, epsilon, retrieve_f, s, scratch);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const
+{
+  NullQueryStats stats;
+  return sim_search_exact(q, epsilon, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const
+{
+  return sim_search_exact_query(q, epsilon, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename TT>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::sim_search_exact(const typename TT::PreparedQuery& pq, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const
+{
+  NullQueryStats stats;
+  return sim_search_exact_query(pq, epsilon, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS, typename TT>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::sim_search_exact(const typename TT::PreparedQuery& pq, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const
+{
+  return sim_search_exact_query(pq, epsilon, retrieve_f, s, scratch, stats);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+template <typename QS, typename Q>
+std::vector<std::array<const double*,2>> RTree<R,I,P,T>::sim_search_exact_query(const Q& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch, QS& stats) const
+{
+  stats.start_query();
   epsilon = epsilon * epsilon;
-  if (uncompr_point_dist_sqr_f(q, root->mbr) > epsilon) {
+  if (root != NO_NODE) stats.call_dist(1);
+  bool exact;
+  if (root == NO_NODE || query_dist_sqr(q, nodes[root].mbr, epsilon, exact) > epsilon) {
+    stats.end_query();
     return {};
   }
 
-  queue<const RTreeNode<R,I>*> nodes;
-  nodes.push(root);
+  // breadth first queue, nodes before front have been visited
+  std::vector<NodeId>& to_visit = scratch.to_visit;
+  to_visit.clear();
+  to_visit.push_back(root);
   std::vector<std::array<const double*, 2>> results;
 
-  while (nodes.size() != 0) {
-    const RTreeNode<R,I>* const next = nodes.front();
-    nodes.pop();
-    if (next->entries.index() == 0) {
-      for (const LeafEntry<R,I>& l : std::get<0>(next->entries)) {
-	if (uncompr_point_dist_sqr_f(q, l.mbr) <= epsilon) {
-	  for (const auto& [s_ptr,e_ptr] : retrieve_f(l.st_index,s)) {
-	    if (error_measures::se_between_ptrs(q.data(), q.data()+q.size()-1, s_ptr, e_ptr) <= epsilon)
+  for (unsigned int front=0; front < to_visit.size(); front++) {
+    const NodeId next = to_visit[front];
+    const R* const mbr_arr = entry_mbrs[next];
+    const unsigned int num_entries = nodes[next].num_entries;
+    stats.visit_node(nodes[next].level);
+    stats.call_dist(num_entries);
+    stats.queue_size(to_visit.size() - front);
+    if (nodes[next].level == 0) {
+      const I* const index_arr = leaf_indexes(next);
+      stats.check_entries(num_entries);
+      for (unsigned int i=0; i<num_entries; i++) {
+	if (query_dist_sqr(q, mbr_arr[i], epsilon, exact) <= epsilon) {
+	  if (RTreeLeafBound<I>::enabled && RTreeLeafBound<I>::dist_sqr(q, index_arr[i]) > epsilon) {
+	    stats.skip_entry();
+	    continue;
+	  }
+	  stats.retrieve_entry();
+	  for (const auto& [s_ptr,e_ptr] : retrieve_f(index_arr[i],s)) {
+	    stats.refine_candidate();
+	    if (rtree_refine_error(rtree_query_series(q), {s_ptr,e_ptr}, epsilon, scratch) <= epsilon)
 	      results.push_back({s_ptr,e_ptr});
 	  }
 	}
       }
     } else {
-      for (const RTreeNode<R,I>* const n : std::get<1>(next->entries)) {
-	if (uncompr_point_dist_sqr_f(q, n->mbr) <= epsilon) {
-	  nodes.push(n);
+      const NodeId* const child_arr = node_children(next);
+      for (unsigned int i=0; i<num_entries; i++) {
+	if (query_dist_sqr(q, mbr_arr[i], epsilon, exact) <= epsilon) {
+	  to_visit.push_back(child_arr[i]);
 	}
       }
     }
   }
+  stats.end_query();
   return results;
 }
-template <typename R, typename I>
-double RTree<R,I>::pruning_power(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s)
+
+template <typename R, typename I, SplitPolicy P, typename T>
+double RTree<R,I,P,T>::pruning_power(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s) const
 {
-  typedef std::variant<const LeafEntry<R,I>*, const RTreeNode<R,I>*> QEntry;
-  typedef std::tuple<QEntry,double> QDEntry;
-  auto entry_error = [this,&q](const QEntry& a) {
-    const R& ambr = a.index()==0 ? std::get<0>(a)->mbr : std::get<1>(a)->mbr;
-    return uncompr_point_dist_sqr_f(q,ambr);
-  };
-  auto cmp = [](const QDEntry& a, const QDEntry& b) {
-    return std::get<1>(a) > std::get<1>(b);
-  };
-  using std::vector, std::array;
-  auto ptr_error = [this,&q](const array<const double*,2>& s) { return error_measures::se_between_ptrs(q.data(), q.data()+q.size()-1,s[0],s[1]); };
-  auto leaf_cmp = [this,&q,&ptr_error](const array<const double*,2>& sa, const array<const double*,2>& sb) {
-    return ptr_error(sa) > ptr_error(sb);
-  };
+  RTreeSearchScratch scratch;
+  return pruning_power(q, retrieve_f, s, scratch);
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+double RTree<R,I,P,T>::pruning_power(const std::vector<double>& q, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, RTreeSearchScratch& scratch) const
+{
+  if (root == NO_NODE) return 1.0;
+  QueryStats stats;
+  knn_search(q, 1, retrieve_f, s, scratch, stats);
+  return stats.entries_retrieved / (double) total_num_entries;
+}
 
-  std::priority_queue<QDEntry, std::vector<QDEntry>, decltype(cmp)> pri_q(cmp);
-  pri_q.push( { root, entry_error(root) } );
+/* *************************** Approximate knn ******************************* */
+#include <chrono>
+#include <cmath>
 
-  array<const double*,2> min_index;
-  double min_actual_error = 100000000000000000;
-  double objects_scanned = 0.0;
+template <typename R, typename I, SplitPolicy P, typename T>
+ApproxKnnResult RTree<R,I,P,T>::knn_search_approx(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, const ApproxKnnLimits& limits) const
+{
+  RTreeSearchScratch scratch;
+  return knn_search_approx(q, k, retrieve_f, s, limits, scratch);
+}
 
-  while (pri_q.size() != 0) {
-    auto [next,next_error] = pri_q.top();
-    pri_q.pop();
-    if (min_actual_error < next_error) {
-      return objects_scanned / (double) total_num_entries;
+// best first search keeping the k least errors refined in candidate_heap (as a max heap), stopping when the kth is
+//  below every unexpanded bound (exact), within (1+epsilon)^2 of the least of them, or at the refinement or time limits
+template <typename R, typename I, SplitPolicy P, typename T>
+ApproxKnnResult RTree<R,I,P,T>::knn_search_approx(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, const ApproxKnnLimits& limits, RTreeSearchScratch& scratch) const
+{
+  NullQueryStats stats;
+  start_nearest(q, scratch, stats, k);
+  std::vector<RTreeNodeDist>& pri_q = scratch.node_heap;
+  std::vector<RTreeSubseqDist>& best = scratch.candidate_heap;
+  auto pri_q_push = [&pri_q](const RTreeNodeDist& e) { pri_q.push_back(e); std::push_heap(pri_q.begin(), pri_q.end(), rtree_node_dist_greater); };
+  auto best_push = [&best,k](const RTreeSubseqDist& e) {
+    best.push_back(e);
+    std::push_heap(best.begin(), best.end(), rtree_subseq_dist_less);
+    if (best.size() > k) {
+      std::pop_heap(best.begin(), best.end(), rtree_subseq_dist_less);
+      best.pop_back();
     }
+  };
 
-    if (next.index() == 0) { // next is an entry
-      objects_scanned+=1.0;
-      for (auto s : retrieve_f( std::get<0>(next)->st_index, s ) ) {
-	if (ptr_error(s) < min_actual_error) {
-	  min_actual_error = ptr_error(s);
-	  min_index = s;
-	}
+  const double ratio_sqr = (1.0 + limits.epsilon) * (1.0 + limits.epsilon);
+  const auto start = std::chrono::steady_clock::now();
+  unsigned int refinements = 0;
+  while (pri_q.size() != 0 && k != 0) {
+    const double next_bound = std::get<2>(pri_q.front());
+    if (best.size() == k && std::get<1>(best.front()) <= next_bound * ratio_sqr) break;
+    if (limits.max_refinements != 0 && refinements >= limits.max_refinements) break;
+    if (limits.time_budget_ms > 0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= limits.time_budget_ms) break;
+
+    std::pop_heap(pri_q.begin(), pri_q.end(), rtree_node_dist_greater);
+    auto [next, slot, next_error, next_exact] = pri_q.back();
+    pri_q.pop_back();
+
+    if (slot >= 0) { // next is an entry
+      refinements++;
+      for (auto s : retrieve_f( leaf_indexes(next)[slot], s ) ) {
+	double threshold = best.size() == k ? std::get<1>(best.front()) : std::numeric_limits<double>::infinity();
+	double s_error = rtree_refine_error(q, s, threshold, scratch);
+	if (s_error <= threshold) best_push({ s, s_error });
       }
     } else {
-      const RTreeNode<R,I>* node = std::get<1>(next);
-      if (node->entries.index() == 0) { // next is a leaf node
-	for ( const LeafEntry<R,I>& l : std::get<0>(node->entries) ){
-	  pri_q.push({ &l, entry_error(&l) }); // potential optimisation if you can retrieve the original DRT and use dist_LB
+      const R* const mbr_arr = entry_mbrs[next];
+      const unsigned int num_entries = nodes[next].num_entries;
+      if (nodes[next].level == 0) { // next is a leaf node
+	for (unsigned int i=0; i<num_entries; i++) {
+	  pri_q_push({ next, (int) i, traits.dist_sqr(q, mbr_arr[i]), true });
 	}
       } else {
-	for ( const RTreeNode<R,I>* e : std::get<1>(node->entries) ){
-	  pri_q.push({e,entry_error(e)});
+	const NodeId* const child_arr = node_children(next);
+	for (unsigned int i=0; i<num_entries; i++) {
+	  pri_q_push({ child_arr[i], -1, traits.dist_sqr(q, mbr_arr[i]), true });
 	}
       }
     }
   }
-  return 1.0;
+
+  ApproxKnnResult result;
+  std::sort_heap(best.begin(), best.end(), rtree_subseq_dist_less);
+  for (const auto& [subseq, error] : best) result.results.push_back(subseq);
+
+  // the true kth nearest is either among those refined, or no closer than the least bound left unexpanded
+  const double least_bound = pri_q.size() == 0 ? std::numeric_limits<double>::infinity() : std::get<2>(pri_q.front());
+  // entries can retrieve any number of subsequences, so fewer than k are only all there are once every entry is refined
+  result.exhausted = pri_q.size() == 0;
+  const bool found_k = best.size() == k;
+  const double kth_error = best.size() == 0 ? 0.0 : std::get<1>(best.back());
+  result.exact = (found_k || result.exhausted) && kth_error <= least_bound;
+  if (result.exact) {
+    result.distance_ratio = 1.0;
+  } else if (!found_k || least_bound <= 0.0) {
+    result.distance_ratio = std::numeric_limits<double>::infinity();
+  } else {
+    result.distance_ratio = std::sqrt( kth_error / least_bound );
+  }
+  return result;
+}
+
+/* *************************** Batch search methods ************************** */
+
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::vector<std::array<const double*,2>>> RTree<R,I,P,T>::knn_search_batch(const std::vector<std::vector<double>>& qs, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads) const
+{
+  num_threads = parallel::num_threads_or_default(num_threads);
+  std::vector<std::vector<std::array<const double*,2>>> results(qs.size());
+  std::vector<RTreeSearchScratch> scratches(num_threads);
+  parallel::parallel_for(qs.size(), num_threads, [&](unsigned int i, unsigned int thread_i) {
+    results[i] = knn_search(qs[i], k, retrieve_f, s, scratches[thread_i]);
+  });
+  return results;
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::vector<std::array<const double*,2>>> RTree<R,I,P,T>::knn_search_batch(const std::vector<std::vector<double>>& qs, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, std::vector<QueryStats>& stats, unsigned int num_threads) const
+{
+  num_threads = parallel::num_threads_or_default(num_threads);
+  std::vector<std::vector<std::array<const double*,2>>> results(qs.size());
+  std::vector<RTreeSearchScratch> scratches(num_threads);
+  stats.assign(qs.size(), QueryStats());
+  parallel::parallel_for(qs.size(), num_threads, [&](unsigned int i, unsigned int thread_i) {
+    results[i] = knn_search(qs[i], k, retrieve_f, s, scratches[thread_i], stats[i]);
+  });
+  return results;
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::vector<std::array<const double*,2>>> RTree<R,I,P,T>::sim_search_exact_batch(const std::vector<std::vector<double>>& qs, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads) const
+{
+  num_threads = parallel::num_threads_or_default(num_threads);
+  std::vector<std::vector<std::array<const double*,2>>> results(qs.size());
+  std::vector<RTreeSearchScratch> scratches(num_threads);
+  parallel::parallel_for(qs.size(), num_threads, [&](unsigned int i, unsigned int thread_i) {
+    results[i] = sim_search_exact(qs[i], epsilon, retrieve_f, s, scratches[thread_i]);
+  });
+  return results;
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<std::vector<std::array<const double*,2>>> RTree<R,I,P,T>::sim_search_exact_batch(const std::vector<std::vector<double>>& qs, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, std::vector<QueryStats>& stats, unsigned int num_threads) const
+{
+  num_threads = parallel::num_threads_or_default(num_threads);
+  std::vector<std::vector<std::array<const double*,2>>> results(qs.size());
+  std::vector<RTreeSearchScratch> scratches(num_threads);
+  stats.assign(qs.size(), QueryStats());
+  parallel::parallel_for(qs.size(), num_threads, [&](unsigned int i, unsigned int thread_i) {
+    results[i] = sim_search_exact(qs[i], epsilon, retrieve_f, s, scratches[thread_i], stats[i]);
+  });
+  return results;
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+std::vector<double> RTree<R,I,P,T>::pruning_power_batch(const std::vector<std::vector<double>>& qs, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads) const
+{
+  num_threads = parallel::num_threads_or_default(num_threads);
+  std::vector<double> results(qs.size());
+  std::vector<RTreeSearchScratch> scratches(num_threads);
+  parallel::parallel_for(qs.size(), num_threads, [&](unsigned int i, unsigned int thread_i) {
+    results[i] = pruning_power(qs[i], retrieve_f, s, scratches[thread_i]);
+  });
+  return results;
+}
+
+/* *************************** Persistence definitions ************************ */
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief RTreeFileHeader begins a saved r tree, it is followed by the released ids of the node, index and child pools,
+ * then the slabs of each pool in turn
+ * Each of these sections (and each slab) starts on a multiple of RTREE_FILE_ALIGN bytes so mapped slabs are aligned for their types.
+ */
+struct RTreeFileHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int mbr_bytes;
+  unsigned int index_bytes;
+  unsigned int node_bytes;
+  unsigned int max_entries;
+  unsigned int min_entries;
+  NodeId root;
+  unsigned int total_num_entries;
+  NodeId num_allocated;
+  unsigned int num_released;
+  NodeId num_index_allocated;
+  unsigned int num_index_released;
+  NodeId num_child_allocated;
+  unsigned int num_child_released;
+  unsigned long node_slab_bytes;
+  unsigned long mbr_slab_bytes;
+  unsigned long index_slab_bytes;
+  unsigned long child_slab_bytes;
+  unsigned int num_node_slabs;
+  unsigned int num_mbr_slabs;
+  unsigned int num_index_slabs;
+  unsigned int num_child_slabs;
+};
+const char RTREE_FILE_MAGIC[8] = "APLARTR";
+const unsigned int RTREE_FILE_VERSION = 2;
+const unsigned long RTREE_FILE_ALIGN = 64;
+
+template <typename R, typename I, SplitPolicy P, typename T>
+bool RTree<R,I,P,T>::save(const std::string& path) const
+{
+  static_assert(std::is_trivially_copyable<R>::value && std::is_trivially_copyable<I>::value, "only trees of trivially copyable MBRs and indexes can be saved");
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if (!ofs) return false;
+
+  RTreeFileHeader header = {};
+  std::memcpy(header.magic, RTREE_FILE_MAGIC, sizeof(header.magic));
+  header.version = RTREE_FILE_VERSION;
+  header.mbr_bytes = sizeof(R);
+  header.index_bytes = sizeof(I);
+  header.node_bytes = sizeof(RTreeNode<R>);
+  header.max_entries = max_entries;
+  header.min_entries = min_entries;
+  header.root = root;
+  header.total_num_entries = total_num_entries;
+  header.num_allocated = nodes.num_allocated();
+  header.num_released = nodes.released().size();
+  header.num_index_allocated = entry_indexes.num_allocated();
+  header.num_index_released = entry_indexes.released().size();
+  header.num_child_allocated = entry_children.num_allocated();
+  header.num_child_released = entry_children.released().size();
+  header.node_slab_bytes = nodes.slab_size_bytes();
+  header.mbr_slab_bytes = entry_mbrs.slab_size_bytes();
+  header.index_slab_bytes = entry_indexes.slab_size_bytes();
+  header.child_slab_bytes = entry_children.slab_size_bytes();
+  header.num_node_slabs = nodes.num_slabs();
+  header.num_mbr_slabs = entry_mbrs.num_slabs();
+  header.num_index_slabs = entry_indexes.num_slabs();
+  header.num_child_slabs = entry_children.num_slabs();
+
+  unsigned long offset = 0;
+  auto write_section = [&ofs,&offset](const void* data, unsigned long bytes) {
+    static const char padding[RTREE_FILE_ALIGN] = {};
+    unsigned long pad = (RTREE_FILE_ALIGN - offset % RTREE_FILE_ALIGN) % RTREE_FILE_ALIGN;
+    ofs.write(padding, pad);
+    ofs.write((const char*) data, bytes);
+    offset += pad + bytes;
+  };
+  write_section(&header, sizeof(header));
+  write_section(nodes.released().data(), nodes.released().size() * sizeof(NodeId));
+  write_section(entry_indexes.released().data(), entry_indexes.released().size() * sizeof(NodeId));
+  write_section(entry_children.released().data(), entry_children.released().size() * sizeof(NodeId));
+  for (unsigned int i=0; i<nodes.num_slabs(); i++) write_section(nodes.slab(i), nodes.slab_size_bytes());
+  for (unsigned int i=0; i<entry_mbrs.num_slabs(); i++) write_section(entry_mbrs.slab(i), entry_mbrs.slab_size_bytes());
+  for (unsigned int i=0; i<entry_indexes.num_slabs(); i++) write_section(entry_indexes.slab(i), entry_indexes.slab_size_bytes());
+  for (unsigned int i=0; i<entry_children.num_slabs(); i++) write_section(entry_children.slab(i), entry_children.slab_size_bytes());
+  return (bool) ofs;
+}
+
+template <typename R, typename I, SplitPolicy P, typename T>
+bool RTree<R,I,P,T>::open_mapped(const std::string& path)
+{
+  static_assert(std::is_trivially_copyable<R>::value && std::is_trivially_copyable<I>::value, "only trees of trivially copyable MBRs and indexes can be opened");
+  MappedFile file;
+  if (!file.map(path) || file.size() < sizeof(RTreeFileHeader)) return false;
+
+  RTreeFileHeader header;
+  std::memcpy(&header, file.get(), sizeof(header));
+  if (std::memcmp(header.magic, RTREE_FILE_MAGIC, sizeof(header.magic)) != 0
+      || header.version != RTREE_FILE_VERSION
+      || header.mbr_bytes != sizeof(R)
+      || header.index_bytes != sizeof(I)
+      || header.node_bytes != sizeof(RTreeNode<R>)
+      || header.max_entries != max_entries
+      || header.min_entries != min_entries
+      || header.node_slab_bytes != nodes.slab_size_bytes()
+      || header.mbr_slab_bytes != entry_mbrs.slab_size_bytes()
+      || header.index_slab_bytes != entry_indexes.slab_size_bytes()
+      || header.child_slab_bytes != entry_children.slab_size_bytes()) {
+    return false;
+  }
+
+  // walk the sections as save wrote them
+  unsigned long offset = sizeof(header);
+  bool in_bounds = true;
+  auto next_section = [&file,&offset,&in_bounds](unsigned long bytes) {
+    offset = (offset + RTREE_FILE_ALIGN - 1) / RTREE_FILE_ALIGN * RTREE_FILE_ALIGN;
+    if (offset + bytes > file.size()) in_bounds = false;
+    char* section = file.get() + offset;
+    offset += bytes;
+    return section;
+  };
+  std::vector<NodeId> released(header.num_released), index_released(header.num_index_released), child_released(header.num_child_released);
+  char* released_section = next_section(header.num_released * sizeof(NodeId));
+  char* index_released_section = next_section(header.num_index_released * sizeof(NodeId));
+  char* child_released_section = next_section(header.num_child_released * sizeof(NodeId));
+  std::vector<RTreeNode<R>*> node_slabs;
+  std::vector<R*> mbr_slabs;
+  std::vector<I*> index_slabs;
+  std::vector<NodeId*> child_slabs;
+  for (unsigned int i=0; i<header.num_node_slabs; i++) node_slabs.push_back( (RTreeNode<R>*) next_section(header.node_slab_bytes) );
+  for (unsigned int i=0; i<header.num_mbr_slabs; i++) mbr_slabs.push_back( (R*) next_section(header.mbr_slab_bytes) );
+  for (unsigned int i=0; i<header.num_index_slabs; i++) index_slabs.push_back( (I*) next_section(header.index_slab_bytes) );
+  for (unsigned int i=0; i<header.num_child_slabs; i++) child_slabs.push_back( (NodeId*) next_section(header.child_slab_bytes) );
+  if (!in_bounds) return false;
+  if (header.num_released != 0) std::memcpy(released.data(), released_section, header.num_released * sizeof(NodeId));
+  if (header.num_index_released != 0) std::memcpy(index_released.data(), index_released_section, header.num_index_released * sizeof(NodeId));
+  if (header.num_child_released != 0) std::memcpy(child_released.data(), child_released_section, header.num_child_released * sizeof(NodeId));
+
+  clear_tree();
+  nodes.view(node_slabs, header.num_allocated, released);
+  entry_mbrs.view(mbr_slabs);
+  entry_indexes.view(index_slabs, header.num_index_allocated, index_released);
+  entry_children.view(child_slabs, header.num_child_allocated, child_released);
+  root = header.root;
+  total_num_entries = header.total_num_entries;
+  mapped = std::move(file);
+  return true;
 }
 
 #endif
@@ -1,54 +1,185 @@
 #include "sequential_scan.h"
+#include "error_measures.h"
+#include "distance_kernels.h"
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
 
 using std::vector;
 
+// the FFT distance profile costs O(n log n) whatever the query size, against O(n m) for the naive scan. Over random walks
+// of 20k, 200k and 1M points (with the vector distance kernels) similarity search by MASS was quicker from queries of
+// about 60 log n points. The naive knn scan abandons most distances early, and more of them the more subsequences there are
+// to beat, so MASS was only quicker from about 1500, 6000 and 12000 points, which 12 sqrt(n) follows
+const unsigned int MASS_QUERY_PER_LOG_SIZE = 60;
+const unsigned int MASS_KNN_QUERY_PER_SQRT_SIZE = 12;
+
 
 double seq_scan::l2_sqr(const double* const s1start, const double* const s2start, unsigned int len)
 {
-  double se = 0;
-  for (int i=0; i < len; ++i) {
-    se += ( *(s1start+i) - *(s2start+i) ) * ( *(s1start+i) - *(s2start+i) );
+  return distance_kernels::l2_sqr(s1start, s2start, len);
+}
+
+namespace {
+  // the number of blocks the offsets of a scan are split into, enough per thread for the threads to balance out
+  unsigned int scan_blocks(unsigned int num_subseqs, unsigned int num_threads)
+  {
+    num_threads = parallel::num_threads_or_default(num_threads);
+    if (num_threads == 1) return 1;
+    return std::max( 1u, std::min( num_subseqs, 4 * num_threads ) );
+  }
+  unsigned int block_start(unsigned int b, unsigned int num_blocks, unsigned int num_subseqs)
+  {
+    return (unsigned long) b * num_subseqs / num_blocks;
+  }
+
+  /**
+   * @brief batch_scan answers each query of a batch by MASS or by a naive scan, as prefer_mass picks
+   * The queries taken by MASS share one spectrum of the series, and are answered by by_mass(ps, q). The rest are split
+   * across the threads and answered by by_scan(q). Queries no smaller than the series are left to the caller.
+   */
+  template <typename M, typename F>
+  void batch_scan(const vector<double>& series, const vector<vector<double>>& queries, bool knn, unsigned int num_threads, M by_mass, F by_scan)
+  {
+    vector<unsigned int> mass_queries, scanned_queries;
+    for (unsigned int q=0; q<queries.size(); q++) {
+      if (series.size() <= queries[q].size()) continue;
+      if (seq_scan::prefer_mass(series.size(), queries[q].size(), knn)) mass_queries.push_back(q);
+      else scanned_queries.push_back(q);
+    }
+
+    if (!mass_queries.empty()) {
+      const mass::PreparedSeries ps = mass::prepare(series);
+      parallel::parallel_for(mass_queries.size(), num_threads, [&](unsigned int i, unsigned int) { by_mass(ps, mass_queries[i]); });
+    }
+    parallel::parallel_for(scanned_queries.size(), num_threads, [&](unsigned int i, unsigned int) { by_scan(scanned_queries[i]); });
   }
-  return se;
 }
 
-vector<unsigned int> seq_scan::find_similar_subseq_indexes(const vector<double>& series, const vector<double>& query, double epsilon)
+bool seq_scan::prefer_mass(unsigned int series_size, unsigned int query_size, bool knn)
+{
+  if (knn) return query_size >= MASS_KNN_QUERY_PER_SQRT_SIZE * std::sqrt(series_size);
+  return query_size >= MASS_QUERY_PER_LOG_SIZE * std::log2( std::max(series_size, 2u) );
+}
+
+vector<unsigned int> seq_scan::find_similar_subseq_indexes(const vector<double>& series, const vector<double>& query, double epsilon, ScanMethod method, unsigned int num_threads)
+{
+  if (series.size() <= query.size()) return {0};
+  if (epsilon < 0) return {};
+  if (method == MASS || (method == AUTO && prefer_mass(series.size(), query.size(), false)))
+    return find_similar_subseq_indexes(mass::prepare(series), query, epsilon);
+
+  // the offsets are split into blocks scanned concurrently, whose results are joined in order
+  const unsigned int num_subseqs = series.size() - query.size() + 1;
+  const unsigned int num_blocks = scan_blocks(num_subseqs, num_threads);
+  vector<vector<unsigned int>> block_subseqs(num_blocks);
+  parallel::parallel_for(num_blocks, num_threads, [&](unsigned int b, unsigned int) {
+    for (unsigned int i = block_start(b, num_blocks, num_subseqs); i < block_start(b+1, num_blocks, num_subseqs); ++i) {
+      if ( epsilon * epsilon >= l2_sqr(series.data() + i, query.data(), query.size()) ) {
+	block_subseqs[b].emplace_back(i);
+      }
+    }
+  });
+  vector<unsigned int> similar_subseqs;
+  for (const vector<unsigned int>& subseqs : block_subseqs) similar_subseqs.insert(similar_subseqs.end(), subseqs.begin(), subseqs.end());
+  return similar_subseqs;
+}
+
+vector<unsigned int> seq_scan::find_similar_subseq_indexes(const mass::PreparedSeries& ps, const vector<double>& query, double epsilon)
 {
+  const vector<double>& series = ps.series;
   if (series.size() <= query.size()) return {0};
   if (epsilon < 0) return {};
 
+  // the profile is only good to within its tolerance, so the subsequences it puts near epsilon are checked directly
+  vector<double> profile = mass::distance_profile_sqr(ps, query);
+  const double cutoff = epsilon * epsilon + mass::tolerance(ps, query);
   vector<unsigned int> similar_subseqs;
-  for (int i=0; i < series.size() - query.size() + 1; ++i) {
-    if ( epsilon * epsilon >= l2_sqr(series.data() + i, query.data(), query.size()) ) {
+  for (unsigned int i=0; i < profile.size(); ++i) {
+    if ( profile[i] <= cutoff && epsilon * epsilon >= l2_sqr(series.data() + i, query.data(), query.size()) ) {
       similar_subseqs.emplace_back(i);
     }
   }
   return similar_subseqs;
 }
 
-#include <queue>
-#include <tuple>
-using std::priority_queue, std::tuple;
+vector<unsigned int> seq_scan::find_k_closest_indexes(const std::vector<double> &series, const std::vector<double> &query, unsigned int k, ScanMethod method, unsigned int num_threads)
+{
+  if (series.size() <= query.size()) return {0};
+  if (method == MASS || (method == AUTO && prefer_mass(series.size(), query.size(), true)))
+    return find_k_closest_indexes(mass::prepare(series), query, k);
+
+  // each block keeps its own k closest, abandoning against its own k-th best. Offering the blocks' to the result in order
+  // of offset settles ties as a single pass would
+  const unsigned int num_subseqs = series.size() - query.size() + 1;
+  const unsigned int num_blocks = scan_blocks(num_subseqs, num_threads);
+  vector<vector<std::tuple<double, unsigned int>>> block_closest(num_blocks);
+  parallel::parallel_for(num_blocks, num_threads, [&](unsigned int b, unsigned int) {
+    KClosest closest(k);
+    const unsigned int end = block_start(b+1, num_blocks, num_subseqs);
+    for (unsigned int i = block_start(b, num_blocks, num_subseqs); i < end; ++i) {
+      closest.push(distance_kernels::l2_sqr_early_abandon(query.data(), series.data() + i, query.size(), closest.threshold()), i);
+    }
+    block_closest[b] = closest.entries();
+    std::sort(block_closest[b].begin(), block_closest[b].end(), [](const auto& a, const auto& c){ return std::get<1>(a) < std::get<1>(c); });
+  });
+  KClosest closest(k);
+  for (const auto& candidates : block_closest) {
+    for (const auto& [dist, i] : candidates) closest.push(dist, i);
+  }
+  return closest.indexes();
+}
 
-vector<unsigned int> seq_scan::find_k_closest_indexes(const std::vector<double> &series, const std::vector<double> &query, unsigned int k)
+vector<unsigned int> seq_scan::find_k_closest_indexes(const mass::PreparedSeries& ps, const std::vector<double> &query, unsigned int k)
 {
+  const vector<double>& series = ps.series;
   if (series.size() <= query.size()) return {0};
+  if (k == 0) return {};
 
-  auto cmp = [](const tuple<unsigned int, double>& a, const tuple<unsigned int, double> b){
-    return std::get<1>(a) > std::get<1>(b);
-  };
-  priority_queue<tuple<unsigned int, double>, vector<tuple<unsigned int, double>>, decltype(cmp)> pri_q(cmp);
+  // the k-th closest is at most tolerance beyond the k-th least of the profile, and the profile of any closer
+  // subsequence at most tolerance beyond that, so only these are checked directly
+  vector<double> profile = mass::distance_profile_sqr(ps, query);
+  double cutoff = std::numeric_limits<double>::infinity();
+  if (k < profile.size()) {
+    vector<double> least( profile );
+    std::nth_element(least.begin(), least.begin()+k-1, least.end());
+    cutoff = least[k-1] + 2 * mass::tolerance(ps, query);
+  }
 
-  for (int i=0; i < series.size() - query.size() + 1; ++i) {
-    double dist = l2_sqr(series.data() + i, query.data(), query.size());
-    pri_q.push( { i, dist } );
+  KClosest closest(k);
+  for (unsigned int i=0; i < profile.size(); ++i) {
+    if (profile[i] > cutoff) continue;
+    const double* const candidate = series.data() + i;
+    double dist = error_measures::se_between_ptrs_early_abandon(query.data(), query.data()+query.size()-1, candidate, candidate+query.size()-1, closest.threshold());
+    closest.push(dist, i);
   }
+  return closest.indexes();
+}
 
-  vector<unsigned int> k_closest;
-  for (int i=0; i<k; i++) {
-    auto [seq_i,d] = pri_q.top();
-    pri_q.pop();
-    k_closest.push_back(seq_i);
+vector<vector<unsigned int>> seq_scan::find_similar_subseq_indexes_batch(const vector<double>& series, const vector<vector<double>>& queries, double epsilon, unsigned int num_threads)
+{
+  vector<vector<unsigned int>> similar_subseqs(queries.size());
+  for (unsigned int q=0; q<queries.size(); q++) {
+    if (series.size() <= queries[q].size()) similar_subseqs[q] = {0};
   }
+  if (epsilon < 0) return similar_subseqs;
+
+  auto by_mass = [&](const mass::PreparedSeries& ps, unsigned int q) { similar_subseqs[q] = find_similar_subseq_indexes(ps, queries[q], epsilon); };
+  auto by_scan = [&](unsigned int q) { similar_subseqs[q] = find_similar_subseq_indexes(series, queries[q], epsilon, NAIVE, 1); };
+  batch_scan(series, queries, false, num_threads, by_mass, by_scan);
+  return similar_subseqs;
+}
+
+vector<vector<unsigned int>> seq_scan::find_k_closest_indexes_batch(const vector<double>& series, const vector<vector<double>>& queries, unsigned int k, unsigned int num_threads)
+{
+  vector<vector<unsigned int>> k_closest(queries.size());
+  for (unsigned int q=0; q<queries.size(); q++) {
+    if (series.size() <= queries[q].size()) k_closest[q] = {0};
+  }
+
+  auto by_mass = [&](const mass::PreparedSeries& ps, unsigned int q) { k_closest[q] = find_k_closest_indexes(ps, queries[q], k); };
+  auto by_scan = [&](unsigned int q) { k_closest[q] = find_k_closest_indexes(series, queries[q], k, NAIVE, 1); };
+  batch_scan(series, queries, true, num_threads, by_mass, by_scan);
   return k_closest;
 }
@@ -2,6 +2,11 @@
 #define SEQUENTIAL_SCAN_H
 
 #include <vector>
+#include <queue>
+#include <tuple>
+#include <limits>
+
+#include "mass.h"
 
 /**
  * @file sequential_scan.h
@@ -13,6 +18,75 @@
  */
 namespace seq_scan {
 
+  /**
+   * @brief ScanMethod is how a scan finds the distances of the query to the subsequences
+   * NAIVE computes each in turn, MASS finds them all by FFT (see mass.h) and checks the candidates it finds directly,
+   * AUTO picks whichever prefer_mass expects to be quicker. All give the same result.
+   */
+  enum ScanMethod { NAIVE, MASS, AUTO };
+  /**
+   * @brief prefer_mass returns whether the FFT distance profile is expected to be quicker than the naive scan
+   * @param series_size is the size of the series scanned
+   * @param query_size is the size of the query
+   * @param knn whether the scan is for k nearest neighbours, whose naive scan abandons distances early
+   */
+  bool prefer_mass(unsigned int series_size, unsigned int query_size, bool knn);
+
+  /**
+   * @brief KClosest keeps the k closest of a stream of candidates, the furthest of them on top of a max heap
+   * Memory is O(k) whatever the number of candidates, and threshold() is the distance a new candidate must beat,
+   * so its distance can be abandoned once it passes it.
+   */
+  class KClosest {
+    unsigned int m_k;
+    std::priority_queue<std::tuple<double, unsigned int>> m_heap;
+  public:
+    /**
+     * @brief constructs an empty KClosest keeping at most k candidates
+     */
+    explicit KClosest(unsigned int k) : m_k(k) {}
+    /**
+     * @brief threshold returns the distance of the k-th closest so far, infinity until k candidates have been seen
+     */
+    double threshold() const
+    {
+      if (m_k == 0) return -std::numeric_limits<double>::infinity();
+      return m_heap.size() < m_k ? std::numeric_limits<double>::infinity() : std::get<0>(m_heap.top());
+    }
+    /**
+     * @brief push offers candidate i at distance dist, kept if it is closer than the k-th closest so far
+     */
+    void push(double dist, unsigned int i)
+    {
+      if (m_heap.size() < m_k) m_heap.push( { dist, i } );
+      else if (m_k > 0 && dist < std::get<0>(m_heap.top())) {
+	m_heap.pop();
+	m_heap.push( { dist, i } );
+      }
+    }
+    /**
+     * @brief entries returns the distances and indexes of the candidates kept, closest first, emptying the KClosest
+     */
+    std::vector<std::tuple<double, unsigned int>> entries()
+    {
+      std::vector<std::tuple<double, unsigned int>> closest(m_heap.size());
+      for (unsigned int i=m_heap.size(); i-- > 0; ) {
+	closest[i] = m_heap.top();
+	m_heap.pop();
+      }
+      return closest;
+    }
+    /**
+     * @brief indexes returns the candidates kept, closest first, emptying the KClosest
+     */
+    std::vector<unsigned int> indexes()
+    {
+      std::vector<unsigned int> closest;
+      for (const auto& [dist, i] : entries()) closest.push_back(i);
+      return closest;
+    }
+  };
+
   /**
    * @brief l2_sqr returns the squared error of the two sequences
    * @param s1start points to beginning of s1 array
@@ -27,17 +101,51 @@ namespace seq_scan {
    * @param series is the large time series to search for subsequences in
    * @param query is the query sequence to search for similar sequences to
    * @param epsilon is the maximum allowed l2 error between a query and returned subseqence
+   * @param method is how the distances are found
+   * @param num_threads is the number of threads the naive scan is split across, 0 uses one per hardware core
    * @return array of integers representing the start index of a subsequence within epsilon
    */
-  std::vector<unsigned int> find_similar_subseq_indexes(const std::vector<double>& series, const std::vector<double>& query, double epsilon);
+  std::vector<unsigned int> find_similar_subseq_indexes(const std::vector<double>& series, const std::vector<double>& query, double epsilon, ScanMethod method=AUTO, unsigned int num_threads=1);
+  /**
+   * @brief find_similar_subseq_indexes is find_similar_subseq_indexes by MASS, with a series already prepared for many queries
+   */
+  std::vector<unsigned int> find_similar_subseq_indexes(const mass::PreparedSeries& series, const std::vector<double>& query, double epsilon);
   /**
    * @brief find_k_closest_indexes finds all the k closest subsequences to a query
    * @param series is the large time series to search for subsequences in
    * @param query is the query sequence to search for similar sequences to
-   * @param k is the number of subsequences to find
-   * @return array of integers representing the start index of the k closest subsequences
+   * @param k is the number of subsequences to find, fewer are returned if the series has fewer subsequences
+   * @param method is how the distances are found
+   * @param num_threads is the number of threads the naive scan is split across, 0 uses one per hardware core
+   * @return array of integers representing the start index of the k closest subsequences, closest first
+   */
+  std::vector<unsigned int> find_k_closest_indexes(const std::vector<double>& series, const std::vector<double>& query, unsigned int k, ScanMethod method=AUTO, unsigned int num_threads=1);
+  /**
+   * @brief find_k_closest_indexes is find_k_closest_indexes by MASS, with a series already prepared for many queries
+   */
+  std::vector<unsigned int> find_k_closest_indexes(const mass::PreparedSeries& series, const std::vector<double>& query, unsigned int k);
+
+  /**
+   * @brief find_similar_subseq_indexes_batch is find_similar_subseq_indexes for many queries at once
+   * @param series is the large time series to search for subsequences in
+   * @param queries are the query sequences, of any sizes
+   * @param epsilon is the maximum allowed l2 error between a query and returned subseqence
+   * @param num_threads is the number of threads the queries are split across, 0 uses one per hardware core
+   * @return for each query the array find_similar_subseq_indexes returns
+   * The queries prefer_mass picks share one spectrum of the series (see mass::PreparedSeries), so it is transformed once
+   * rather than once per query. The rest are scanned naively, each by one thread.
+   */
+  std::vector<std::vector<unsigned int>> find_similar_subseq_indexes_batch(const std::vector<double>& series, const std::vector<std::vector<double>>& queries, double epsilon, unsigned int num_threads=1);
+  /**
+   * @brief find_k_closest_indexes_batch is find_k_closest_indexes for many queries at once
+   * @param series is the large time series to search for subsequences in
+   * @param queries are the query sequences, of any sizes
+   * @param k is the number of subsequences to find for each query
+   * @param num_threads is the number of threads the queries are split across, 0 uses one per hardware core
+   * @return for each query the array find_k_closest_indexes returns
+   * The queries are answered by MASS or scanned as in find_similar_subseq_indexes_batch.
    */
-  std::vector<unsigned int> find_k_closest_indexes(const std::vector<double>& series, const std::vector<double>& query, unsigned int k);
+  std::vector<std::vector<unsigned int>> find_k_closest_indexes_batch(const std::vector<double>& series, const std::vector<std::vector<double>>& queries, unsigned int k, unsigned int num_threads=1);
 };
 
 #endif
@@ -0,0 +1,121 @@
+#ifndef SHARDED_R_TREE_H
+#define SHARDED_R_TREE_H
+
+#include <vector>
+#include <array>
+#include <tuple>
+#include <algorithm>
+
+#include "r_tree.h"
+#include "parallel_for.h"
+
+/**
+ * @file sharded_r_tree.h
+ * @brief sharded_r_tree.h holds an index splitting the subsequences of a series by time range across independent r trees
+ */
+
+/**
+ * @brief ShardedRTree partitions the sequences it indexes into contiguous ranges, each held by its own RTree (shard)
+ * The shards are built concurrently and queries fan out to every shard concurrently. knn searches of the shards share
+ * their kth least error (RTreeSharedBound), so a shard stops as soon as the others have found k closer subsequences.
+ * Given the mbrs of subsequences in the order they start in the series, each shard indexes one range of time.
+ */
+template <typename R, typename I, SplitPolicy P = SplitPolicy::QUADRATIC, typename T = FPtrTraits<R>>
+class ShardedRTree {
+private:
+  std::vector<RTree<R,I,P,T>> shards;
+  unsigned int total_num_entries;
+
+public:
+  /**
+   * @brief constructor for the sharded r tree, the remaining parameters are those of the RTree constructor
+   * @param num_shards is the number of trees to partition the sequences across (eg. the number of cores)
+   */
+  ShardedRTree(unsigned int num_shards, unsigned int max_entries, unsigned int min_entries, FPtrArea<R> area_f, FPtrAreaMerge<R> merge_f, FPtrMBRDistSqr<R> p_dist_f, FPtrMBRCentre<R> centre_f=nullptr)
+    : ShardedRTree(num_shards, max_entries, min_entries, T(area_f, merge_f, p_dist_f, centre_f)) {}
+  /**
+   * @brief constructor for the sharded r tree taking the functions on MBRs as traits
+   * @param num_shards is the number of trees to partition the sequences across (eg. the number of cores)
+   */
+  ShardedRTree(unsigned int num_shards, unsigned int max_entries, unsigned int min_entries, T traits = T())
+    : total_num_entries(0)
+  {
+    shards.reserve( std::max(num_shards, 1u) );
+    for (unsigned int i=0; i<std::max(num_shards, 1u); i++) shards.emplace_back(max_entries, min_entries, traits);
+  }
+
+  /**
+   * @brief build replaces the contents of the shards, the ith of n shards taking the ith of n contiguous ranges of the sequences
+   * @param mbrs is the array of mbrs of the sequences, in time order
+   * @param st_indexes is the array of indexing methods, the ith retrieves the sequence covered by the ith mbr
+   * @param bulk chooses to bulk load each shard, otherwise the sequences are inserted one at a time
+   * @param num_threads is the number of threads to build with, 0 uses one per hardware core
+   */
+  void build(const std::vector<R>& mbrs, const std::vector<I>& st_indexes, bool bulk=true, unsigned int num_threads=0)
+  {
+    total_num_entries = mbrs.size();
+    parallel::parallel_for(shards.size(), num_threads, [&](unsigned int shard, unsigned int) {
+      unsigned long start = mbrs.size() * shard / shards.size();
+      unsigned long end = mbrs.size() * (shard+1) / shards.size();
+      if (bulk) {
+	shards[shard].bulk_load( std::vector<R>( mbrs.begin()+start, mbrs.begin()+end ), std::vector<I>( st_indexes.begin()+start, st_indexes.begin()+end ) );
+      } else {
+	RTree<R,I,P,T>& tree = shards[shard];
+	for (unsigned long i=start; i<end; i++) tree.insert( mbrs[i], st_indexes[i] );
+      }
+    });
+  }
+
+  /**
+   * @brief knn_search finds k subsequences of series closest to q across every shard, see RTree::knn_search
+   * @param num_threads is the number of threads to search the shards with, 0 uses one per hardware core
+   * @return array of pointers to the sequences in the larger sequence s, closest first
+   */
+  std::vector<std::array<const double*, 2>> knn_search(const std::vector<double>& q, unsigned int k, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads=0) const
+  {
+    RTreeSharedBound bound(k);
+    std::vector<std::vector<std::array<const double*, 2>>> shard_results(shards.size());
+    std::vector<std::vector<double>> shard_errors(shards.size());
+    parallel::parallel_for(shards.size(), num_threads, [&](unsigned int shard, unsigned int) {
+      RTreeSearchScratch scratch;
+      scratch.shared_bound = &bound;
+      shard_results[shard] = shards[shard].knn_search_errors(q, k, retrieve_f, s, scratch, shard_errors[shard]);
+    });
+
+    // each shard's results hold every one of the k closest inside it, with the errors its search refined them to
+    std::vector<std::tuple<double, std::array<const double*, 2>>> merged;
+    for (unsigned int shard=0; shard<shards.size(); shard++) {
+      for (unsigned int i=0; i<shard_results[shard].size(); i++) {
+	merged.push_back( { shard_errors[shard][i], shard_results[shard][i] } );
+      }
+    }
+    std::sort(merged.begin(), merged.end());
+    std::vector<std::array<const double*, 2>> results;
+    for (unsigned int i=0; i<std::min( (unsigned int) merged.size(), k ); i++) {
+      results.push_back( std::get<1>(merged[i]) );
+    }
+    return results;
+  }
+  /**
+   * @brief sim_search_exact finds all subsequences of series within epsilon of q across every shard, see RTree::sim_search_exact
+   * @param num_threads is the number of threads to search the shards with, 0 uses one per hardware core
+   * @return array of pointers to the sequences in the larger sequence s, shard by shard
+   */
+  std::vector<std::array<const double*, 2>> sim_search_exact(const std::vector<double>& q, double epsilon, FPtrRetrievalMethod<I> retrieve_f, const std::vector<double>& s, unsigned int num_threads=0) const
+  {
+    std::vector<std::vector<std::array<const double*, 2>>> shard_results(shards.size());
+    parallel::parallel_for(shards.size(), num_threads, [&](unsigned int shard, unsigned int) {
+      shard_results[shard] = shards[shard].sim_search_exact(q, epsilon, retrieve_f, s);
+    });
+
+    std::vector<std::array<const double*, 2>> results;
+    for (const auto& r : shard_results) results.insert(results.end(), r.begin(), r.end());
+    return results;
+  }
+
+  inline unsigned int get_num_shards() const { return shards.size(); }
+  inline const RTree<R,I,P,T>& get_shard(unsigned int i) const { return shards[i]; }
+  inline unsigned int get_num_leaves() const { return total_num_entries; }
+};
+
+#endif
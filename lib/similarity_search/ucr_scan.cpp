@@ -0,0 +1,128 @@
+#include "ucr_scan.h"
+#include "sequential_scan.h"
+
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+using std::vector;
+
+ucr_scan::ScanQuery ucr_scan::prepare(const vector<double>& query)
+{
+  ScanQuery prepared = { query, vector<unsigned int>(query.size()), {} };
+  std::iota(prepared.order.begin(), prepared.order.end(), 0);
+  std::stable_sort(prepared.order.begin(), prepared.order.end(), [&](unsigned int a, unsigned int b){ return std::abs(query[a]) > std::abs(query[b]); });
+  // the cascade has summed the first two and last two points before abandoning, so they are left to the end
+  const unsigned int n = query.size();
+  std::stable_partition(prepared.order.begin(), prepared.order.end(), [n](unsigned int i){ return i > 1 && i+2 < n; });
+  for (unsigned int i : prepared.order) prepared.ordered_q.push_back(query[i]);
+  return prepared;
+}
+
+namespace {
+  /**
+   * @brief kim_cascade sums the squared errors of the first and last points, then the second and second to last,
+   * returning as soon as the sum exceeds threshold
+   */
+  double kim_cascade(const std::vector<double>& q, const double* const c, double threshold)
+  {
+    const unsigned int n = q.size();
+    if (n == 0) return 0.0;
+    double lb = (q[0]-c[0])*(q[0]-c[0]);
+    if (n == 1) return lb;
+    lb += (q[n-1]-c[n-1])*(q[n-1]-c[n-1]);
+    if (lb > threshold || n == 2) return lb;
+    lb += (q[1]-c[1])*(q[1]-c[1]);
+    if (n == 3) return lb;
+    return lb + (q[n-2]-c[n-2])*(q[n-2]-c[n-2]);
+  }
+
+  /**
+   * @brief num_kim_points returns the number of points of a query of size n that kim_cascade sums
+   */
+  inline unsigned int num_kim_points(unsigned int n) { return std::min(n, 4u); }
+
+  /**
+   * @brief sum_early_abandon adds the squared errors of the first num_points points in the query's order to se,
+   * returning as soon as the sum exceeds threshold
+   */
+  double sum_early_abandon(const ucr_scan::ScanQuery& q, const double* const c, unsigned int num_points, double se, double threshold, ScanStats* stats)
+  {
+    for (unsigned int i=0; i < num_points; ++i) {
+      double diff = q.ordered_q[i] - c[ q.order[i] ];
+      se += diff * diff;
+      if (se > threshold) {
+	if (stats) stats->points_skipped += num_points - i - 1;
+	return se;
+      }
+    }
+    return se;
+  }
+
+  /**
+   * @brief settle returns the distance of candidate c to q, or a value above threshold once it is known to be above it,
+   * taking it through the cascade and counting where it was settled
+   */
+  double settle(const ucr_scan::ScanQuery& q, const double* const c, double threshold, ScanStats* stats)
+  {
+    if (stats) stats->candidates++;
+    const double kim = kim_cascade(q.q, c, threshold);
+    if (kim > threshold) {
+      if (stats) stats->kim_pruned++;
+      return std::numeric_limits<double>::infinity();
+    }
+    // the cascade summed all of its points, which the order leaves to the end
+    const unsigned int n = q.order.size();
+    double dist = sum_early_abandon(q, c, n - num_kim_points(n), kim, threshold, stats);
+    if (stats && dist > threshold) stats->abandoned++;
+    return dist;
+  }
+}
+
+double ucr_scan::kim_lb_sqr(const ScanQuery& q, const double* const candidate)
+{
+  return kim_cascade(q.q, candidate, std::numeric_limits<double>::infinity());
+}
+
+double ucr_scan::l2_sqr_early_abandon(const ScanQuery& q, const double* const candidate, double threshold, ScanStats* stats)
+{
+  return sum_early_abandon(q, candidate, q.order.size(), 0.0, threshold, stats);
+}
+
+vector<unsigned int> ucr_scan::find_similar_subseq_indexes(const vector<double>& series, const ScanQuery& query, double epsilon, ScanStats* stats)
+{
+  if (series.size() <= query.q.size()) return {0};
+  if (epsilon < 0) return {};
+
+  vector<unsigned int> similar_subseqs;
+  const double threshold = epsilon * epsilon;
+  for (unsigned int i=0; i < series.size() - query.q.size() + 1; ++i) {
+    if ( settle(query, series.data() + i, threshold, stats) <= threshold ) {
+      similar_subseqs.emplace_back(i);
+    }
+  }
+  return similar_subseqs;
+}
+
+vector<unsigned int> ucr_scan::find_similar_subseq_indexes(const vector<double>& series, const vector<double>& query, double epsilon, ScanStats* stats)
+{
+  return find_similar_subseq_indexes(series, prepare(query), epsilon, stats);
+}
+
+vector<unsigned int> ucr_scan::find_k_closest_indexes(const vector<double>& series, const ScanQuery& query, unsigned int k, ScanStats* stats)
+{
+  if (series.size() <= query.q.size()) return {0};
+  if (k == 0) return {};
+
+  seq_scan::KClosest closest(k);
+  for (unsigned int i=0; i < series.size() - query.q.size() + 1; ++i) {
+    closest.push(settle(query, series.data() + i, closest.threshold(), stats), i);
+  }
+  return closest.indexes();
+}
+
+vector<unsigned int> ucr_scan::find_k_closest_indexes(const vector<double>& series, const vector<double>& query, unsigned int k, ScanStats* stats)
+{
+  return find_k_closest_indexes(series, prepare(query), k, stats);
+}
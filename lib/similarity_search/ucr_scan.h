@@ -0,0 +1,90 @@
+#ifndef UCR_SCAN_H
+#define UCR_SCAN_H
+
+#include <vector>
+
+/**
+ * @file ucr_scan.h
+ * @brief Header file for the optimised sequential scan, answering the same searches as seq_scan in the manner of the UCR suite
+ */
+
+/**
+ * @brief ScanStats counts where the candidates of a scan were settled, for comparing against the pruning of an index
+ */
+struct ScanStats {
+  unsigned long candidates = 0; // subsequences considered
+  unsigned long kim_pruned = 0; // discarded by the bound on their first and last points
+  unsigned long abandoned = 0; // discarded part way through the distance
+  unsigned long points_skipped = 0; // points left unvisited when abandoning
+};
+
+/**
+ * @brief ucr_scan is namespace for the optimised sequential scan, returning the same as seq_scan
+ * Every candidate passes through a cascade of cheaper checks before its distance is finished:
+ *  - a bound from its first two and last two points, in the manner of LB_Kim,
+ *  - the distance summed in the order of the query's largest absolute values, abandoned once it exceeds the threshold.
+ *    It starts from the sum of the bound, so the points of the bound are not summed twice.
+ * The threshold is epsilon for similarity search and the current k-th best for k nearest neighbours.
+ * The order pays off for z-normalised series, where the points far from 0 are most likely to differ.
+ */
+namespace ucr_scan {
+
+  /**
+   * @brief ScanQuery is a query prepared for scanning, so scanning many series with it prepares it once
+   */
+  struct ScanQuery {
+    std::vector<double> q;
+    std::vector<unsigned int> order; // indexes of q, by descending absolute value but for the points of kim_lb_sqr, which come last
+    std::vector<double> ordered_q; // q in that order, read alongside order
+  };
+  /**
+   * @brief prepare returns the query prepared for scanning
+   * @param query is the query sequence
+   */
+  ScanQuery prepare(const std::vector<double>& query);
+
+  /**
+   * @brief kim_lb_sqr returns a lower bound of the squared error between the query and a candidate, from the first two and last two points
+   * @param q is the prepared query
+   * @param candidate points to the start of the candidate, of the same size as the query
+   */
+  double kim_lb_sqr(const ScanQuery& q, const double* const candidate);
+  /**
+   * @brief l2_sqr_early_abandon returns the squared error between the query and a candidate, summed in the query's order
+   * @param q is the prepared query
+   * @param candidate points to the start of the candidate, of the same size as the query
+   * @param threshold is the error above which the exact value is not needed
+   * @param stats if given counts the points left unvisited when abandoning
+   * @return the squared error if it is at most threshold, otherwise a partial sum already above threshold
+   */
+  double l2_sqr_early_abandon(const ScanQuery& q, const double* const candidate, double threshold, ScanStats* stats=nullptr);
+
+  /**
+   * @brief find_similar_subseq_indexes finds all subsequences of series that are within epsilon of query
+   * @param series is the large time series to search for subsequences in
+   * @param query is the prepared query to search for similar sequences to
+   * @param epsilon is the maximum allowed l2 error between a query and returned subseqence
+   * @param stats if given counts where the candidates were settled
+   * @return array of integers representing the start index of a subsequence within epsilon, in increasing order
+   */
+  std::vector<unsigned int> find_similar_subseq_indexes(const std::vector<double>& series, const ScanQuery& query, double epsilon, ScanStats* stats=nullptr);
+  /**
+   * @brief find_similar_subseq_indexes is find_similar_subseq_indexes preparing the query itself
+   */
+  std::vector<unsigned int> find_similar_subseq_indexes(const std::vector<double>& series, const std::vector<double>& query, double epsilon, ScanStats* stats=nullptr);
+  /**
+   * @brief find_k_closest_indexes finds all the k closest subsequences to a query
+   * @param series is the large time series to search for subsequences in
+   * @param query is the prepared query to search for similar sequences to
+   * @param k is the number of subsequences to find, fewer are returned if the series has fewer subsequences
+   * @param stats if given counts where the candidates were settled
+   * @return array of integers representing the start index of the k closest subsequences, closest first
+   */
+  std::vector<unsigned int> find_k_closest_indexes(const std::vector<double>& series, const ScanQuery& query, unsigned int k, ScanStats* stats=nullptr);
+  /**
+   * @brief find_k_closest_indexes is find_k_closest_indexes preparing the query itself
+   */
+  std::vector<unsigned int> find_k_closest_indexes(const std::vector<double>& series, const std::vector<double>& query, unsigned int k, ScanStats* stats=nullptr);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef WINDOWED_R_TREE_H
+#define WINDOWED_R_TREE_H
+
+#include <deque>
+#include <utility>
+
+#include "r_tree.h"
+
+/**
+ * @file windowed_r_tree.h
+ * @brief windowed_r_tree.h holds a r tree indexing only the latest sequences of an unbounded stream
+ */
+
+/**
+ * @brief WindowedRTree indexes the last window_size sequences inserted, removing the oldest as each new one arrives
+ * Nodes freed by removals are reused by the following inserts, so the memory held and the cost of queries stay
+ * those of a tree of window_size sequences however long the stream runs.
+ * The indexing methods must keep retrieving their sequences while in the window (eg. positions in a ring buffer of the stream).
+ */
+template <typename R, typename I, SplitPolicy P = SplitPolicy::QUADRATIC, typename T = FPtrTraits<R>>
+class WindowedRTree {
+private:
+  RTree<R,I,P,T> tree;
+  std::deque<std::pair<R, I>> window;
+  unsigned int window_size;
+
+public:
+  /**
+   * @brief constructor for the windowed r tree, the remaining parameters are those of the RTree constructor
+   * @param window_size is the number of latest sequences to index
+   */
+  WindowedRTree(unsigned int window_size, unsigned int max_entries, unsigned int min_entries, FPtrArea<R> area_f, FPtrAreaMerge<R> merge_f, FPtrMBRDistSqr<R> p_dist_f, FPtrMBRCentre<R> centre_f=nullptr)
+    : tree(max_entries, min_entries, area_f, merge_f, p_dist_f, centre_f), window_size(window_size) {}
+  /**
+   * @brief constructor for the windowed r tree taking the functions on MBRs as traits
+   * @param window_size is the number of latest sequences to index
+   */
+  WindowedRTree(unsigned int window_size, unsigned int max_entries, unsigned int min_entries, T traits = T())
+    : tree(max_entries, min_entries, traits), window_size(window_size) {}
+
+  /**
+   * @brief insert inserts the next sequence of the stream, removing the oldest sequence once the window is full
+   * @param mbr is the mbr of the sequence
+   * @param st_index is the indexing methods to retrieve the original sequence
+   */
+  void insert(const R& mbr, const I& st_index)
+  {
+    if (window_size == 0) return;
+    if (window.size() == window_size) {
+      tree.remove( window.front().first, window.front().second );
+      window.pop_front();
+    }
+    tree.insert( mbr, st_index );
+    window.push_back( {mbr, st_index} );
+  }
+
+  /**
+   * @brief get_tree returns the tree indexing the window, to search
+   */
+  inline const RTree<R,I,P,T>& get_tree() const { return tree; }
+  /**
+   * @brief size returns the number of sequences in the window
+   */
+  inline unsigned int size() const { return window.size(); }
+  inline unsigned int get_window_size() const { return window_size; }
+};
+
+#endif
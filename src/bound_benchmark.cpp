@@ -0,0 +1,105 @@
+/**
+ * @file bound_benchmark.cpp
+ *
+ * @brief Checks the Partition Cover lower bound never exceeds the true distance, and measures its tightness and time per DRT and S
+ *
+ * Pairs of subsequences are sampled from a random walk and, when the UCR archive is found (the first argument, or
+ * external/data/UCRArchive_2018/ by default), from a few of its datasets. Each DRT covers one side of the pair and the
+ * bound of the other side to the cover is compared against their true distance. Any violation is a bug in the bound.
+ */
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <type_traits>
+
+#include "ucr_parsing.h"
+#include "z_norm.h"
+#include "random_walk.h"
+
+#include "pla.h"
+#include "bottom_up.h"
+#include "exact_dp.h"
+#include "apla_segment_and_merge.h"
+
+#include "evaluations/capla.h"
+#include "evaluations/bound_eval.h"
+
+using std::vector, std::string, std::tuple;
+
+const unsigned int seq_size = 128;
+const unsigned int num_pairs = 200;
+
+/**
+ * @brief print_tightness prints the checks of the bound for each S on a dataset with a DRT, returning the number of violations
+ */
+template <unsigned int... Ss>
+unsigned long print_tightness(const vector<double>& dataset, const string& dataset_name, const string& drt_name, pla::APLA_DRT f)
+{
+  unsigned long violations = 0;
+  auto print_s = [&](auto s) {
+    constexpr unsigned int S = decltype(s)::value;
+    BoundTightness t = bound_eval::tightness_of_mbr_bound<S>(dataset, seq_size, f, num_pairs, S);
+    std::cout << std::left << std::setw(20) << dataset_name << std::setw(12) << drt_name << std::setw(4) << S
+	      << std::right << std::setw(6) << t.num_violations << std::setw(8) << t.num_merged_violations
+	      << std::setw(10) << t.mean_tightness << std::setw(10) << t.min_tightness
+	      << std::setw(12) << t.ns_per_bound << std::endl;
+    if (t.num_violations > 0) std::cout << "  worst violation : bound is " << t.max_violation << " times the distance" << std::endl;
+    violations += t.num_violations + t.num_merged_violations;
+  };
+  ( print_s(std::integral_constant<unsigned int, Ss>{}), ... );
+  return violations;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace ucr_parsing;
+  std::cout << std::fixed << std::setprecision(3);
+
+  vector<tuple<string, pla::APLA_DRT>> drts = {
+    { "conv mean 5", capla_eval::generate_mean_DRT_COMPR(5) },
+    { "bottom up", [](const Seqd& s, unsigned int num_params){
+	auto apla = bottom_up::bottom_up(s, 0.1, bottom_up::se);
+	if (apla.size() < num_params/3) segmerge::segment_to_dim(s, apla, num_params);
+	if (apla.size() > num_params/3) segmerge::merge_to_dim(s, apla, num_params);
+	return apla;
+      } },
+    { "exact dp", [](const Seqd& s, unsigned int num_params){ return exact_dp::min_l2_pla(s, num_params); } }
+  };
+
+  vector<tuple<string, vector<double>>> datasets;
+  RandomWalk walk( NormalFunctor(1) );
+  walk.gen_steps(20000);
+  vector<double> walk_dataset( walk.get_walk().begin(), walk.get_walk().end() );
+  z_norm::z_normalise(walk_dataset);
+  datasets.push_back( { "Normal Walk", walk_dataset } );
+
+  string ucr_datasets_loc = argc > 1 ? argv[1] : "external/data/UCRArchive_2018/";
+  if (std::filesystem::is_directory(ucr_datasets_loc)) {
+    vector<string> folders = parse_folder_names(ucr_datasets_loc);
+    // 5 is Arrowhead, 13 is Chlorine, 25 is Dodgers loop day, 28 is ECG200, 109 is Strawberry
+    for (unsigned int di : { 5, 13, 25, 28, 109 }) {
+      if (di >= folders.size()) continue;
+      vector<double> dataset = parse_ucr_dataset(folders[di], ucr_datasets_loc, DatasetType::TRAIN_APPEND_TEST);
+      if (dataset.size() <= seq_size) continue;
+      z_norm::z_normalise(dataset);
+      datasets.push_back( { folders[di], dataset } );
+    }
+  }
+  else std::cout << "No UCR archive at " << ucr_datasets_loc << ", checking the random walk only" << std::endl;
+
+  std::cout << "Tightness is the bound over the true distance, averaged and at its least over " << num_pairs << " pairs of size " << seq_size << std::endl;
+  std::cout << std::left << std::setw(20) << "dataset" << std::setw(12) << "DRT" << std::setw(4) << "S"
+	    << std::right << std::setw(6) << "viol" << std::setw(8) << "merged"
+	    << std::setw(10) << "mean" << std::setw(10) << "min" << std::setw(12) << "ns/bound" << std::endl;
+  unsigned long violations = 0;
+  for (auto& [dataset_name, dataset] : datasets) {
+    for (auto& [drt_name, f] : drts) {
+      violations += print_tightness<4, 8, 16, 32>(dataset, dataset_name, drt_name, f);
+    }
+  }
+  std::cout << violations << " violations of the lower bound" << std::endl;
+  return violations > 0;
+}
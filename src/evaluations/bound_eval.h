@@ -0,0 +1,109 @@
+#ifndef EVAL_BOUND_H
+#define EVAL_BOUND_H
+
+#include "lower_bounds_apla.h"
+#include "error_measures.h"
+#include "pla.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+/**
+ * @file bound_eval.h
+ * @brief Header file defining functions for checking and measuring the lower bound of the distance to a Partition Cover
+ * As the Partition Covers are templated on their number of regions these are defined in the header.
+ */
+
+/**
+ * @brief BoundTightness is the outcome of checking a lower bound against the true distance over sampled pairs
+ * The tightness of a pair is the bound over the true distance (both as distances, not squared), 1 being exact.
+ */
+struct BoundTightness {
+  unsigned long num_pairs = 0;
+  unsigned long num_violations = 0; // pairs whose bound exceeded the true distance, by more than rounding
+  unsigned long num_merged_violations = 0; // the same for the merge of the cover with another, as the nodes of a r tree hold
+  double max_violation = 1.0; // the largest bound over true distance of the violations (squared), 1 if there were none
+  double mean_tightness = 0.0;
+  double min_tightness = std::numeric_limits<double>::infinity();
+  double ns_per_bound = 0.0; // the time taken by one bound
+};
+
+/**
+ * @brief bound_eval is a namespace containing methods to check lower bounds never exceed the distance and to measure how close they come
+ */
+namespace bound_eval {
+  /**
+   * @brief sampled_subseqs returns num subsequences of size seq_size of the dataset, taken at random starts
+   */
+  inline std::vector<std::vector<double>> sampled_subseqs(const std::vector<double>& dataset, unsigned int seq_size, unsigned int num, std::mt19937& gen)
+  {
+    std::uniform_int_distribution<unsigned int> start_dist(0, dataset.size() - seq_size);
+    std::vector<std::vector<double>> subseqs;
+    for (unsigned int i=0; i<num; i++) {
+      unsigned int start = start_dist(gen);
+      subseqs.emplace_back( dataset.begin()+start, dataset.begin()+start+seq_size );
+    }
+    return subseqs;
+  }
+
+  /**
+   * @brief tightness_of_mbr_bound checks dist_to_mbr_sqr against the true distance for pairs of subsequences of the dataset
+   * @param dataset is the series to sample the subsequences from, it must be longer than seq_size
+   * @param seq_size is the size of the subsequences
+   * @param f is the DRT the Partition Covers are made with
+   * @param num_pairs is the number of (query, subsequence) pairs sampled
+   * @param seed seeds the sampling, so a run can be repeated
+   * @return the violations and tightness of the bound over the pairs, and its time per bound
+   * The queries are subsequences taken at other random starts, perturbed by noise so none equals a covered subsequence.
+   */
+  template <unsigned int S>
+  BoundTightness tightness_of_mbr_bound(const std::vector<double>& dataset, unsigned int seq_size, pla::APLA_DRT f, unsigned int num_pairs, unsigned int seed)
+  {
+    std::mt19937 gen(seed);
+    std::normal_distribution<double> noise(0.0, 0.1);
+    std::vector<std::vector<double>> subseqs = sampled_subseqs(dataset, seq_size, num_pairs, gen);
+    std::vector<std::vector<double>> queries = sampled_subseqs(dataset, seq_size, num_pairs, gen);
+    for (std::vector<double>& q : queries) {
+      for (double& v : q) v += noise(gen);
+    }
+    std::vector<apla_bounds::AplaMBR<S>> mbrs;
+    for (const std::vector<double>& s : subseqs) mbrs.push_back( apla_bounds::vec_to_mbr<S>(s, f) );
+
+    BoundTightness result;
+    result.num_pairs = num_pairs;
+    for (unsigned int i=0; i<num_pairs; i++) {
+      double dist = error_measures::se_between_ptrs(queries[i].data(), queries[i].data()+seq_size-1, subseqs[i].data(), subseqs[i].data()+seq_size-1);
+      double lb = apla_bounds::dist_to_mbr_sqr<S>(queries[i], mbrs[i]);
+      double merged_lb = apla_bounds::dist_to_mbr_sqr<S>(queries[i], apla_bounds::mbr_merge<S>(mbrs[i], mbrs[(i+1) % num_pairs]));
+      // the bound and the distance are rounded differently, so a bound equal to the distance may come out just above it
+      const double slack = dist * 1e-9 + 1e-12;
+      if (lb > dist + slack) {
+	result.num_violations++;
+	result.max_violation = std::max( result.max_violation, lb / dist );
+      }
+      if (merged_lb > dist + slack) result.num_merged_violations++;
+      double tightness = dist > 0 ? std::sqrt( std::min(lb, dist) / dist ) : 1.0;
+      result.mean_tightness += tightness / num_pairs;
+      result.min_tightness = std::min( result.min_tightness, tightness );
+    }
+
+    // time the bounds over every pair, enough times to take a measurable time
+    const unsigned int num_trials = std::max( 1u, 100'000 / std::max(num_pairs, 1u) );
+    volatile double sink = 0.0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (unsigned int t=0; t<num_trials; t++) {
+      double sum = 0.0;
+      for (unsigned int i=0; i<num_pairs; i++) sum += apla_bounds::dist_to_mbr_sqr<S>(queries[i], mbrs[i]);
+      sink = sink + sum;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    result.ns_per_bound = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / ((double) num_trials * std::max(num_pairs, 1u));
+    return result;
+  }
+};
+
+#endif
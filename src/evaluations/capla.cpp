@@ -21,6 +21,12 @@ DRT_COMPR capla_eval::generate_mean_DRT_COMPR(unsigned int win_size)
   Seqd r(win_size, 1/(double)win_size);
   return [l, r](const Seqd& s, unsigned int num_params){ return c_d_w::conv_pla(s, num_params, l, r); };
 }
+pla::APLA_DRT_PTR capla_eval::generate_mean_DRT_COMPR_PTR(unsigned int win_size)
+{
+  Seqd l(win_size, 1/(double)win_size);
+  Seqd r(win_size, 1/(double)win_size);
+  return c_d_w::ConvPla(l, r);
+}
 
 DRT capla_eval::generate_mean_skip_one_DRT(unsigned int win_size)
 {
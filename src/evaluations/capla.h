@@ -32,6 +32,13 @@ namespace capla_eval {
    * @return Function that accepts series and number of parameters to return approximation
    */
   DRT_COMPR generate_mean_DRT_COMPR(unsigned int win_size);
+  /**
+   * Function is generate_mean_DRT_COMPR taking a view of the series rather than a copy, see pla::APLA_DRT_PTR.
+   * Called on the windows of a series in turn it scores each point once, see c_d_w::ConvPla.
+   * @param win_size is the desired size of the windows, 0 is invalid here
+   * @return Function that accepts a pointer to a series, its size and number of parameters to return approximation
+   */
+  pla::APLA_DRT_PTR generate_mean_DRT_COMPR_PTR(unsigned int win_size);
   /**
    * Function creates non-weighted distribution of given window size and returns function to apply to data. This is formed of the additional hypothesis that gradient between the two potential lines shouldn't be accounted for.
    * @param win_size is the desired size of the windows, 0 is invalid here
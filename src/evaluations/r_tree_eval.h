@@ -0,0 +1,318 @@
+#ifndef EVAL_R_TREE_H
+#define EVAL_R_TREE_H
+
+#include "r_tree.h"
+#include "sharded_r_tree.h"
+#include "apla_r_tree.h"
+#include "random_walk.h"
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+
+/**
+ * @file r_tree_eval.h
+ * @brief Header file defining functions for timing construction of the r tree and measuring the quality of the built index
+ * As the r tree is templated on its MBR, index types, split policy and traits these are defined in the header.
+ */
+
+/**
+ * @brief r_tree_eval is a namespace containing methods to compare ways of building and querying the r tree
+ */
+namespace r_tree_eval {
+  /**
+   * @brief cputime_ms_of_insert_build times filling an empty tree by inserting the mbrs one at a time
+   * @param tree is the empty tree to fill
+   * @param mbrs is the array of mbrs, the ith is inserted with index i
+   * @return the time taken in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_insert_build(RTree<R, unsigned int, P, T>& tree, const std::vector<R>& mbrs)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (unsigned int i=0; i<mbrs.size(); i++) {
+      tree.insert( mbrs[i], i );
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_bulk_build times filling a tree by bulk loading the mbrs
+   * @param tree is the tree to fill
+   * @param mbrs is the array of mbrs, the ith is loaded with index i
+   * @return the time taken in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_bulk_build(RTree<R, unsigned int, P, T>& tree, const std::vector<R>& mbrs)
+  {
+    std::vector<unsigned int> indexes(mbrs.size());
+    for (unsigned int i=0; i<indexes.size(); i++) indexes[i] = i;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    tree.bulk_load( mbrs, indexes );
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_open_mapped times replacing the contents of a tree with a tree saved to file
+   * @param tree is the tree to open the file into
+   * @param path is the path of the saved tree
+   * @return the time taken in milliseconds, or -1 if the file could not be opened
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_open_mapped(RTree<R, unsigned int, P, T>& tree, const std::string& path)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    bool opened = tree.open_mapped( path );
+    auto end = std::chrono::high_resolution_clock::now();
+    if (!opened) return -1;
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief mean_pruning_power averages the pruning power of the tree over queries taken evenly from the dataset and perturbed by noise
+   * @param tree is the tree holding every subsequence of the dataset
+   * @param dataset is the series the tree indexes
+   * @param seq_size is the size of the indexed subsequences
+   * @param num_trials is the number of queries to average over
+   * @param retrieve_f is the method to retrieve the subsequence from the index
+   * @return the mean pruning power of the queries
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double mean_pruning_power(RTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, FPtrRetrievalMethod<unsigned int> retrieve_f)
+  {
+    unsigned int trial_incr = std::max( (dataset.size() - seq_size) / num_trials, (size_t) 1 );
+    NormalFunctor noise(0, 0.0, 0.1);
+    double pp = 0.0;
+    unsigned int trials = 0;
+    for (unsigned int i=0; i<dataset.size()-seq_size; i+=trial_incr) {
+      trials++;
+      std::vector<double> query( dataset.begin()+i, dataset.begin()+seq_size+i );
+      for (double& v : query) { // perturb query a bit to make it new
+	v += noise();
+      }
+      pp += tree.pruning_power(query, retrieve_f, dataset);
+    }
+    return pp / trials;
+  }
+  /**
+   * @brief perturbed_queries takes queries evenly from the dataset and perturbs them by noise to make them new
+   * @param dataset is the series to take the queries from
+   * @param seq_size is the size of the queries
+   * @param num_trials is the rough number of queries to take
+   * @return the array of queries
+   */
+  inline std::vector<std::vector<double>> perturbed_queries(const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials)
+  {
+    unsigned int trial_incr = std::max( (dataset.size() - seq_size) / num_trials, (size_t) 1 );
+    NormalFunctor noise(0, 0.0, 0.1);
+    std::vector<std::vector<double>> queries;
+    for (unsigned int i=0; i<dataset.size()-seq_size; i+=trial_incr) {
+      queries.emplace_back( dataset.begin()+i, dataset.begin()+seq_size+i );
+      for (double& v : queries.back()) {
+	v += noise();
+      }
+    }
+    return queries;
+  }
+  /**
+   * @brief cputime_ms_of_knn_traversal times knn searches of the tree for queries taken evenly from the dataset and perturbed by noise
+   * @param tree is the tree holding every subsequence of the dataset
+   * @param dataset is the series the tree indexes
+   * @param seq_size is the size of the indexed subsequences
+   * @param num_trials is the number of queries to time
+   * @param k is the number of neighbours each query searches for
+   * @param retrieve_f is the method to retrieve the subsequence from the index
+   * @return the total time taken by the searches in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_knn_traversal(RTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, unsigned int k, FPtrRetrievalMethod<unsigned int> retrieve_f)
+  {
+    std::vector<std::vector<double>> queries = perturbed_queries(dataset, seq_size, num_trials);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::vector<double>& query : queries) {
+      tree.knn_search(query, k, retrieve_f, dataset);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief fraction_of_points_skipped_by_knn measures the refinement work early abandoning saves knn searches,
+   * the queries and parameters as in cputime_ms_of_knn_traversal
+   * @return the fraction of candidate points due to be compared to the queries which were skipped
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double fraction_of_points_skipped_by_knn(const RTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, unsigned int k, FPtrRetrievalMethod<unsigned int> retrieve_f)
+  {
+    RTreeSearchScratch scratch;
+    for (const std::vector<double>& query : perturbed_queries(dataset, seq_size, num_trials)) {
+      tree.knn_search(query, k, retrieve_f, dataset, scratch);
+    }
+    if (scratch.points_refined == 0) return 0.0;
+    return scratch.points_skipped / (double) scratch.points_refined;
+  }
+  /**
+   * @brief query_stats_of_knn collects the work done by knn searches of the tree, the queries and parameters as in cputime_ms_of_knn_traversal
+   * @return the stats of every query merged together
+   * For a tree whose leaves hold the APLA of their subsequence (see AplaLeafRTree) the stats count the entries skipped by
+   * the APLA (entries_skipped) rather than retrieved. The index type is taken from the tree alone, so retrieve_f may be a lambda.
+   */
+  template <typename R, typename I, SplitPolicy P, typename T>
+  QueryStats query_stats_of_knn(const RTree<R, I, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, unsigned int k, FPtrRetrievalMethod<std::common_type_t<I>> retrieve_f)
+  {
+    RTreeSearchScratch scratch;
+    QueryStats stats;
+    for (const std::vector<double>& query : perturbed_queries(dataset, seq_size, num_trials)) {
+      tree.knn_search(query, k, retrieve_f, dataset, scratch, stats);
+    }
+    return stats;
+  }
+  /**
+   * @brief cputime_ms_of_approx_knn times approximate knn searches of the tree and measures their recall against exact searches,
+   * the queries and parameters as in cputime_ms_of_knn_traversal
+   * @param limits are the cut offs of the approximate searches
+   * @param recall is set to the fraction of the exact k nearest the approximate searches found
+   * @param max_distance_ratio is set to the largest distance ratio guaranteed by a search (1 if every search was exact)
+   * @return the total time taken by the approximate searches in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_approx_knn(const RTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, unsigned int k, FPtrRetrievalMethod<unsigned int> retrieve_f, const ApproxKnnLimits& limits, double& recall, double& max_distance_ratio)
+  {
+    std::vector<std::vector<double>> queries = perturbed_queries(dataset, seq_size, num_trials);
+    std::vector<ApproxKnnResult> approx_results;
+    RTreeSearchScratch scratch;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::vector<double>& query : queries) {
+      approx_results.push_back( tree.knn_search_approx(query, k, retrieve_f, dataset, limits, scratch) );
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    unsigned int found = 0, total = 0;
+    max_distance_ratio = 1.0;
+    for (unsigned int i=0; i<queries.size(); i++) {
+      std::vector<std::array<const double*,2>> exact = tree.knn_search(queries[i], k, retrieve_f, dataset, scratch);
+      for (const auto& r : approx_results[i].results) {
+	found += std::find(exact.begin(), exact.end(), r) != exact.end();
+      }
+      total += exact.size();
+      max_distance_ratio = std::max( max_distance_ratio, approx_results[i].distance_ratio );
+    }
+    recall = total == 0 ? 1.0 : found / (double) total;
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_knn_batch times a batch of knn searches spread over threads, the queries as in cputime_ms_of_knn_traversal
+   * @param num_threads is the number of threads to search with, 0 uses one per hardware core
+   * @return the wall clock time taken by the batch in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_knn_batch(const RTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, unsigned int k, FPtrRetrievalMethod<unsigned int> retrieve_f, unsigned int num_threads)
+  {
+    std::vector<std::vector<double>> queries = perturbed_queries(dataset, seq_size, num_trials);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    tree.knn_search_batch(queries, k, retrieve_f, dataset, num_threads);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_pruning_power_batch times pruning power measurements spread over threads, the queries as in mean_pruning_power
+   * @param num_threads is the number of threads to search with, 0 uses one per hardware core
+   * @return the wall clock time taken by the batch in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_pruning_power_batch(const RTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, FPtrRetrievalMethod<unsigned int> retrieve_f, unsigned int num_threads)
+  {
+    std::vector<std::vector<double>> queries = perturbed_queries(dataset, seq_size, num_trials);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    tree.pruning_power_batch(queries, retrieve_f, dataset, num_threads);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_prepared_knn is cputime_ms_of_knn_traversal preparing each query for the traits before searching
+   * @return the total time taken by preparing and searching in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_prepared_knn(const RTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, unsigned int k, FPtrRetrievalMethod<unsigned int> retrieve_f)
+  {
+    std::vector<std::vector<double>> queries = perturbed_queries(dataset, seq_size, num_trials);
+    RTreeSearchScratch scratch;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::vector<double>& query : queries) {
+      typename T::PreparedQuery pq(query);
+      tree.knn_search(pq, k, retrieve_f, dataset, scratch);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_sharded_build times building the shards of a sharded tree concurrently
+   * @param tree is the sharded tree to fill
+   * @param mbrs is the array of mbrs in time order, the ith is loaded with index i
+   * @param bulk chooses to bulk load each shard, otherwise the mbrs are inserted one at a time
+   * @param num_threads is the number of threads to build with, 0 uses one per hardware core
+   * @return the wall clock time taken in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_sharded_build(ShardedRTree<R, unsigned int, P, T>& tree, const std::vector<R>& mbrs, bool bulk, unsigned int num_threads)
+  {
+    std::vector<unsigned int> indexes(mbrs.size());
+    for (unsigned int i=0; i<indexes.size(); i++) indexes[i] = i;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    tree.build( mbrs, indexes, bulk, num_threads );
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_sharded_knn times knn searches fanned out over the shards, the queries as in cputime_ms_of_knn_traversal
+   * @param num_threads is the number of threads each query searches the shards with, 0 uses one per hardware core
+   * @return the total wall clock time taken by the searches in milliseconds
+   */
+  template <typename R, SplitPolicy P, typename T>
+  double cputime_ms_of_sharded_knn(const ShardedRTree<R, unsigned int, P, T>& tree, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, unsigned int k, FPtrRetrievalMethod<unsigned int> retrieve_f, unsigned int num_threads)
+  {
+    std::vector<std::vector<double>> queries = perturbed_queries(dataset, seq_size, num_trials);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::vector<double>& query : queries) {
+      tree.knn_search(query, k, retrieve_f, dataset, num_threads);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+  /**
+   * @brief cputime_ms_of_dist_kernel times a kernel computing the distance between queries and Partition Covers, as a tree search does
+   * @param mbrs is the array of Partition Covers of the subsequences of the dataset
+   * @param dataset is the series to take the queries from
+   * @param seq_size is the size of the queries
+   * @param num_trials is the number of queries, each measured against every mbr
+   * @param kernel is the kernel to time, it must be supported by the cpu
+   * @return the total time taken in milliseconds
+   */
+  template <unsigned int S>
+  double cputime_ms_of_dist_kernel(const std::vector<apla_bounds::AplaMBR<S>>& mbrs, const std::vector<double>& dataset, unsigned int seq_size, unsigned int num_trials, apla_bounds::DistKernel kernel)
+  {
+    std::vector<std::vector<double>> queries = perturbed_queries(dataset, seq_size, num_trials);
+
+    volatile double sink = 0.0; // keeps the distances from being optimised away
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::vector<double>& query : queries) {
+      double total = 0.0;
+      for (const auto& mbr : mbrs) {
+	total += apla_bounds::regions_dist_sqr(query.data(), query.size(), mbr.data(), S, kernel);
+      }
+      sink = sink + total;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+};
+
+#endif
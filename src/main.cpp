@@ -34,12 +34,17 @@
 #include "evaluations/general.h"
 #include "evaluations/capla.h"
 #include "evaluations/e_guarantee_eval.h"
+#include "evaluations/r_tree_eval.h"
 
 #include "random_walk.h"
 
 #include "r_tree.h"
+#include "apla_r_tree.h"
 #include "lower_bounds_apla.h"
 #include "sequential_scan.h"
+#include "ucr_scan.h"
+#include "mass.h"
+#include "distance_kernels.h"
 
 #include <chrono>
 
@@ -617,6 +622,559 @@ int main()
   */
   /********************************************************************************************/
 
+  /************************* Bulk loading vs Insertion ****************************************/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int> inserted(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>);
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int> packed(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    double insert_ms = r_tree_eval::cputime_ms_of_insert_build(inserted, mbrs);
+    double bulk_ms = r_tree_eval::cputime_ms_of_bulk_build(packed, mbrs);
+
+    std::cout << datasets[di] << " build (ms) : " << insert_ms << "," << bulk_ms
+      << " nodes : " << inserted.get_size_tree() << "," << packed.get_size_tree()
+      << " pruning power : " << r_tree_eval::mean_pruning_power(inserted, dataset, seq_size, 100, retrieval_f)
+      << "," << r_tree_eval::mean_pruning_power(packed, dataset, seq_size, 100, retrieval_f) << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Batched sequential scan against one query at a time *************/
+  /*
+  {
+  RandomWalk long_walk( NormalFunctor(1) );
+  long_walk.gen_steps(200'000);
+  vector<double> series( long_walk.get_walk().begin(), long_walk.get_walk().end() );
+  z_norm::z_normalise(series);
+
+  for (unsigned int seq_size : { 64, 256, 2048 }) {
+    vector<vector<double>> queries;
+    NormalFunctor noise(0,0.0,0.05);
+    for (unsigned int q=0; q<100; q++) {
+      unsigned int start = (q * 104'729) % (series.size() - seq_size);
+      queries.emplace_back( series.begin()+start, series.begin()+start+seq_size );
+      for (double& x : queries.back()) x += noise();
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const vector<double>& query : queries) seq_scan::find_similar_subseq_indexes(series, query, 1.0);
+    auto mid = std::chrono::high_resolution_clock::now();
+    seq_scan::find_similar_subseq_indexes_batch(series, queries, 1.0);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "query length : " << seq_size
+      << " one at a time (ms) : " << std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count() / 1000.0
+      << " batched (ms) : " << std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count() / 1000.0 << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Distance kernel throughput against sequence length ***************/
+  /*
+  {
+  RandomWalk long_walk( NormalFunctor(1) );
+  long_walk.gen_steps(2'000'000);
+  vector<double> series( long_walk.get_walk().begin(), long_walk.get_walk().end() );
+  z_norm::z_normalise(series);
+
+  vector<std::string> kernel_names = { "scalar", "avx2", "avx512" };
+  for (unsigned int len : { 64, 256, 1024, 16'384, 500'000 }) {
+    for (unsigned int k=0; k<kernel_names.size(); k++) {
+      auto kernel = (distance_kernels::Kernel) k;
+      if (!distance_kernels::kernel_supported(kernel)) continue;
+      const unsigned long reps = 50'000'000 / len;
+      double sum = 0;
+      auto start = std::chrono::high_resolution_clock::now();
+      for (unsigned long r=0; r<reps; r++) {
+	unsigned int offset = (r * 7'919) % (series.size() - 2*len - 1);
+	sum += distance_kernels::l2_sqr(series.data()+offset, series.data()+offset+len+1, len, kernel);
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      double secs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1e6;
+      std::cout << "length " << len << " " << kernel_names[k] << " : " << reps * len / secs / 1e9 << " Gpoints/s, "
+	<< reps * len * 2 * sizeof(double) / secs / 1e9 << " GB/s (" << sum << ")" << std::endl;
+    }
+  }
+
+  vector<double> query( series.begin()+1'000, series.begin()+1'128 );
+  for (unsigned int num_threads : { 1, 2, 4, 8 }) {
+    auto start = std::chrono::high_resolution_clock::now();
+    seq_scan::find_similar_subseq_indexes(series, query, 1.0, seq_scan::NAIVE, num_threads);
+    seq_scan::find_k_closest_indexes(series, query, 10, seq_scan::NAIVE, num_threads);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << num_threads << " threads scan (ms) : " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0 << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* MASS distance profiles against the naive scan over query sizes ***/
+  /*
+  {
+  for (unsigned int series_size : { 20'000, 200'000, 1'000'000 }) {
+    RandomWalk long_walk( NormalFunctor(1) );
+    long_walk.gen_steps(series_size);
+    vector<double> series( long_walk.get_walk().begin(), long_walk.get_walk().end() );
+    z_norm::z_normalise(series);
+    mass::PreparedSeries prepared = mass::prepare(series);
+
+    for (unsigned int seq_size=16; seq_size<=4096; seq_size*=2) {
+      vector<double> query( series.begin()+series_size/3, series.begin()+series_size/3+seq_size );
+      NormalFunctor noise(0,0.0,0.01);
+      for (double& x : query) x += noise();
+      const double epsilon = 0.05 * std::sqrt(seq_size);
+
+      vector<double> times;
+      auto time_ms = [&](auto f) {
+	auto start = std::chrono::high_resolution_clock::now();
+	f();
+	auto end = std::chrono::high_resolution_clock::now();
+	times.push_back( std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0 );
+      };
+      time_ms([&]{ seq_scan::find_similar_subseq_indexes(series, query, epsilon, seq_scan::NAIVE); });
+      time_ms([&]{ seq_scan::find_similar_subseq_indexes(series, query, epsilon, seq_scan::MASS); });
+      time_ms([&]{ seq_scan::find_k_closest_indexes(series, query, 10, seq_scan::NAIVE); });
+      time_ms([&]{ seq_scan::find_k_closest_indexes(series, query, 10, seq_scan::MASS); });
+      time_ms([&]{ seq_scan::find_k_closest_indexes(prepared, query, 10); });
+      std::cout << series_size << " query length : " << seq_size
+	<< " sim search naive, mass (ms) : " << times[0] << "," << times[1]
+	<< " knn naive, mass, mass prepared (ms) : " << times[2] << "," << times[3] << "," << times[4]
+	<< " auto picks mass : " << seq_scan::prefer_mass(series_size, seq_size, false) << "," << seq_scan::prefer_mass(series_size, seq_size, true) << std::endl;
+    }
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Parallel Partition Cover generation against threads **************/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(5'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 256;
+    const unsigned int NS = 8;
+    vector<pla::APLA_DRT> drts = { capla_eval::generate_mean_DRT_COMPR(5)
+				 , bottom_up_f_uncompr
+				 , exact_dp::min_l2_pla };
+    vector<std::string> drt_names = { "conv", "bottom up", "exact dp" };
+    for (unsigned int d=0; d<drts.size(); d++) {
+      std::cout << datasets[di] << " " << drt_names[d];
+      for (unsigned int num_threads : { 1, 2, 4, 8, 16 }) {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto mbrs = apla_bounds::vec_to_subseq_mbrs_parallel<NS>(dataset, seq_size, drts[d], num_threads);
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << " " << num_threads << " threads (ms) : " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+      }
+      std::cout << std::endl;
+    }
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Partition Cover construction, copied against sliding windows *****/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int NS = 30;
+    for (unsigned int seq_size : { 150, 300, 600 }) {
+      auto start = std::chrono::high_resolution_clock::now();
+      auto copied = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+      auto mid = std::chrono::high_resolution_clock::now();
+      auto slid = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR_PTR(5));
+      auto end = std::chrono::high_resolution_clock::now();
+      std::cout << datasets[di] << " query length : " << seq_size
+	<< " copied DRT (ms) : " << std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count() / 1000.0
+	<< " sliding DRT (ms) : " << std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count() / 1000.0 << std::endl;
+    }
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* APLA leaf bound against retrievals of the raw series *************/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto leaf_retrieval_f = [](const apla_bounds::AplaLeaf<NS>& leaf, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+leaf.start, q.data()+leaf.start+seq_size-1 }} );
+    };
+    vector<apla_bounds::AplaMBR<NS>> mbrs;
+    auto leaves = apla_bounds::vec_to_subseq_leaves<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5), mbrs);
+
+    AplaRTree<NS> tree(40,10);
+    r_tree_eval::cputime_ms_of_bulk_build(tree, mbrs);
+    AplaLeafRTree<NS> leaf_tree(40,10);
+    leaf_tree.bulk_load(mbrs, leaves);
+    QueryStats stats = r_tree_eval::query_stats_of_knn(tree, dataset, seq_size, 100, 10, retrieval_f);
+    QueryStats leaf_stats = r_tree_eval::query_stats_of_knn(leaf_tree, dataset, seq_size, 100, 10, leaf_retrieval_f);
+    std::cout << datasets[di] << " entries retrieved : " << stats.entries_retrieved / (double) stats.num_queries
+      << " ms per query : " << stats.wall_ms / stats.num_queries
+      << " with APLA leaves entries retrieved : " << leaf_stats.entries_retrieved / (double) leaf_stats.num_queries
+      << " skipped : " << leaf_stats.entries_skipped / (double) leaf_stats.num_queries
+      << " ms per query : " << leaf_stats.wall_ms / leaf_stats.num_queries << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Prepared queries against plain knn ********************************/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    AplaRTree<NS> tree(40,10);
+    r_tree_eval::cputime_ms_of_bulk_build(tree, mbrs);
+    std::cout << datasets[di] << " 10-nn (ms) : " << r_tree_eval::cputime_ms_of_knn_traversal(tree, dataset, seq_size, 100, 10, retrieval_f)
+      << " prepared 10-nn (ms) : " << r_tree_eval::cputime_ms_of_prepared_knn(tree, dataset, seq_size, 100, 10, retrieval_f) << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Partition Cover distance kernels against S and query length *******/
+  /*
+  {
+  dataset = parse_ucr_dataset(datasets[28], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+  dataset.resize(10'000);
+  z_norm::z_normalise(dataset);
+
+  vector<apla_bounds::DistKernel> kernels = { apla_bounds::DistKernel::SCALAR, apla_bounds::DistKernel::AVX2, apla_bounds::DistKernel::AVX512 };
+  vector<std::string> kernel_names = { "scalar", "avx2", "avx512" };
+  auto time_kernels = [&](auto ns) {
+    constexpr unsigned int NS = decltype(ns)::value;
+    for (unsigned int seq_size : { 128, 256, 512, 1024 }) {
+      auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+      std::cout << "S : " << NS << " query length : " << seq_size;
+      for (unsigned int k=0; k<kernels.size(); k++) {
+	if (!apla_bounds::dist_kernel_supported(kernels[k])) continue;
+	std::cout << " " << kernel_names[k] << " (ms) : " << r_tree_eval::cputime_ms_of_dist_kernel<NS>(mbrs, dataset, seq_size, 20, kernels[k]);
+      }
+      std::cout << std::endl;
+    }
+  };
+  time_kernels( std::integral_constant<unsigned int, 4>() );
+  time_kernels( std::integral_constant<unsigned int, 8>() );
+  time_kernels( std::integral_constant<unsigned int, 16>() );
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Approximate knn recall against latency ***************************/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    AplaRTree<NS> tree(40,10);
+    r_tree_eval::cputime_ms_of_bulk_build(tree, mbrs);
+    std::cout << datasets[di] << " exact 10-nn (ms) : " << r_tree_eval::cputime_ms_of_knn_traversal(tree, dataset, seq_size, 100, 10, retrieval_f) << std::endl;
+
+    vector<ApproxKnnLimits> limits = { {10, 0.0, 0.0}, {100, 0.0, 0.0}, {0, 0.1, 0.0}, {0, 0.5, 0.0}, {0, 0.0, 1.0} };
+    for (const ApproxKnnLimits& l : limits) {
+      double recall, max_ratio;
+      double ms = r_tree_eval::cputime_ms_of_approx_knn(tree, dataset, seq_size, 100, 10, retrieval_f, l, recall, max_ratio);
+      std::cout << "  refinements,epsilon,budget : " << l.max_refinements << "," << l.epsilon << "," << l.time_budget_ms
+	<< " (ms) : " << ms << " recall : " << recall << " max distance ratio : " << max_ratio << std::endl;
+    }
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Sharded R Tree against shards *************************************/
+  /*
+  {
+  vector<unsigned int> divs = { 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    for (unsigned int num_shards : { 1, 2, 4, 8, 16, 32, 64 }) {
+      ShardedRTree<apla_bounds::AplaMBR<NS>, unsigned int, SplitPolicy::QUADRATIC, apla_bounds::AplaTraits<NS>> tree(num_shards, 40, 10);
+      std::cout << datasets[di] << " shards : " << num_shards
+	<< " build (ms) : " << r_tree_eval::cputime_ms_of_sharded_build(tree, mbrs, false, num_shards)
+	<< " 10-nn (ms) : " << r_tree_eval::cputime_ms_of_sharded_knn(tree, dataset, seq_size, 100, 10, retrieval_f, num_shards) << std::endl;
+    }
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* R Tree query stats against entry limits **************************/
+  /*
+  {
+  vector<unsigned int> divs = { 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    for (unsigned int max_entries : { 10, 20, 40, 80 }) {
+      AplaRTree<NS> tree(max_entries, max_entries/4);
+      r_tree_eval::cputime_ms_of_insert_build(tree, mbrs);
+      QueryStats stats = r_tree_eval::query_stats_of_knn(tree, dataset, seq_size, 100, 10, retrieval_f);
+
+      std::cout << datasets[di] << " entries : " << max_entries << "," << max_entries/4 << " nodes visited per level :";
+      for (unsigned long n : stats.nodes_visited) std::cout << " " << n / (double) stats.num_queries;
+      std::cout << " entries checked : " << stats.entries_checked / (double) stats.num_queries
+	<< " candidates refined : " << stats.candidates_refined / (double) stats.num_queries
+	<< " dist calls : " << stats.dist_calls / (double) stats.num_queries
+	<< " max queue : " << stats.max_queue_size
+	<< " ms per query : " << stats.wall_ms / stats.num_queries << std::endl;
+    }
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Early abandoned refinement of the R Tree *************************/
+  /*
+  {
+  vector<unsigned int> divs = { 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    AplaRTree<NS> tree(40,10);
+    r_tree_eval::cputime_ms_of_bulk_build(tree, mbrs);
+
+    std::cout << datasets[di] << " 10-nn traversal (ms) : " << r_tree_eval::cputime_ms_of_knn_traversal(tree, dataset, seq_size, 100, 10, retrieval_f)
+      << " fraction of points skipped : " << r_tree_eval::fraction_of_points_skipped_by_knn(tree, dataset, seq_size, 100, 10, retrieval_f) << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* R Tree with function pointers vs traits ***************************/
+  /*
+  {
+  vector<unsigned int> divs = { 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int> fptr_tree(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    AplaRTree<NS> traits_tree(40,10);
+    double fptr_build_ms = r_tree_eval::cputime_ms_of_insert_build(fptr_tree, mbrs);
+    double traits_build_ms = r_tree_eval::cputime_ms_of_insert_build(traits_tree, mbrs);
+
+    std::cout << datasets[di] << " build (ms) : " << fptr_build_ms << "," << traits_build_ms
+      << " 10-nn traversal (ms) : " << r_tree_eval::cputime_ms_of_knn_traversal(fptr_tree, dataset, seq_size, 100, 10, retrieval_f)
+      << "," << r_tree_eval::cputime_ms_of_knn_traversal(traits_tree, dataset, seq_size, 100, 10, retrieval_f) << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Rebuilding vs reopening a saved R Tree ***************************/
+  /*
+  {
+  vector<unsigned int> divs = { 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto start = std::chrono::high_resolution_clock::now();
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int> built(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    r_tree_eval::cputime_ms_of_insert_build(built, mbrs);
+    auto end = std::chrono::high_resolution_clock::now();
+    double rebuild_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+
+    string path = "img/" + datasets[di] + ".rtree";
+    built.save(path);
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int> opened(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    double open_ms = r_tree_eval::cputime_ms_of_open_mapped(opened, path);
+
+    std::cout << datasets[di] << " rebuild (ms) : " << rebuild_ms << " open mapped (ms) : " << open_ms
+      << " pruning power : " << r_tree_eval::mean_pruning_power(built, dataset, seq_size, 100, retrieval_f)
+      << "," << r_tree_eval::mean_pruning_power(opened, dataset, seq_size, 100, retrieval_f) << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Split policies: Quadratic vs Linear vs R* ************************/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 28, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int, SplitPolicy::QUADRATIC> quad(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int, SplitPolicy::LINEAR> linear(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int, SplitPolicy::RSTAR> rstar(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    double quad_ms = r_tree_eval::cputime_ms_of_insert_build(quad, mbrs);
+    double linear_ms = r_tree_eval::cputime_ms_of_insert_build(linear, mbrs);
+    double rstar_ms = r_tree_eval::cputime_ms_of_insert_build(rstar, mbrs);
+
+    std::cout << datasets[di] << " build (ms) : " << quad_ms << "," << linear_ms << "," << rstar_ms
+      << " nodes : " << quad.get_size_tree() << "," << linear.get_size_tree() << "," << rstar.get_size_tree()
+      << " pruning power : " << r_tree_eval::mean_pruning_power(quad, dataset, seq_size, 100, retrieval_f)
+      << "," << r_tree_eval::mean_pruning_power(linear, dataset, seq_size, 100, retrieval_f)
+      << "," << r_tree_eval::mean_pruning_power(rstar, dataset, seq_size, 100, retrieval_f) << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* R Tree traversal: AoS vs SoA regions *****************************/
+  /*
+  {
+  vector<unsigned int> divs = { 28, 109 }; // ECG200 and Strawberry
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+    vector<apla_bounds::AplaMBRSoA<NS>> soa_mbrs;
+    for (const auto& mbr : mbrs) soa_mbrs.push_back( apla_bounds::to_soa<NS>(mbr) );
+
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int> aos_tree(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    RTree<apla_bounds::AplaMBRSoA<NS>, unsigned int> soa_tree(40,10 , apla_bounds::soa_mbr_area<NS> , apla_bounds::soa_mbr_merge<NS> , apla_bounds::soa_dist_to_mbr_sqr<NS>, apla_bounds::soa_mbr_centre<NS>);
+    r_tree_eval::cputime_ms_of_bulk_build(aos_tree, mbrs);
+    r_tree_eval::cputime_ms_of_bulk_build(soa_tree, soa_mbrs);
+
+    std::cout << datasets[di] << " 10-nn traversal (ms) : " << r_tree_eval::cputime_ms_of_knn_traversal(aos_tree, dataset, seq_size, 100, 10, retrieval_f)
+      << "," << r_tree_eval::cputime_ms_of_knn_traversal(soa_tree, dataset, seq_size, 100, 10, retrieval_f) << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
+  /************************* Batch query scaling with threads *********************************/
+  /*
+  {
+  vector<unsigned int> divs = { 5, 13, 25, 109 };
+  for (auto di : divs) {
+    dataset = parse_ucr_dataset(datasets[di], ucr_datasets_loc,  DatasetType::TRAIN_APPEND_TEST);
+    dataset.resize(20'000);
+    z_norm::z_normalise(dataset);
+
+    const unsigned int seq_size = 600;
+    const unsigned int NS = 30;
+    auto retrieval_f = [](const unsigned int& i, const vector<double>& q) {
+      return std::vector<std::array<const double*,2>>( {{ q.data()+i, q.data()+i+seq_size-1 }} );
+    };
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(dataset, seq_size, capla_eval::generate_mean_DRT_COMPR(5));
+    RTree<apla_bounds::AplaMBR<NS>, unsigned int> tree(40,10 , apla_bounds::mbr_area<NS> , apla_bounds::mbr_merge<NS> , apla_bounds::dist_to_mbr_sqr<NS>, apla_bounds::mbr_centre<NS>);
+    r_tree_eval::cputime_ms_of_bulk_build(tree, mbrs);
+
+    std::cout << datasets[di] << " pruning power of 1000 queries (ms) by threads :";
+    for (unsigned int threads : { 1, 2, 4, 8 }) {
+      std::cout << " " << threads << ":" << r_tree_eval::cputime_ms_of_pruning_power_batch(tree, dataset, seq_size, 1000, retrieval_f, threads);
+    }
+    std::cout << std::endl;
+  }
+  }
+  */
+  /********************************************************************************************/
+
   /************************* GEMINI vs SeqScan ************************************************/
   /*
   {
@@ -650,6 +1208,7 @@ int main()
   std::cout << "searching" << std::endl;
   vector<double> rtree_times(2);
   vector<double> seqscan_times(2);
+  vector<double> ucrscan_times(2);
   double trials = 0;
   for (int i=0;i<dataset.size()-seq_size; i+=10'000) {
     trials += 1;
@@ -684,17 +1243,32 @@ int main()
     dur_seqscan = std::chrono::duration_cast<std::chrono::microseconds>(end_seqscan - start_seqscan);
     seqscan_times[0] += dur_seqscan.count()/1000.0;
 
+    start_seqscan = std::chrono::high_resolution_clock::now();
+    ucr_scan::find_similar_subseq_indexes(dataset, query, 0.1);
+    end_seqscan = std::chrono::high_resolution_clock::now();
+    dur_seqscan = std::chrono::duration_cast<std::chrono::microseconds>(end_seqscan - start_seqscan);
+    ucrscan_times[1] += dur_seqscan.count()/1000.0;
+
+    start_seqscan = std::chrono::high_resolution_clock::now();
+    ucr_scan::find_k_closest_indexes(dataset, query, 30);
+    end_seqscan = std::chrono::high_resolution_clock::now();
+    dur_seqscan = std::chrono::duration_cast<std::chrono::microseconds>(end_seqscan - start_seqscan);
+    ucrscan_times[0] += dur_seqscan.count()/1000.0;
+
   }
   rtree_times[0] /= trials;
   rtree_times[1] /= trials;
   seqscan_times[0] /= trials;
   seqscan_times[1] /= trials;
+  ucrscan_times[0] /= trials;
+  ucrscan_times[1] /= trials;
 
   PlotDetails pd = { "Time taken by Sim Search and K-NN Methods", "", "Time (MS)", "img/sim_search/", PDF };
   Series rtree_series = {rtree_times, "RTree"};
   Series seqscan_series = {seqscan_times, "Sequential Scan"};
+  Series ucrscan_series = {ucrscan_times, "UCR Scan"};
   vector<string> x_labels = { "K-NN", "Similarity Search" };
-  vector<Series> vs = {rtree_series, seqscan_series};
+  vector<Series> vs = {rtree_series, seqscan_series, ucrscan_series};
   plot::barplot_many_series(vs, x_labels, pd);
 
   }
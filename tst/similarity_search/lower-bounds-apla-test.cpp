@@ -0,0 +1,382 @@
+#include "lower_bounds_apla.h"
+#include "apla_r_tree.h"
+#include "conv_double_window.h"
+#include "error_measures.h"
+#include "random_walk.h"
+#include "z_norm.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+  const unsigned int NS = 10;
+  const unsigned int seq_size = 200;
+
+  pla::APLA_DRT mean_conv_drt()
+  {
+    std::vector<double> l(5, 1/5.0), r(5, 1/5.0);
+    return [l, r](const std::vector<double>& s, unsigned int num_params){ return c_d_w::conv_pla(s, num_params, l, r); };
+  }
+
+  std::vector<double> z_normalised_walk(unsigned int size, unsigned int seed)
+  {
+    RandomWalk walk{ NormalFunctor(seed) };
+    walk.gen_steps(size);
+    std::vector<double> series(walk.get_walk().cbegin(), walk.get_walk().cend());
+    z_norm::z_normalise(series);
+    return series;
+  }
+}
+
+TEST(AplaBounds, CompactRegionContainsRegion) {
+  EXPECT_LE(2 * sizeof(apla_bounds::CompactRegion), sizeof(apla_bounds::Region));
+
+  std::vector<double> series = z_normalised_walk(2'000, 1);
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, mean_conv_drt());
+  for (const auto& mbr : mbrs) {
+    auto compact = apla_bounds::to_compact<NS>(mbr);
+    for (int r=0; r<NS; r++) {
+      const apla_bounds::Region& region = mbr[r];
+      const apla_bounds::Region rounded = apla_bounds::from_compact_region(compact[r]);
+      ASSERT_EQ(rounded.min_i, region.min_i);
+      ASSERT_EQ(rounded.max_i, region.max_i);
+      for (unsigned int x=0; x<=region.max_i-region.min_i; x++) {
+	EXPECT_LE(rounded.min_dp[1]*x + rounded.min_dp[0], region.min_dp[1]*x + region.min_dp[0]);
+	EXPECT_GE(rounded.max_dp[1]*x + rounded.max_dp[0], region.max_dp[1]*x + region.max_dp[0]);
+      }
+    }
+  }
+
+  // lines through or near 0, as flat or zero mean data gives, are rounded without stepping through the denormals
+  for (DoublePair dp : { DoublePair{0.0, 0.1}, DoublePair{0.0, 0.0}, DoublePair{1e-310, -1e-310}, DoublePair{-3.0, 1e-9} }) {
+    for (bool down : { true, false }) {
+      auto line = apla_bounds::round_line_outward(dp, 600, down);
+      for (double x : { 0.0, 600.0 }) {
+	double rounded = (double) line[0] + (double) line[1]*x, exact = dp[0] + dp[1]*x;
+	EXPECT_TRUE(down ? rounded <= exact : rounded >= exact);
+      }
+    }
+  }
+
+  // indices past 16 bits have no compact form
+  auto too_long = mbrs;
+  too_long.back()[NS-1].max_i = apla_bounds::COMPACT_MAX_INDEX + 1;
+  EXPECT_TRUE(apla_bounds::compact_fits<NS>(mbrs.back()));
+  EXPECT_FALSE(apla_bounds::compact_fits<NS>(too_long.back()));
+  EXPECT_EQ(apla_bounds::to_compact_mbrs<NS>(mbrs).size(), mbrs.size());
+  EXPECT_TRUE(apla_bounds::to_compact_mbrs<NS>(too_long).empty());
+}
+
+template <unsigned int S>
+void expect_dist_is_lower_bound(const std::vector<double>& series, const std::vector<double>& other)
+{
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<S>(series, seq_size, mean_conv_drt());
+  for (unsigned int qi=0; qi+seq_size<other.size(); qi+=97) {
+    std::vector<double> q(other.begin()+qi, other.begin()+qi+seq_size);
+    for (unsigned int i=0; i<mbrs.size(); i+=13) {
+      double dist = error_measures::se_between_ptrs(q.data(), q.data()+seq_size-1, &series[i], &series[i+seq_size-1]);
+      EXPECT_LE(apla_bounds::dist_to_mbr_sqr<S>(q, mbrs[i]), dist * (1 + 1e-9));
+      auto merged = apla_bounds::mbr_merge<S>(mbrs[i], mbrs[(i+500) % mbrs.size()]);
+      EXPECT_LE(apla_bounds::dist_to_mbr_sqr<S>(q, merged), dist * (1 + 1e-9));
+    }
+  }
+}
+
+TEST(AplaBounds, DistIsLowerBound) {
+  std::vector<double> series = z_normalised_walk(2'000, 4);
+  std::vector<double> other = z_normalised_walk(2'000, 5);
+  expect_dist_is_lower_bound<4>(series, other);
+  expect_dist_is_lower_bound<NS>(series, other);
+  expect_dist_is_lower_bound<32>(series, other);
+}
+
+TEST(AplaBounds, CompactDistIsLowerBound) {
+  std::vector<double> series = z_normalised_walk(2'000, 2);
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, mean_conv_drt());
+  auto compact_mbrs = apla_bounds::to_compact_mbrs<NS>(mbrs);
+  std::vector<double> other = z_normalised_walk(2'000, 3);
+
+  for (unsigned int qi=0; qi+seq_size<other.size(); qi+=97) {
+    std::vector<double> q(other.begin()+qi, other.begin()+qi+seq_size);
+    for (unsigned int i=0; i<mbrs.size(); i+=13) {
+      double compact_dist = apla_bounds::compact_dist_to_mbr_sqr<NS>(q, compact_mbrs[i]);
+      EXPECT_LE(compact_dist, apla_bounds::dist_to_mbr_sqr<NS>(q, mbrs[i]));
+      EXPECT_LE(compact_dist, error_measures::se_between_ptrs(q.data(), q.data()+seq_size-1, &series[i], &series[i+seq_size-1]));
+    }
+  }
+
+  // merges of compact covers still contain both covers
+  for (unsigned int i=0; i+500<compact_mbrs.size(); i+=101) {
+    auto merged = apla_bounds::compact_mbr_merge<NS>(compact_mbrs[i], compact_mbrs[i+500]);
+    std::vector<double> q(series.begin()+i, series.begin()+i+seq_size);
+    EXPECT_LE(apla_bounds::compact_dist_to_mbr_sqr<NS>(q, merged), apla_bounds::compact_dist_to_mbr_sqr<NS>(q, compact_mbrs[i]));
+  }
+}
+
+TEST(AplaBounds, CompactRTreeKnn) {
+  std::vector<double> series = z_normalised_walk(3'000, 4);
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, mean_conv_drt());
+  AplaCompactRTree<NS> tree(40, 10);
+  for (unsigned int i=0; i<mbrs.size(); i++) tree.insert(apla_bounds::to_compact<NS>(mbrs[i]), i);
+  auto retrieve = [](const unsigned int& i, const std::vector<double>& s) {
+    return std::vector<std::array<const double*,2>>( {{ s.data()+i, s.data()+i+seq_size-1 }} );
+  };
+
+  std::vector<double> q(series.begin()+1'234, series.begin()+1'234+seq_size);
+  for (double& v : q) v += 0.05;
+  std::vector<double> errors;
+  for (unsigned int i=0; i<mbrs.size(); i++) {
+    errors.push_back( error_measures::se_between_ptrs(q.data(), q.data()+seq_size-1, &series[i], &series[i+seq_size-1]) );
+  }
+  std::sort(errors.begin(), errors.end());
+
+  auto res = tree.knn_search(q, 5, retrieve, series);
+  ASSERT_EQ(res.size(), 5);
+  for (int i=0; i<5; i++) {
+    EXPECT_DOUBLE_EQ(error_measures::se_between_ptrs(q.data(), q.data()+seq_size-1, res[i][0], res[i][1]), errors[i]);
+  }
+}
+
+namespace {
+  template <unsigned int S>
+  void expect_dist_kernels_agree(unsigned int size, unsigned int seed)
+  {
+    std::vector<double> series = z_normalised_walk(1'500, seed);
+    auto mbrs = apla_bounds::vec_to_subseq_mbrs<S>(series, size, mean_conv_drt());
+    for (unsigned int i=0; i+300<mbrs.size(); i+=37) mbrs.push_back( apla_bounds::mbr_merge<S>(mbrs[i], mbrs[i+300]) );
+    std::vector<double> other = z_normalised_walk(1'500, seed+1);
+
+    for (unsigned int qi=0; qi+size<other.size(); qi+=211) {
+      std::vector<double> q(other.begin()+qi, other.begin()+qi+size);
+      for (unsigned int i=0; i<mbrs.size(); i+=7) {
+	double scalar = apla_bounds::regions_dist_sqr(q.data(), size, mbrs[i].data(), S, apla_bounds::DistKernel::SCALAR);
+	for (auto kernel : { apla_bounds::DistKernel::AVX2, apla_bounds::DistKernel::AVX512 }) {
+	  if (!apla_bounds::dist_kernel_supported(kernel)) continue;
+	  EXPECT_EQ(apla_bounds::regions_dist_sqr(q.data(), size, mbrs[i].data(), S, kernel), scalar);
+	}
+	EXPECT_EQ(apla_bounds::dist_to_mbr_sqr<S>(q, mbrs[i]), scalar);
+      }
+    }
+  }
+}
+
+TEST(AplaBounds, DistKernelsAgree) {
+  // lengths with and without a tail of points left over from the blocks of the vector kernels
+  expect_dist_kernels_agree<4>(128, 5);
+  expect_dist_kernels_agree<8>(203, 7);
+  expect_dist_kernels_agree<16>(256, 9);
+  expect_dist_kernels_agree<16>(61, 11);
+}
+
+TEST(AplaBounds, PreparedQueryBound) {
+  std::vector<double> series = z_normalised_walk(2'000, 12);
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, mean_conv_drt());
+  for (unsigned int i=0; i+400<mbrs.size(); i+=41) mbrs.push_back( apla_bounds::mbr_merge<NS>(mbrs[i], mbrs[i+400]) );
+  std::vector<double> other = z_normalised_walk(2'000, 13);
+
+  for (unsigned int qi=0; qi+seq_size<other.size(); qi+=173) {
+    std::vector<double> q(other.begin()+qi, other.begin()+qi+seq_size);
+    apla_bounds::PreparedQuery pq(q);
+    for (unsigned int i=0; i<mbrs.size(); i+=11) {
+      double dist = apla_bounds::dist_to_mbr_sqr<NS>(q, mbrs[i]);
+      EXPECT_LE(apla_bounds::prepared_lb_sqr(pq, mbrs[i].data(), NS), dist);
+      // exact up to the threshold, and a bound above it beyond
+      EXPECT_EQ(apla_bounds::dist_to_mbr_sqr<NS>(pq, mbrs[i], dist), dist);
+      double bounded = apla_bounds::dist_to_mbr_sqr<NS>(pq, mbrs[i], dist * 0.5);
+      EXPECT_LE(bounded, dist);
+      if (dist > 0) {
+	EXPECT_GT(bounded, dist * 0.5);
+      }
+    }
+  }
+}
+
+TEST(AplaBounds, PreparedQuerySearch) {
+  std::vector<double> series = z_normalised_walk(3'000, 14);
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, mean_conv_drt());
+  AplaRTree<NS> tree(40, 10);
+  for (unsigned int i=0; i<mbrs.size(); i++) tree.insert(mbrs[i], i);
+  auto retrieve = [](const unsigned int& i, const std::vector<double>& s) {
+    return std::vector<std::array<const double*,2>>( {{ s.data()+i, s.data()+i+seq_size-1 }} );
+  };
+
+  for (unsigned int qi : { 100, 1'234, 2'500 }) {
+    std::vector<double> q(series.begin()+qi, series.begin()+qi+seq_size);
+    for (double& v : q) v += 0.05;
+    apla_bounds::PreparedQuery pq(q);
+    RTreeSearchScratch scratch;
+    QueryStats plain_stats, prepared_stats;
+
+    auto plain = tree.knn_search(q, 10, retrieve, series, scratch, plain_stats);
+    auto prepared = tree.knn_search(pq, 10, retrieve, series, scratch, prepared_stats);
+    ASSERT_EQ(prepared.size(), plain.size());
+    for (unsigned int i=0; i<plain.size(); i++) {
+      EXPECT_DOUBLE_EQ(error_measures::se_between_ptrs(q.data(), q.data()+seq_size-1, prepared[i][0], prepared[i][1]),
+		       error_measures::se_between_ptrs(q.data(), q.data()+seq_size-1, plain[i][0], plain[i][1]));
+    }
+    EXPECT_EQ(prepared_stats.entries_retrieved, plain_stats.entries_retrieved);
+
+    double epsilon = 2.0;
+    auto within = tree.sim_search_exact(q, epsilon, retrieve, series, scratch);
+    auto prepared_within = tree.sim_search_exact(pq, epsilon, retrieve, series, scratch);
+    std::sort(within.begin(), within.end());
+    std::sort(prepared_within.begin(), prepared_within.end());
+    EXPECT_EQ(prepared_within, within);
+  }
+}
+
+TEST(AplaBounds, LeafBound) {
+  std::vector<double> series = z_normalised_walk(2'000, 15);
+  std::vector<apla_bounds::AplaMBR<NS>> mbrs;
+  auto leaves = apla_bounds::vec_to_subseq_leaves<NS>(series, seq_size, mean_conv_drt(), mbrs);
+  ASSERT_EQ(leaves.size(), mbrs.size());
+  std::vector<double> other = z_normalised_walk(2'000, 16);
+
+  for (unsigned int qi=0; qi+seq_size<other.size(); qi+=173) {
+    std::vector<double> q(other.begin()+qi, other.begin()+qi+seq_size);
+    apla_bounds::PreparedQuery pq(q);
+    for (unsigned int i=0; i<leaves.size(); i+=11) {
+      double dist = error_measures::se_between_ptrs(q.data(), q.data()+seq_size-1, series.data()+i, series.data()+i+seq_size-1);
+      double lb = RTreeLeafBound<apla_bounds::AplaLeaf<NS>>::dist_sqr(q, leaves[i]);
+      EXPECT_LE(lb, dist);
+      EXPECT_NEAR(RTreeLeafBound<apla_bounds::AplaLeaf<NS>>::dist_sqr(pq, leaves[i]), lb, lb * 1e-6);
+    }
+  }
+}
+
+TEST(AplaBounds, LeafBoundSearch) {
+  std::vector<double> series = z_normalised_walk(3'000, 17);
+  std::vector<apla_bounds::AplaMBR<NS>> mbrs;
+  auto leaves = apla_bounds::vec_to_subseq_leaves<NS>(series, seq_size, mean_conv_drt(), mbrs);
+  AplaRTree<NS> tree(40, 10);
+  AplaLeafRTree<NS> leaf_tree(40, 10);
+  for (unsigned int i=0; i<mbrs.size(); i++) {
+    tree.insert(mbrs[i], i);
+    leaf_tree.insert(mbrs[i], leaves[i]);
+  }
+  auto retrieve = [](const unsigned int& i, const std::vector<double>& s) {
+    return std::vector<std::array<const double*,2>>( {{ s.data()+i, s.data()+i+seq_size-1 }} );
+  };
+  auto retrieve_leaf = [](const apla_bounds::AplaLeaf<NS>& leaf, const std::vector<double>& s) {
+    return std::vector<std::array<const double*,2>>( {{ s.data()+leaf.start, s.data()+leaf.start+seq_size-1 }} );
+  };
+
+  for (unsigned int qi : { 100, 1'234, 2'500 }) {
+    std::vector<double> q(series.begin()+qi, series.begin()+qi+seq_size);
+    for (double& v : q) v += 0.05;
+    apla_bounds::PreparedQuery pq(q);
+    RTreeSearchScratch scratch;
+    QueryStats plain_stats, leaf_stats, prepared_stats;
+
+    auto plain = tree.knn_search(q, 10, retrieve, series, scratch, plain_stats);
+    auto leaf = leaf_tree.knn_search(q, 10, retrieve_leaf, series, scratch, leaf_stats);
+    auto prepared = leaf_tree.knn_search(pq, 10, retrieve_leaf, series, scratch, prepared_stats);
+    EXPECT_EQ(leaf, plain);
+    EXPECT_EQ(prepared, plain);
+    // the entries skipped are exactly those retrieved without the leaf bound that could not be among the results
+    EXPECT_GT(leaf_stats.entries_skipped, 0);
+    EXPECT_EQ(leaf_stats.entries_retrieved + leaf_stats.entries_skipped, plain_stats.entries_retrieved);
+    EXPECT_EQ(prepared_stats.entries_retrieved + prepared_stats.entries_skipped, plain_stats.entries_retrieved);
+
+    double epsilon = 2.0;
+    auto within = tree.sim_search_exact(q, epsilon, retrieve, series, scratch);
+    auto leaf_within = leaf_tree.sim_search_exact(q, epsilon, retrieve_leaf, series, scratch);
+    std::sort(within.begin(), within.end());
+    std::sort(leaf_within.begin(), leaf_within.end());
+    EXPECT_EQ(leaf_within, within);
+  }
+}
+
+TEST(AplaBounds, LeafTreeSaveRemove) {
+  std::vector<double> series = z_normalised_walk(1'500, 18);
+  std::vector<apla_bounds::AplaMBR<NS>> mbrs;
+  auto leaves = apla_bounds::vec_to_subseq_leaves<NS>(series, seq_size, mean_conv_drt(), mbrs);
+  AplaLeafRTree<NS> leaf_tree(40, 10);
+  leaf_tree.bulk_load(mbrs, leaves);
+  auto retrieve_leaf = [](const apla_bounds::AplaLeaf<NS>& leaf, const std::vector<double>& s) {
+    return std::vector<std::array<const double*,2>>( {{ s.data()+leaf.start, s.data()+leaf.start+seq_size-1 }} );
+  };
+  std::vector<double> q(series.begin()+700, series.begin()+700+seq_size);
+
+  // the leaves hold their lines in place, so the tree maps back with the same results
+  std::string path = ::testing::TempDir() + "apla_leaf_tree_save_test.bin";
+  ASSERT_TRUE(leaf_tree.save(path));
+  AplaLeafRTree<NS> mapped(40, 10);
+  ASSERT_TRUE(mapped.open_mapped(path));
+  EXPECT_EQ(mapped.get_num_leaves(), leaf_tree.get_num_leaves());
+  EXPECT_EQ(mapped.knn_search(q, 10, retrieve_leaf, series), leaf_tree.knn_search(q, 10, retrieve_leaf, series));
+  std::remove(path.c_str());
+
+  // leaves are found by their position, so removing one leaves it out of the results
+  EXPECT_TRUE(leaf_tree.remove(mbrs[700], leaves[700]));
+  EXPECT_FALSE(leaf_tree.remove(mbrs[700], leaves[700]));
+  EXPECT_EQ(leaf_tree.get_num_leaves(), leaves.size()-1);
+  auto nearest = leaf_tree.knn_search(q, 1, retrieve_leaf, series);
+  ASSERT_EQ(nearest.size(), 1);
+  EXPECT_NE(nearest[0][0], series.data()+700);
+}
+
+TEST(AplaBounds, SubseqCoverStream) {
+  std::vector<double> series = z_normalised_walk(1'000, 18);
+  std::vector<double> l(5, 1/5.0), r(5, 1/5.0);
+  // scores the points of the series once, reusing them across the windows
+  pla::APLA_DRT_PTR view_drt = c_d_w::ConvPla(l, r);
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, mean_conv_drt());
+  auto view_mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, view_drt);
+  ASSERT_EQ(mbrs.size(), series.size() - seq_size);
+  ASSERT_EQ(view_mbrs.size(), mbrs.size());
+
+  // the same covers as approximating a copy of each subsequence, up to the rounding of the regressions
+  for (unsigned int i=0; i<mbrs.size(); i++) {
+    std::vector<double> q(series.begin()+i, series.begin()+i+seq_size);
+    auto copied = apla_bounds::vec_to_mbr<NS>(q, mean_conv_drt());
+    for (unsigned int ri=0; ri<NS; ri++) {
+      EXPECT_EQ(mbrs[i][ri].min_i, copied[ri].min_i);
+      EXPECT_EQ(mbrs[i][ri].max_i, copied[ri].max_i);
+      EXPECT_NEAR(mbrs[i][ri].min_dp[0], copied[ri].min_dp[0], 1e-9);
+      EXPECT_NEAR(mbrs[i][ri].min_dp[1], copied[ri].min_dp[1], 1e-9);
+      EXPECT_NEAR(mbrs[i][ri].max_dp[0], copied[ri].max_dp[0], 1e-9);
+      EXPECT_NEAR(mbrs[i][ri].max_dp[1], copied[ri].max_dp[1], 1e-9);
+      EXPECT_EQ(view_mbrs[i][ri].min_dp, mbrs[i][ri].min_dp);
+      EXPECT_EQ(view_mbrs[i][ri].max_dp, mbrs[i][ri].max_dp);
+    }
+    EXPECT_NEAR(apla_bounds::dist_to_mbr_sqr<NS>(q, mbrs[i]), 0.0, 1e-9);
+  }
+}
+
+TEST(AplaBounds, ConvPlaRewrittenWindow) {
+  std::vector<double> series = z_normalised_walk(1'000, 20), other = z_normalised_walk(1'000, 21);
+  std::vector<double> l(5, 1/5.0), r(5, 1/5.0);
+  c_d_w::ConvPla conv(l, r);
+  std::vector<double> buffer(series.begin(), series.begin()+seq_size+2);
+  EXPECT_EQ(conv(buffer.data(), seq_size, 2*NS), c_d_w::conv_pla(buffer.data(), seq_size, 2*NS, l, r));
+  EXPECT_EQ(conv(buffer.data()+1, seq_size, 2*NS), c_d_w::conv_pla(buffer.data()+1, seq_size, 2*NS, l, r));
+
+  // the next window lies one past the last, but its points were rewritten so none of the scores can be reused
+  std::copy(other.begin(), other.begin()+seq_size+2, buffer.begin());
+  EXPECT_EQ(conv(buffer.data()+2, seq_size, 2*NS), c_d_w::conv_pla(buffer.data()+2, seq_size, 2*NS, l, r));
+}
+
+TEST(AplaBounds, SubseqMbrsParallel) {
+  std::vector<double> series = z_normalised_walk(1'500, 19);
+  std::vector<double> l(5, 1/5.0), r(5, 1/5.0);
+  auto mbrs = apla_bounds::vec_to_subseq_mbrs<NS>(series, seq_size, mean_conv_drt());
+  for (unsigned int num_threads : { 1, 3, 8 }) {
+    auto parallel_mbrs = apla_bounds::vec_to_subseq_mbrs_parallel<NS>(series, seq_size, mean_conv_drt(), num_threads);
+    auto view_mbrs = apla_bounds::vec_to_subseq_mbrs_parallel<NS>(series, seq_size, c_d_w::ConvPla(l, r), num_threads);
+    ASSERT_EQ(parallel_mbrs.size(), mbrs.size());
+    ASSERT_EQ(view_mbrs.size(), mbrs.size());
+    for (unsigned int i=0; i<mbrs.size(); i++) {
+      for (unsigned int ri=0; ri<NS; ri++) {
+	EXPECT_EQ(parallel_mbrs[i][ri].max_i, mbrs[i][ri].max_i);
+	EXPECT_NEAR(parallel_mbrs[i][ri].min_dp[0], mbrs[i][ri].min_dp[0], 1e-9);
+	EXPECT_NEAR(parallel_mbrs[i][ri].max_dp[1], mbrs[i][ri].max_dp[1], 1e-9);
+	EXPECT_EQ(view_mbrs[i][ri].max_i, mbrs[i][ri].max_i);
+	EXPECT_NEAR(view_mbrs[i][ri].max_dp[0], mbrs[i][ri].max_dp[0], 1e-9);
+      }
+    }
+  }
+  EXPECT_TRUE(apla_bounds::vec_to_subseq_mbrs_parallel<NS>(std::vector<double>(seq_size, 0.0), seq_size, mean_conv_drt()).empty());
+}
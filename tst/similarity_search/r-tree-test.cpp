@@ -1,4 +1,6 @@
 #include "r_tree.h"
+#include "windowed_r_tree.h"
+#include "sharded_r_tree.h"
 
 #include <gtest/gtest.h>
 
@@ -7,6 +9,8 @@
 #include <vector>
 #include <set>
 #include <algorithm>
+#include <string>
+#include <cstdio>
 
 typedef std::vector<double> MBR1D;
 
@@ -28,6 +32,43 @@ double mbr_1d_point_dist(const std::vector<double>& q, const MBR1D& r)
   return 0.0;
 }
 
+std::vector<double> mbr_1d_centre(const MBR1D& r)
+{
+  return { (r[0] + r[1]) / 2.0 };
+}
+
+// the values below max in a scrambled order, each twice, so trees built from them in order must reorder them
+std::vector<double> shuffled_nums(unsigned int max)
+{
+  std::vector<double> nums;
+  for (double i=0.0; i<=max; i+=0.5) {
+    nums.push_back( (int)(i*7919) % max );
+  }
+  return nums;
+}
+
+// retrieves the point of nums an entry indexes
+std::vector<std::array<const double*,2>> point_retrieve(const unsigned int& n, const std::vector<double>& s)
+{
+  return {{&s[n], &s[n]}};
+}
+
+// trivially copyable version of MBR1D so trees of it can be saved
+typedef std::array<double,2> FlatMBR1D;
+
+double area_flat_1d(const FlatMBR1D& mbr) { return mbr[1] - mbr[0]; }
+FlatMBR1D merge_flat_1d(const FlatMBR1D& a, const FlatMBR1D& b) { return { std::min(a[0], b[0]), std::max(a[1], b[1]) }; }
+double flat_1d_point_dist(const std::vector<double>& q, const FlatMBR1D& r) { return mbr_1d_point_dist(q, {r[0], r[1]}); }
+std::vector<double> flat_1d_centre(const FlatMBR1D& r) { return { (r[0] + r[1]) / 2.0 }; }
+
+struct Flat1DTraits {
+  static double area(const FlatMBR1D& r) { return area_flat_1d(r); }
+  static FlatMBR1D merge(const FlatMBR1D& a, const FlatMBR1D& b) { return merge_flat_1d(a, b); }
+  static double dist_sqr(const std::vector<double>& q, const FlatMBR1D& r) { return flat_1d_point_dist(q, r); }
+  static std::vector<double> centre(const FlatMBR1D& r) { return flat_1d_centre(r); }
+  static constexpr bool has_centre() { return true; }
+};
+
 
 TEST(RTree, RTreeInsert) {
   std::vector<double> nums;
@@ -106,3 +147,449 @@ TEST(RTree, RTreeAPCA) {
 
   EXPECT_EQ(expected_els, result);
 }
+
+TEST(RTree, RTreeBulkLoad) {
+  std::vector<double> nums = shuffled_nums(20'000); // STR must reorder them
+  std::vector<MBR1D> mbrs;
+  std::vector<unsigned int> indexes;
+  for (unsigned int i=0; i<nums.size(); i++) {
+    mbrs.push_back({nums[i], nums[i]});
+    indexes.push_back(i);
+  }
+
+  RTree<MBR1D, unsigned int> inserted(40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    inserted.insert(mbrs[i], i);
+  }
+  RTree<MBR1D, unsigned int> packed(40, 10, area_1d, merge_1d, mbr_1d_point_dist, mbr_1d_centre);
+  packed.bulk_load(mbrs, indexes);
+
+  EXPECT_EQ(packed.get_num_leaves(), nums.size());
+  EXPECT_EQ(packed.get_size_leaves(), inserted.get_size_leaves());
+  EXPECT_LE(packed.get_size_tree(), inserted.get_size_tree());
+
+  for (double q : {0.0, 1234.0, 19'999.0}) {
+    std::vector<unsigned int> packed_res = packed.sim_search({q}, 2.0);
+    std::vector<unsigned int> inserted_res = inserted.sim_search({q}, 2.0);
+    std::sort(packed_res.begin(), packed_res.end());
+    std::sort(inserted_res.begin(), inserted_res.end());
+    EXPECT_EQ(packed_res, inserted_res);
+  }
+}
+
+// 2d points, {x min, x max, y min, y max}
+typedef std::array<double,4> FlatMBR2D;
+
+struct Flat2DTraits {
+  static double area(const FlatMBR2D& r) { return (r[1] - r[0]) * (r[3] - r[2]); }
+  static FlatMBR2D merge(const FlatMBR2D& a, const FlatMBR2D& b) { return { std::min(a[0], b[0]), std::max(a[1], b[1]), std::min(a[2], b[2]), std::max(a[3], b[3]) }; }
+  static double dist_sqr(const std::vector<double>& q, const FlatMBR2D& r)
+  {
+    double dx = std::max({ r[0] - q[0], 0.0, q[0] - r[1] }), dy = std::max({ r[2] - q[1], 0.0, q[1] - r[3] });
+    return dx*dx + dy*dy;
+  }
+  static std::vector<double> centre(const FlatMBR2D& r) { return { (r[0] + r[1]) / 2.0, (r[2] + r[3]) / 2.0 }; }
+  static constexpr bool has_centre() { return true; }
+};
+
+TEST(RTree, RTreeBulkLoadTilesSlices) {
+  // 61 x 61 points make 94 pages of 40 in 10 slices of x, the last of them short, so nodes spread over the whole run
+  // rather than within each slice would straddle slices and span all of y
+  const unsigned int side = 61;
+  std::vector<double> coords;
+  std::vector<FlatMBR2D> mbrs;
+  std::vector<unsigned int> indexes;
+  for (unsigned int i=0; i<side*side; i++) {
+    double x = (i*7919) % (side*side) / side, y = (i*7919) % side;
+    coords.insert(coords.end(), { x, y });
+    mbrs.push_back({ x, x, y, y });
+    indexes.push_back(i);
+  }
+  RTree<FlatMBR2D, unsigned int, SplitPolicy::QUADRATIC, Flat2DTraits> rtree(40, 10);
+  rtree.bulk_load(mbrs, indexes);
+  EXPECT_EQ(rtree.get_num_leaves(), side*side);
+
+  auto retrieve = [](const unsigned int& n, const std::vector<double>& s){ return std::vector<std::array<const double*,2>>({{&s[2*n], &s[2*n+1]}}); };
+  RTreeSearchScratch scratch;
+  QueryStats stats;
+  for (unsigned int i=0; i<side*side; i+=13) {
+    std::vector<double> q = { coords[2*i] + 0.25, coords[2*i+1] + 0.25 };
+    auto res = rtree.sim_search_exact(q, 0.5, retrieve, coords, scratch, stats);
+    ASSERT_EQ(res.size(), 1u);
+    EXPECT_EQ(res[0][0], &coords[2*i]);
+  }
+  // a point is only in more than one leaf where a row of y is split between leaves (packing across slices visits ~3 a query)
+  EXPECT_LT(stats.nodes_visited[0], 3 * stats.num_queries / 2);
+}
+
+TEST(RTree, RTreeBatchSearch) {
+  std::vector<double> nums;
+  std::vector<MBR1D> mbrs;
+  std::vector<unsigned int> indexes;
+  for (double i=0.0; i<=20'000; i+=0.5) {
+    nums.push_back(i);
+    mbrs.push_back({i, i});
+    indexes.push_back(indexes.size());
+  }
+  RTree<MBR1D, unsigned int> rtree(40, 10, area_1d, merge_1d, mbr_1d_point_dist, mbr_1d_centre);
+  rtree.bulk_load(mbrs, indexes);
+
+  std::vector<std::vector<double>> qs;
+  for (double q=0.3; q<20'000; q+=97.1) qs.push_back({q});
+
+  auto knn_res = rtree.knn_search_batch(qs, 10, point_retrieve, nums, 4);
+  auto sim_res = rtree.sim_search_exact_batch(qs, 2.0, point_retrieve, nums, 4);
+  auto pp_res = rtree.pruning_power_batch(qs, point_retrieve, nums, 4);
+  ASSERT_EQ(knn_res.size(), qs.size());
+  ASSERT_EQ(sim_res.size(), qs.size());
+  ASSERT_EQ(pp_res.size(), qs.size());
+  for (unsigned int i=0; i<qs.size(); i++) {
+    EXPECT_EQ(knn_res[i], rtree.knn_search(qs[i], 10, point_retrieve, nums));
+    EXPECT_EQ(sim_res[i], rtree.sim_search_exact(qs[i], 2.0, point_retrieve, nums));
+    EXPECT_EQ(pp_res[i], rtree.pruning_power(qs[i], point_retrieve, nums));
+  }
+}
+
+template <SplitPolicy P>
+void expect_sim_search_with_policy(const std::vector<double>& nums)
+{
+  RTree<MBR1D, unsigned int, P> rtree(40, 10, area_1d, merge_1d, mbr_1d_point_dist, mbr_1d_centre);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    rtree.insert({nums[i], nums[i]}, i);
+  }
+  EXPECT_EQ(rtree.get_num_leaves(), nums.size());
+
+  for (double q : {0.0, 1234.0, 19'999.0}) {
+    std::vector<unsigned int> expected;
+    for (unsigned int i=0; i<nums.size(); i++) {
+      if (std::abs(nums[i] - q) <= 2.0) expected.push_back(i);
+    }
+    std::vector<unsigned int> res = rtree.sim_search({q}, 2.0);
+    std::sort(res.begin(), res.end());
+    EXPECT_EQ(res, expected);
+  }
+}
+
+TEST(RTree, RTreeSplitPolicies) {
+  std::vector<double> nums = shuffled_nums(20'000);
+  expect_sim_search_with_policy<SplitPolicy::QUADRATIC>(nums);
+  expect_sim_search_with_policy<SplitPolicy::LINEAR>(nums);
+  expect_sim_search_with_policy<SplitPolicy::RSTAR>(nums);
+}
+
+TEST(RTree, RTreeSaveOpenMapped) {
+  std::vector<double> nums = shuffled_nums(20'000);
+  RTree<FlatMBR1D, unsigned int> rtree(40, 10, area_flat_1d, merge_flat_1d, flat_1d_point_dist, flat_1d_centre);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    rtree.insert({nums[i], nums[i]}, i);
+  }
+  std::string path = ::testing::TempDir() + "r_tree_save_test.bin";
+  ASSERT_TRUE(rtree.save(path));
+
+  RTree<FlatMBR1D, unsigned int> mapped(40, 10, area_flat_1d, merge_flat_1d, flat_1d_point_dist, flat_1d_centre);
+  ASSERT_TRUE(mapped.open_mapped(path));
+  EXPECT_EQ(mapped.get_num_leaves(), rtree.get_num_leaves());
+  EXPECT_EQ(mapped.get_size_tree(), rtree.get_size_tree());
+
+  for (double q : {0.0, 1234.0, 19'999.0}) {
+    EXPECT_EQ(mapped.sim_search({q}, 2.0), rtree.sim_search({q}, 2.0));
+    EXPECT_EQ(mapped.knn_search({q}, 10, point_retrieve, nums), rtree.knn_search({q}, 10, point_retrieve, nums));
+  }
+
+  // the mapped tree can still grow, leaving the file untouched
+  mapped.insert({20'000.5, 20'000.5}, 0);
+  EXPECT_EQ(mapped.sim_search({20'000.5}, 0.1), std::vector<unsigned int>({0}));
+  RTree<FlatMBR1D, unsigned int> reopened(40, 10, area_flat_1d, merge_flat_1d, flat_1d_point_dist, flat_1d_centre);
+  ASSERT_TRUE(reopened.open_mapped(path));
+  EXPECT_EQ(reopened.get_num_leaves(), rtree.get_num_leaves());
+
+  RTree<FlatMBR1D, unsigned int> other_limits(20, 5, area_flat_1d, merge_flat_1d, flat_1d_point_dist, flat_1d_centre);
+  EXPECT_FALSE(other_limits.open_mapped(path));
+  std::remove(path.c_str());
+}
+
+TEST(RTree, RTreeStaticTraits) {
+  std::vector<double> nums = shuffled_nums(20'000);
+  RTree<FlatMBR1D, unsigned int> fptr_tree(40, 10, area_flat_1d, merge_flat_1d, flat_1d_point_dist, flat_1d_centre);
+  RTree<FlatMBR1D, unsigned int, SplitPolicy::QUADRATIC, Flat1DTraits> traits_tree(40, 10);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    fptr_tree.insert({nums[i], nums[i]}, i);
+    traits_tree.insert({nums[i], nums[i]}, i);
+  }
+  EXPECT_EQ(traits_tree.get_size_tree(), fptr_tree.get_size_tree());
+
+  for (double q : {0.0, 1234.0, 19'999.0}) {
+    EXPECT_EQ(traits_tree.sim_search({q}, 2.0), fptr_tree.sim_search({q}, 2.0));
+    EXPECT_EQ(traits_tree.knn_search({q}, 10, point_retrieve, nums), fptr_tree.knn_search({q}, 10, point_retrieve, nums));
+  }
+}
+
+TEST(RTree, RTreeNearestIterator) {
+  std::vector<double> nums = shuffled_nums(20'000);
+  RTree<MBR1D, unsigned int> rtree(40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    rtree.insert({nums[i], nums[i]}, i);
+  }
+
+  std::vector<double> q = {1234.3};
+  auto it = rtree.nearest(q, point_retrieve, nums);
+  std::vector<std::array<const double*,2>> paged;
+  for (int page=0; page<3; page++) {
+    auto next_page = it.next_page(10);
+    EXPECT_EQ(next_page.size(), 10);
+    paged.insert(paged.end(), next_page.begin(), next_page.end());
+  }
+  EXPECT_EQ(it.get_num_yielded(), 30);
+  EXPECT_EQ(paged, rtree.knn_search(q, 30, point_retrieve, nums));
+
+  double last_error = -1;
+  for (auto [lptr, rptr] : paged) {
+    double error = (*lptr - q[0]) * (*lptr - q[0]);
+    EXPECT_GE(error, last_error);
+    last_error = error;
+  }
+
+  // browsing runs through every subsequence in the end
+  auto small_it = rtree.nearest(q, point_retrieve, nums);
+  std::array<const double*,2> result;
+  double error;
+  unsigned int count = 0;
+  while (small_it.next(result, error)) count++;
+  EXPECT_EQ(count, nums.size());
+}
+
+// lower bounds the squared error between q and a window by their means, the window's mean held as a point mbr
+double window_mean_dist(const std::vector<double>& q, const MBR1D& r)
+{
+  double mean = 0.0;
+  for (double v : q) mean += v;
+  mean /= q.size();
+  return mbr_1d_point_dist({mean}, r) * q.size();
+}
+
+TEST(RTree, RTreeEarlyAbandonRefinement) {
+  const unsigned int seq_size = 200;
+  std::vector<double> nums;
+  for (int i=0; i<5'000; i++) nums.push_back( std::sin(i*0.05) * 10.0 + (i*7919) % 13 );
+  RTree<MBR1D, unsigned int> rtree(40, 10, area_1d, merge_1d, window_mean_dist);
+  for (unsigned int i=0; i+seq_size<=nums.size(); i++) {
+    double mean = 0.0;
+    for (unsigned int j=i; j<i+seq_size; j++) mean += nums[j];
+    mean /= seq_size;
+    rtree.insert({mean, mean}, i);
+  }
+  auto retrieve = [](const unsigned int& n, const std::vector<double>& s){ return std::vector<std::array<const double*,2>>({{&s[n], &s[n+seq_size-1]}}); };
+
+  std::vector<double> q(nums.begin()+1'000, nums.begin()+1'000+seq_size);
+  for (double& v : q) v += 0.5;
+  const double* q_end = q.data()+seq_size-1;
+
+  unsigned long skipped = 0;
+  double full = error_measures::se_between_ptrs(q.data(), q_end, &nums[3'000], &nums[3'000+seq_size-1]);
+  EXPECT_EQ(error_measures::se_between_ptrs_early_abandon(q.data(), q_end, &nums[3'000], &nums[3'000+seq_size-1], full, &skipped), full);
+  EXPECT_EQ(skipped, 0);
+  EXPECT_GT(error_measures::se_between_ptrs_early_abandon(q.data(), q_end, &nums[3'000], &nums[3'000+seq_size-1], full / 4, &skipped), full / 4);
+  EXPECT_GT(skipped, 0);
+
+  std::vector<double> errors;
+  for (unsigned int i=0; i+seq_size<=nums.size(); i++) {
+    errors.push_back( error_measures::se_between_ptrs(q.data(), q_end, &nums[i], &nums[i+seq_size-1]) );
+  }
+  std::sort(errors.begin(), errors.end());
+
+  RTreeSearchScratch scratch;
+  auto knn_res = rtree.knn_search(q, 10, retrieve, nums, scratch);
+  ASSERT_EQ(knn_res.size(), 10);
+  for (int i=0; i<10; i++) {
+    EXPECT_DOUBLE_EQ(error_measures::se_between_ptrs(q.data(), q_end, knn_res[i][0], knn_res[i][1]), errors[i]);
+  }
+  EXPECT_GT(scratch.points_skipped, 0);
+  EXPECT_LT(scratch.points_skipped, scratch.points_refined);
+
+  auto sim_res = rtree.sim_search_exact(q, std::sqrt(errors[4]), retrieve, nums, scratch);
+  EXPECT_EQ(sim_res.size(), 5);
+  EXPECT_EQ(rtree.pruning_power(q, retrieve, nums, scratch), rtree.pruning_power(q, retrieve, nums));
+}
+
+TEST(RTree, RTreeQueryStats) {
+  std::vector<double> nums = shuffled_nums(20'000);
+  RTree<MBR1D, unsigned int> rtree(40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    rtree.insert({nums[i], nums[i]}, i);
+  }
+  std::vector<std::vector<double>> qs = {{0.3}, {1234.3}, {19'999.7}};
+
+  RTreeSearchScratch scratch;
+  QueryStats merged;
+  for (const auto& q : qs) {
+    QueryStats stats;
+    EXPECT_EQ(rtree.knn_search(q, 10, point_retrieve, nums, scratch, stats), rtree.knn_search(q, 10, point_retrieve, nums));
+    EXPECT_EQ(stats.num_queries, 1);
+    ASSERT_GE(stats.nodes_visited.size(), 2);
+    EXPECT_EQ(stats.nodes_visited.back(), 1); // the root
+    EXPECT_GE(stats.entries_retrieved, 10);
+    EXPECT_EQ(stats.candidates_refined, stats.entries_retrieved);
+    EXPECT_LE(stats.entries_retrieved, stats.entries_checked);
+    EXPECT_LT(stats.entries_checked, stats.dist_calls);
+    EXPECT_GT(stats.max_queue_size, 0);
+    EXPECT_EQ(rtree.pruning_power(q, point_retrieve, nums), [&]{ QueryStats nn; rtree.knn_search(q, 1, point_retrieve, nums, scratch, nn); return nn.entries_retrieved / (double) rtree.get_num_leaves(); }());
+    merged.merge(stats);
+  }
+  EXPECT_EQ(merged.num_queries, qs.size());
+  EXPECT_EQ(merged.nodes_visited.back(), qs.size());
+
+  std::vector<QueryStats> batch_stats;
+  auto sim_res = rtree.sim_search_exact_batch(qs, 2.0, point_retrieve, nums, batch_stats, 2);
+  ASSERT_EQ(batch_stats.size(), qs.size());
+  for (unsigned int i=0; i<qs.size(); i++) {
+    EXPECT_EQ(sim_res[i], rtree.sim_search_exact(qs[i], 2.0, point_retrieve, nums));
+    EXPECT_EQ(batch_stats[i].candidates_refined, batch_stats[i].entries_retrieved);
+    EXPECT_GE(batch_stats[i].entries_retrieved, sim_res[i].size());
+  }
+}
+
+TEST(RTree, RTreeRemove) {
+  std::vector<double> nums = shuffled_nums(5'000);
+  RTree<MBR1D, unsigned int> rtree(40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    rtree.insert({nums[i], nums[i]}, i);
+  }
+  EXPECT_FALSE(rtree.remove({nums[3], nums[3]}, nums.size()));
+
+  std::vector<bool> removed(nums.size(), false);
+  unsigned int num_removed = 0;
+  for (unsigned int i=0; i<nums.size(); i+=3) {
+    EXPECT_TRUE(rtree.remove({nums[i], nums[i]}, i));
+    removed[i] = true;
+    num_removed++;
+  }
+  EXPECT_FALSE(rtree.remove({nums[0], nums[0]}, 0));
+  EXPECT_EQ(rtree.get_num_leaves(), nums.size() - num_removed);
+
+  for (double q : {0.0, 1234.0, 4'999.0}) {
+    std::vector<unsigned int> expected;
+    for (unsigned int i=0; i<nums.size(); i++) {
+      if (!removed[i] && std::abs(nums[i] - q) <= 2.0) expected.push_back(i);
+    }
+    std::vector<unsigned int> res = rtree.sim_search({q}, 2.0);
+    std::sort(res.begin(), res.end());
+    EXPECT_EQ(res, expected);
+  }
+
+  EXPECT_TRUE(rtree.update({nums[1], nums[1]}, {10'000, 10'000}, 1));
+  EXPECT_EQ(rtree.sim_search({10'000}, 0.0), std::vector<unsigned int>({1}));
+
+  for (unsigned int i=0; i<nums.size(); i++) {
+    if (!removed[i] && i != 1) {
+      EXPECT_TRUE(rtree.remove({nums[i], nums[i]}, i));
+    }
+  }
+  EXPECT_TRUE(rtree.remove({10'000, 10'000}, 1));
+  EXPECT_EQ(rtree.get_num_leaves(), 0);
+  EXPECT_EQ(rtree.get_size_tree(), 0);
+  rtree.insert({1.0, 1.0}, 0);
+  EXPECT_EQ(rtree.sim_search({1.0}, 0.0), std::vector<unsigned int>({0}));
+}
+
+TEST(RTree, WindowedRTree) {
+  std::vector<double> nums;
+  WindowedRTree<MBR1D, unsigned int> windowed(1'000, 40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  unsigned int max_size_tree = 0;
+  for (unsigned int i=0; i<20'000; i++) {
+    nums.push_back( (i*7919) % 5'000 );
+    windowed.insert({nums.back(), nums.back()}, i);
+    if (i >= 2'000) max_size_tree = std::max(max_size_tree, windowed.get_tree().get_size_tree());
+  }
+  EXPECT_EQ(windowed.size(), 1'000);
+  EXPECT_EQ(windowed.get_tree().get_num_leaves(), 1'000);
+  EXPECT_LT(max_size_tree, 1'000 + 1'000/10 * 2);
+
+  std::vector<unsigned int> res = windowed.get_tree().sim_search({2'500}, 200.0);
+  for (unsigned int i : res) EXPECT_GE(i, 19'000);
+  unsigned int expected = 0;
+  for (unsigned int i=19'000; i<20'000; i++) expected += std::abs(nums[i] - 2'500) <= 200.0;
+  EXPECT_EQ(res.size(), expected);
+}
+
+TEST(RTree, ShardedRTree) {
+  std::vector<double> nums = shuffled_nums(20'000);
+  std::vector<MBR1D> mbrs;
+  std::vector<unsigned int> indexes;
+  for (unsigned int i=0; i<nums.size(); i++) {
+    mbrs.push_back({nums[i], nums[i]});
+    indexes.push_back(i);
+  }
+  RTree<MBR1D, unsigned int> rtree(40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  rtree.bulk_load(mbrs, indexes);
+
+  for (bool bulk : {true, false}) {
+    ShardedRTree<MBR1D, unsigned int> sharded(7, 40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+    sharded.build(mbrs, indexes, bulk, 3);
+    unsigned int num_leaves = 0;
+    for (unsigned int i=0; i<sharded.get_num_shards(); i++) num_leaves += sharded.get_shard(i).get_num_leaves();
+    EXPECT_EQ(num_leaves, nums.size());
+
+    for (double q : {0.3, 1234.3, 19'999.7}) {
+      auto knn_res = sharded.knn_search({q}, 10, point_retrieve, nums, 3);
+      auto expected_knn = rtree.knn_search({q}, 10, point_retrieve, nums);
+      ASSERT_EQ(knn_res.size(), 10);
+      for (int i=0; i<10; i++) EXPECT_EQ(std::abs(*knn_res[i][0] - q), std::abs(*expected_knn[i][0] - q));
+
+      auto sim_res = sharded.sim_search_exact({q}, 2.0, point_retrieve, nums, 3);
+      auto expected_sim = rtree.sim_search_exact({q}, 2.0, point_retrieve, nums);
+      std::sort(sim_res.begin(), sim_res.end());
+      std::sort(expected_sim.begin(), expected_sim.end());
+      EXPECT_EQ(sim_res, expected_sim);
+    }
+  }
+}
+
+TEST(RTree, RTreeApproxKnn) {
+  std::vector<double> nums = shuffled_nums(20'000);
+  RTree<MBR1D, unsigned int> rtree(40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  for (unsigned int i=0; i<nums.size(); i++) {
+    rtree.insert({nums[i], nums[i]}, i);
+  }
+  std::vector<double> q = {1234.3};
+  auto exact = rtree.knn_search(q, 10, point_retrieve, nums);
+  auto dist = [&q](const std::array<const double*,2>& r) { return std::abs(*r[0] - q[0]); };
+
+  ApproxKnnResult unlimited = rtree.knn_search_approx(q, 10, point_retrieve, nums, ApproxKnnLimits());
+  EXPECT_TRUE(unlimited.exact);
+  EXPECT_EQ(unlimited.distance_ratio, 1.0);
+  ASSERT_EQ(unlimited.results.size(), 10);
+  for (int i=0; i<10; i++) EXPECT_EQ(dist(unlimited.results[i]), dist(exact[i]));
+
+  ApproxKnnLimits few_refinements;
+  few_refinements.max_refinements = 3;
+  ApproxKnnResult truncated = rtree.knn_search_approx(q, 10, point_retrieve, nums, few_refinements);
+  EXPECT_FALSE(truncated.exact);
+  EXPECT_EQ(truncated.results.size(), 3);
+  EXPECT_EQ(truncated.distance_ratio, std::numeric_limits<double>::infinity());
+
+  for (double epsilon : {0.5, 4.0}) {
+    ApproxKnnLimits ratio;
+    ratio.epsilon = epsilon;
+    ApproxKnnResult approx = rtree.knn_search_approx(q, 10, point_retrieve, nums, ratio);
+    ASSERT_EQ(approx.results.size(), 10);
+    EXPECT_LE(approx.distance_ratio, 1.0 + epsilon);
+    EXPECT_LE(dist(approx.results[9]), (1.0 + epsilon) * dist(exact[9]));
+    for (int i=1; i<10; i++) EXPECT_LE(dist(approx.results[i-1]), dist(approx.results[i]));
+  }
+
+  // entries retrieving three subsequences or none, so k can be more than the entries but fewer than the subsequences
+  RTree<MBR1D, unsigned int> triples(40, 10, area_1d, merge_1d, mbr_1d_point_dist);
+  for (unsigned int i=0; i<100; i++) triples.insert({nums[i], nums[i]}, i);
+  auto retrieve_triples = [](const unsigned int& n, const std::vector<double>& s){
+    if (n % 2) return std::vector<std::array<const double*,2>>();
+    return std::vector<std::array<const double*,2>>({{&s[n], &s[n]}, {&s[n+1], &s[n+1]}, {&s[n+2], &s[n+2]}});
+  };
+  ApproxKnnResult more_than_entries = triples.knn_search_approx(q, 120, retrieve_triples, nums, ApproxKnnLimits());
+  EXPECT_EQ(more_than_entries.results.size(), 120);
+  EXPECT_TRUE(more_than_entries.exact);
+  EXPECT_EQ(more_than_entries.distance_ratio, 1.0);
+  ApproxKnnResult all = triples.knn_search_approx(q, 200, retrieve_triples, nums, ApproxKnnLimits());
+  EXPECT_EQ(all.results.size(), 150);
+  EXPECT_TRUE(all.exhausted);
+  EXPECT_TRUE(all.exact);
+}
@@ -0,0 +1,217 @@
+#include "sequential_scan.h"
+#include "ucr_scan.h"
+#include "mass.h"
+#include "distance_kernels.h"
+#include "random_walk.h"
+#include "z_norm.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace {
+  const unsigned int seq_size = 128;
+
+  std::vector<double> z_normalised_walk(unsigned int size, unsigned int seed)
+  {
+    RandomWalk walk{ NormalFunctor(seed) };
+    walk.gen_steps(size);
+    std::vector<double> series(walk.get_walk().cbegin(), walk.get_walk().cend());
+    z_norm::z_normalise(series);
+    return series;
+  }
+
+  std::vector<double> sorted_dists(const std::vector<double>& series, const std::vector<double>& q, const std::vector<unsigned int>& indexes)
+  {
+    std::vector<double> dists;
+    for (unsigned int i : indexes) dists.push_back( seq_scan::l2_sqr(series.data()+i, q.data(), q.size()) );
+    std::sort(dists.begin(), dists.end());
+    return dists;
+  }
+}
+
+TEST(UcrScan, KimIsLowerBound) {
+  std::vector<double> series = z_normalised_walk(5'000, 1);
+  std::vector<double> q(series.begin()+1'000, series.begin()+1'000+seq_size);
+  ucr_scan::ScanQuery prepared = ucr_scan::prepare(q);
+  for (unsigned int i=0; i+seq_size<=series.size(); i+=7) {
+    double dist = seq_scan::l2_sqr(series.data()+i, q.data(), seq_size);
+    EXPECT_LE(ucr_scan::kim_lb_sqr(prepared, series.data()+i), dist * (1 + 1e-12));
+    EXPECT_NEAR(ucr_scan::l2_sqr_early_abandon(prepared, series.data()+i, dist * 2), dist, dist * 1e-12);
+  }
+}
+
+TEST(UcrScan, KimPointsSummedOnce) {
+  std::vector<double> series = z_normalised_walk(2'000, 4);
+  std::vector<double> q(series.begin()+500, series.begin()+500+seq_size);
+  ucr_scan::ScanQuery prepared = ucr_scan::prepare(q);
+  // the points the cascade has already summed come last, so the abandoning pass can stop short of them
+  std::vector<unsigned int> last(prepared.order.end()-4, prepared.order.end());
+  std::sort(last.begin(), last.end());
+  EXPECT_EQ(last, std::vector<unsigned int>({ 0, 1, seq_size-2, seq_size-1 }));
+  for (unsigned int i=0; i+5<prepared.order.size(); i++) {
+    EXPECT_GE(std::abs(prepared.ordered_q[i]), std::abs(prepared.ordered_q[i+1]));
+  }
+
+  // queries no longer than the cascade are settled by it alone
+  for (unsigned int n=1; n<=6; n++) {
+    std::vector<double> short_q(series.begin()+700, series.begin()+700+n);
+    for (double& v : short_q) v += 0.1;
+    std::vector<unsigned int> closest = ucr_scan::find_k_closest_indexes(series, short_q, 5);
+    EXPECT_EQ(sorted_dists(series, short_q, closest), sorted_dists(series, short_q, seq_scan::find_k_closest_indexes(series, short_q, 5)));
+  }
+}
+
+TEST(UcrScan, MatchesSequentialScan) {
+  std::vector<double> series = z_normalised_walk(20'000, 2);
+  std::vector<double> other = z_normalised_walk(2'000, 3);
+  for (unsigned int qi=0; qi+seq_size<other.size(); qi+=397) {
+    // a query from the series itself, perturbed, and one from another walk
+    std::vector<double> near(series.begin()+10*qi, series.begin()+10*qi+seq_size);
+    for (unsigned int i=0; i<seq_size; i++) near[i] += 0.01*other[qi+i];
+    std::vector<double> far(other.begin()+qi, other.begin()+qi+seq_size);
+
+    for (const std::vector<double>& q : { near, far }) {
+      for (double epsilon : { 0.5, 2.0, 8.0 }) {
+	ScanStats stats;
+	EXPECT_EQ(ucr_scan::find_similar_subseq_indexes(series, q, epsilon, &stats), seq_scan::find_similar_subseq_indexes(series, q, epsilon));
+	EXPECT_EQ(stats.candidates, series.size() - seq_size + 1);
+      }
+      for (unsigned int k : { 1, 10, 50 }) {
+	ScanStats stats;
+	std::vector<unsigned int> closest = ucr_scan::find_k_closest_indexes(series, q, k, &stats);
+	ASSERT_EQ(closest.size(), k);
+	std::vector<double> dists = sorted_dists(series, q, closest);
+	std::vector<double> expected = sorted_dists(series, q, seq_scan::find_k_closest_indexes(series, q, k));
+	for (unsigned int i=0; i<k; i++) EXPECT_DOUBLE_EQ(dists[i], expected[i]);
+	// returned closest first
+	EXPECT_EQ(sorted_dists(series, q, { closest.front() }).front(), dists.front());
+	EXPECT_GT(stats.kim_pruned + stats.abandoned, 0u);
+      }
+    }
+  }
+}
+
+TEST(SeqScan, KClosestKeepsK) {
+  seq_scan::KClosest closest(3);
+  EXPECT_EQ(closest.threshold(), std::numeric_limits<double>::infinity());
+  std::vector<double> dists = { 5.0, 1.0, 4.0, 3.0, 2.0, 6.0 };
+  for (unsigned int i=0; i<dists.size(); i++) closest.push(dists[i], i);
+  EXPECT_EQ(closest.threshold(), 3.0);
+  EXPECT_EQ(closest.indexes(), std::vector<unsigned int>({ 1, 4, 3 }));
+
+  seq_scan::KClosest none(0);
+  none.push(1.0, 0);
+  EXPECT_LT(none.threshold(), 0.0);
+  EXPECT_TRUE(none.indexes().empty());
+}
+
+TEST(SeqScan, KClosestMoreThanCandidates) {
+  std::vector<double> series = z_normalised_walk(seq_size + 9, 4);
+  std::vector<double> q(series.begin()+3, series.begin()+3+seq_size);
+  std::vector<unsigned int> closest = seq_scan::find_k_closest_indexes(series, q, 50);
+  ASSERT_EQ(closest.size(), series.size() - seq_size + 1);
+  EXPECT_EQ(closest.front(), 3u);
+  EXPECT_EQ(ucr_scan::find_k_closest_indexes(series, q, 50), closest);
+}
+
+TEST(Mass, DistanceProfiles) {
+  std::vector<double> series = z_normalised_walk(3'000, 5);
+  mass::PreparedSeries ps = mass::prepare(series);
+  for (unsigned int m : { 1, 7, 64, 1000 }) {
+    std::vector<double> q(series.begin()+500, series.begin()+500+m);
+    q[0] += 0.5;
+    std::vector<double> profile = mass::distance_profile_sqr(ps, q);
+    std::vector<double> znorm_profile = mass::znorm_distance_profile_sqr(ps, q);
+    ASSERT_EQ(profile.size(), series.size() - m + 1);
+    ASSERT_EQ(znorm_profile.size(), series.size() - m + 1);
+    const double tol = mass::tolerance(ps, q);
+    std::vector<double> zq( q );
+    z_norm::z_normalise(zq);
+    for (unsigned int i=0; i<profile.size(); i+=11) {
+      EXPECT_NEAR(profile[i], seq_scan::l2_sqr(series.data()+i, q.data(), m), tol);
+      if (m < 7) continue;
+      std::vector<double> window(series.begin()+i, series.begin()+i+m);
+      z_norm::z_normalise(window);
+      EXPECT_NEAR(znorm_profile[i], seq_scan::l2_sqr(window.data(), zq.data(), m), 1e-6 * m);
+    }
+  }
+}
+
+TEST(Mass, ScanMethodsAgree) {
+  std::vector<double> series = z_normalised_walk(20'000, 6);
+  std::vector<double> other = z_normalised_walk(20'000, 7);
+  for (unsigned int m : { 16, 300, 2'500 }) {
+    std::vector<double> near(series.begin()+7'000, series.begin()+7'000+m);
+    for (unsigned int i=0; i<m; i++) near[i] += 0.01*other[i];
+    std::vector<double> far(other.begin()+7'000, other.begin()+7'000+m);
+    for (const std::vector<double>& q : { near, far }) {
+      for (double epsilon : { 0.1, 0.5 * std::sqrt(m), 2.0 * std::sqrt(m) }) {
+	EXPECT_EQ(seq_scan::find_similar_subseq_indexes(series, q, epsilon, seq_scan::MASS), seq_scan::find_similar_subseq_indexes(series, q, epsilon, seq_scan::NAIVE));
+      }
+      for (unsigned int k : { 1, 10, 100 }) {
+	EXPECT_EQ(seq_scan::find_k_closest_indexes(series, q, k, seq_scan::MASS), seq_scan::find_k_closest_indexes(series, q, k, seq_scan::NAIVE));
+      }
+    }
+  }
+}
+
+TEST(DistanceKernels, KernelsAgree) {
+  std::vector<double> series = z_normalised_walk(5'000, 8);
+  for (unsigned int len : { 0, 1, 15, 16, 17, 100, 1'000 }) {
+    double scalar = distance_kernels::l2_sqr(series.data(), series.data()+2'000, len, distance_kernels::Kernel::SCALAR);
+    for (auto kernel : { distance_kernels::Kernel::SCALAR, distance_kernels::Kernel::AVX2, distance_kernels::Kernel::AVX512 }) {
+      if (!distance_kernels::kernel_supported(kernel)) continue;
+      double full = distance_kernels::l2_sqr(series.data(), series.data()+2'000, len, kernel);
+      EXPECT_NEAR(full, scalar, 1e-12 * scalar);
+      // giving a threshold the distance is under never changes it, and one it is over abandons it above the threshold
+      unsigned long skipped = 0;
+      EXPECT_EQ(distance_kernels::l2_sqr(series.data(), series.data()+2'000, len, kernel, full, &skipped), full);
+      EXPECT_EQ(skipped, 0u);
+      if (len >= 100) {
+	EXPECT_GT(distance_kernels::l2_sqr(series.data(), series.data()+2'000, len, kernel, full / 4, &skipped), full / 4);
+	EXPECT_GT(skipped, 0u);
+      }
+    }
+  }
+}
+
+TEST(SeqScan, ThreadsAgree) {
+  std::vector<double> series = z_normalised_walk(20'000, 9);
+  std::vector<double> q(series.begin()+4'000, series.begin()+4'000+64);
+  for (double& v : q) v += 0.05;
+  for (unsigned int num_threads : { 2, 3, 8 }) {
+    EXPECT_EQ(seq_scan::find_similar_subseq_indexes(series, q, 1.0, seq_scan::NAIVE, num_threads), seq_scan::find_similar_subseq_indexes(series, q, 1.0, seq_scan::NAIVE));
+    for (unsigned int k : { 1, 10, 100 }) {
+      EXPECT_EQ(seq_scan::find_k_closest_indexes(series, q, k, seq_scan::NAIVE, num_threads), seq_scan::find_k_closest_indexes(series, q, k, seq_scan::NAIVE));
+    }
+  }
+}
+
+TEST(SeqScan, BatchMatchesSingleQueries) {
+  std::vector<double> series = z_normalised_walk(40'000, 10);
+  std::vector<double> other = z_normalised_walk(20'000, 11);
+  std::vector<std::vector<double>> queries;
+  // the longer queries are answered by MASS
+  for (unsigned int m : { 8, 64, 200, 1'000, 2'500, 9'000 }) {
+    queries.emplace_back(series.begin()+17'000, series.begin()+17'000+m);
+    for (unsigned int i=0; i<m; i++) queries.back()[i] += 0.05*other[i];
+    queries.emplace_back(other.begin()+m, other.begin()+2*m);
+  }
+  queries.push_back( std::vector<double>(series.size(), 0.0) ); // no smaller than the series
+
+  for (unsigned int num_threads : { 1, 3 }) {
+    for (double epsilon : { -1.0, 0.5, 4.0 }) {
+      auto batch = seq_scan::find_similar_subseq_indexes_batch(series, queries, epsilon, num_threads);
+      ASSERT_EQ(batch.size(), queries.size());
+      for (unsigned int q=0; q<queries.size(); q++) EXPECT_EQ(batch[q], seq_scan::find_similar_subseq_indexes(series, queries[q], epsilon));
+    }
+    for (unsigned int k : { 0, 1, 25 }) {
+      auto batch = seq_scan::find_k_closest_indexes_batch(series, queries, k, num_threads);
+      ASSERT_EQ(batch.size(), queries.size());
+      for (unsigned int q=0; q<queries.size(); q++) EXPECT_EQ(batch[q], seq_scan::find_k_closest_indexes(series, queries[q], k));
+    }
+  }
+}